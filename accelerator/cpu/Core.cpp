@@ -0,0 +1,83 @@
+#include "Redwood/Core.hpp"
+
+#include <cstring>
+#include <iostream>
+#include <memory>
+
+#include "CpuUtils.hpp"
+#include "Redwood/Numa.hpp"
+
+namespace redwood {
+
+std::vector<std::unique_ptr<Stream>> streams;
+int stored_num_threads;
+int stored_num_streams;
+
+void Init(const int num_threads, const int num_streams) {
+  stored_num_threads = num_threads;
+  stored_num_streams = num_streams;
+  numa::AssignThreads(num_threads);
+
+  // One worker per (tid, stream_id) pair, running on the NUMA node of 'tid' so
+  // the batches it reduces stay local.
+  streams.clear();
+  streams.resize(num_threads * num_streams);
+  for (int tid = 0; tid < num_threads; ++tid) {
+    for (int stream_id = 0; stream_id < num_streams; ++stream_id) {
+      streams[tid * num_streams + stream_id] =
+          std::make_unique<Stream>(numa::NodeOf(tid));
+    }
+  }
+
+  std::cout << "[info] CPU backend started " << streams.size()
+            << " stream workers." << std::endl;
+}
+
+void DeviceSynchronize() {
+  for (const auto& stream : streams) {
+    stream->Synchronize();
+  }
+}
+
+void DeviceStreamSynchronize(const int tid, const int stream_id) {
+  streams[tid * stored_num_streams + stream_id]->Synchronize();
+}
+
+void AttachStreamMem(const int tid, const int stream_id, void* addr) {
+  // No Op, host memory is visible to every stream
+}
+
+void MemcpyAsync(void* dst, const void* src, const std::size_t bytes,
+                 const int tid, const int stream_id) {
+  streams[tid * stored_num_streams + stream_id]->Submit(
+      [=]() noexcept { std::memcpy(dst, src, bytes); });
+}
+
+Event CreateEvent() { return Event{new CpuEvent}; }
+
+void DestroyEvent(const Event event) {
+  delete static_cast<CpuEvent*>(event.handle);
+}
+
+void EventRecord(const Event event, const int tid, const int stream_id) {
+  const auto e = static_cast<CpuEvent*>(event.handle);
+  e->stream = streams[tid * stored_num_streams + stream_id].get();
+  e->ticket = e->stream->Ticket();
+}
+
+bool EventQuery(const Event event) {
+  const auto e = static_cast<const CpuEvent*>(event.handle);
+  return e->stream == nullptr || e->stream->Query(e->ticket);
+}
+
+void EventSynchronize(const Event event) {
+  const auto e = static_cast<const CpuEvent*>(event.handle);
+  if (e->stream != nullptr) e->stream->Wait(e->ticket);
+}
+
+bool StreamQuery(const int tid, const int stream_id) {
+  const auto& stream = streams[tid * stored_num_streams + stream_id];
+  return stream->Query(stream->Ticket());
+}
+
+}  // namespace redwood
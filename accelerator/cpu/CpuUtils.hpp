@@ -0,0 +1,101 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <queue>
+#include <thread>
+
+#include "Redwood/Numa.hpp"
+
+// The CPU equivalent of a 'cudaStream_t'. Each stream owns one worker thread
+// that executes submitted jobs in FIFO order, so the traversal thread can keep
+// going while the leaf reductions of the previous batch are being computed.
+// The worker is pinned to the CPUs of 'numa_node'.
+class Stream {
+ public:
+  explicit Stream(const int numa_node)
+      : numa_node_(numa_node), worker_([this] { Run(); }) {}
+
+  Stream(const Stream&) = delete;
+  Stream& operator=(const Stream&) = delete;
+
+  ~Stream() {
+    {
+      std::lock_guard<std::mutex> lock(mtx_);
+      stop_ = true;
+    }
+    job_cv_.notify_one();
+    worker_.join();
+  }
+
+  void Submit(std::function<void()> job) {
+    {
+      std::lock_guard<std::mutex> lock(mtx_);
+      jobs_.push(std::move(job));
+      ++num_submitted_;
+    }
+    job_cv_.notify_one();
+  }
+
+  // Jobs are numbered by submission order, starting from 1. A ticket captures
+  // all jobs submitted before it was taken.
+  uint64_t Ticket() {
+    std::lock_guard<std::mutex> lock(mtx_);
+    return num_submitted_;
+  }
+
+  bool Query(const uint64_t ticket) {
+    std::lock_guard<std::mutex> lock(mtx_);
+    return num_completed_ >= ticket;
+  }
+
+  void Wait(const uint64_t ticket) {
+    std::unique_lock<std::mutex> lock(mtx_);
+    done_cv_.wait(lock, [&] { return num_completed_ >= ticket; });
+  }
+
+  // Block until every job submitted so far has completed
+  void Synchronize() { Wait(Ticket()); }
+
+ private:
+  void Run() {
+    redwood::numa::PinToNode(numa_node_);
+
+    std::unique_lock<std::mutex> lock(mtx_);
+    while (true) {
+      job_cv_.wait(lock, [this] { return stop_ || !jobs_.empty(); });
+      if (jobs_.empty()) return;  // 'stop_' and nothing left to do
+
+      auto job = std::move(jobs_.front());
+      jobs_.pop();
+
+      lock.unlock();
+      job();
+      lock.lock();
+
+      ++num_completed_;
+      done_cv_.notify_all();
+    }
+  }
+
+  std::mutex mtx_;
+  std::condition_variable job_cv_;
+  std::condition_variable done_cv_;
+  std::queue<std::function<void()>> jobs_;
+  uint64_t num_submitted_ = 0;
+  uint64_t num_completed_ = 0;
+  bool stop_ = false;
+  int numa_node_;
+
+  // Must be the last member, so everything above is constructed before the
+  // worker starts running.
+  std::thread worker_;
+};
+
+// What a 'redwood::Event' handle points to on this backend
+struct CpuEvent {
+  Stream* stream = nullptr;
+  uint64_t ticket = 0;
+};
@@ -0,0 +1,80 @@
+#include "Redwood/Kernel.hpp"
+
+#include <memory>
+#include <vector>
+
+#include "CpuUtils.hpp"
+#include "Functors/DistanceMetrics.hpp"
+#include "Functors/LeafKernels.hpp"
+#include "Functors/ReduceOps.hpp"
+#include "Redwood/KernelRegistry.hpp"
+#include "Redwood/Point.hpp"
+
+namespace redwood {
+
+extern std::vector<std::unique_ptr<Stream>> streams;
+extern int stored_num_streams;
+
+////////////////////////////////////////////////////////////////////////////////
+// Wrapper function for kernel launch
+////////////////////////////////////////////////////////////////////////////////
+
+template <typename Functor, typename ReduceOp, int Dim, typename T>
+void LaunchReduction(const int tid, const int stream_id,
+                     const Point<Dim, T>* u_lnt, const int* u_lnt_offsets,
+                     const Point<Dim, T>* u_q, const int* u_node_idx,
+                     const int num_active,
+                     reduce::ValueOf<ReduceOp, T>* u_out) {
+  const auto my_stream_id = tid * stored_num_streams + stream_id;
+
+  streams[my_stream_id]->Submit([=] {
+    constexpr Functor functor;
+    for (int i = 0; i < num_active; ++i) {
+      const auto begin = u_lnt_offsets[u_node_idx[i]];
+      const auto end = u_lnt_offsets[u_node_idx[i] + 1];
+      const auto slot = u_out + i * ReduceOp::kStride;
+      reduce::ResetSlot<ReduceOp, T>(slot);
+      leaf::Reduce<ReduceOp>(functor, u_lnt + begin, end - begin, u_q[i], slot);
+    }
+  });
+}
+
+template <typename Functor, int Dim, typename T>
+void LaunchRadiusSearch(const int tid, const int stream_id,
+                        const Point<Dim, T>* u_lnt, const int* u_lnt_offsets,
+                        const Point<Dim, T>* u_q, const int* u_node_idx,
+                        const int num_active, const T radius, int* u_counts,
+                        int* u_matches, const int match_stride) {
+  const auto my_stream_id = tid * stored_num_streams + stream_id;
+
+  streams[my_stream_id]->Submit([=] {
+    constexpr Functor functor;
+    for (int i = 0; i < num_active; ++i) {
+      const auto begin = u_lnt_offsets[u_node_idx[i]];
+      const auto end = u_lnt_offsets[u_node_idx[i] + 1];
+      u_counts[i] = leaf::WithinRadius(functor, u_lnt + begin, end - begin,
+                                       u_q[i], radius,
+                                       u_matches + i * match_stride,
+                                       match_stride);
+    }
+  });
+}
+
+// Instantiating the ones we are using
+#define INSTANTIATE_REDUCTION(Functor, ReduceOp, PointT)                     \
+  template void LaunchReduction<Functor, ReduceOp>(                          \
+      int tid, int stream_id, const PointT* u_lnt, const int* u_lnt_offsets, \
+      const PointT* u_q, const int* u_node_idx, int num_active,              \
+      reduce::ValueOf<ReduceOp, PointT::Scalar>* u_out);
+
+REDWOOD_KERNEL_LIST(INSTANTIATE_REDUCTION)
+
+#define INSTANTIATE_RADIUS_SEARCH(Functor, PointT)                           \
+  template void LaunchRadiusSearch<Functor>(                                 \
+      int tid, int stream_id, const PointT* u_lnt, const int* u_lnt_offsets, \
+      const PointT* u_q, const int* u_node_idx, int num_active,              \
+      PointT::Scalar radius, int* u_counts, int* u_matches, int match_stride);
+
+REDWOOD_RADIUS_KERNEL_LIST(INSTANTIATE_RADIUS_SEARCH)
+
+}  // namespace redwood
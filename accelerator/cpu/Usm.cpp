@@ -0,0 +1,57 @@
+#include "Redwood/Usm.hpp"
+
+#include <cstdlib>
+#include <iostream>
+
+#include "Redwood/HostUsm.hpp"
+#include "Redwood/UsmPool.hpp"
+
+namespace redwood {
+
+// 'USM' is just host memory on this backend
+static UsmPool& Pool() {
+  static UsmPool pool(host::RawMalloc, host::RawFree);
+  return pool;
+}
+
+void* UsmMalloc(std::size_t n) {
+  void* tmp = Pool().Allocate(n);
+  if (host::options.verbose) {
+    std::cout << "accelerator::UsmMalloc() " << tmp << ": " << n << " bytes."
+              << std::endl;
+  }
+  return tmp;
+}
+
+// Mapped apart from the pool, see 'host::MapPlaced()'
+void* UsmMallocPlaced(const std::size_t n) {
+  void* tmp = Pool().AllocateUncached(n, host::MapPlaced, host::UnmapPlaced);
+  if (host::options.verbose) {
+    std::cout << "accelerator::UsmMallocPlaced() " << tmp << ": " << n
+              << " bytes." << std::endl;
+  }
+  return tmp;
+}
+
+void UsmFree(void* ptr) {
+  if (host::options.verbose) {
+    std::cout << "accelerator::UsmFree() " << ptr << std::endl;
+  }
+  if (ptr && !Pool().Free(ptr)) {
+    std::cerr << "[warning] UsmFree() of " << ptr
+              << ", which was not allocated by UsmMalloc()." << std::endl;
+  }
+}
+
+void SetUsmOptions(const UsmOptions& options) { host::options = options; }
+
+UsmStats GetUsmStats() { return Pool().Stats(); }
+
+void UsmTrim() { Pool().Trim(); }
+
+// The stream workers copy with 'memcpy()', any host memory will do
+void* HostMalloc(const std::size_t n) { return std::malloc(n); }
+
+void HostFree(void* ptr) { std::free(ptr); }
+
+}  // namespace redwood
@@ -1,10 +1,12 @@
 #include "CudaUtils.cuh"
 #include "Redwood/Core.hpp"
+#include "Redwood/Numa.hpp"
 
 namespace redwood {
 
 std::vector<cudaStream_t> streams;
 int stored_num_threads;
+int stored_num_streams;
 
 __global__ void CudaWarmup() {
   const auto tid = blockIdx.x * blockDim.x + threadIdx.x;
@@ -13,13 +15,15 @@ __global__ void CudaWarmup() {
   ib += ia + tid;
 }
 
-void Init(const int num_threads) {
+void Init(const int num_threads, const int num_streams) {
   stored_num_threads = num_threads;
+  stored_num_streams = num_streams;
+  numa::AssignThreads(num_threads);
 
-  streams.resize(num_threads * kNumStreams);
+  streams.resize(num_threads * num_streams);
   for (int tid = 0; tid < num_threads; ++tid) {
-    for (int stream_id = 0; stream_id < kNumStreams; stream_id++) {
-      HANDLE_ERROR(cudaStreamCreate(&streams[tid * kNumStreams + stream_id]));
+    for (int stream_id = 0; stream_id < num_streams; stream_id++) {
+      HANDLE_ERROR(cudaStreamCreate(&streams[tid * stored_num_streams + stream_id]));
     }
   }
 
@@ -30,11 +34,50 @@ void Init(const int num_threads) {
 void DeviceSynchronize() { HANDLE_ERROR(cudaDeviceSynchronize()); }
 
 void DeviceStreamSynchronize(const int tid, const int stream_id) {
-  HANDLE_ERROR(cudaStreamSynchronize(streams[tid * kNumStreams + stream_id]));
+  HANDLE_ERROR(cudaStreamSynchronize(streams[tid * stored_num_streams + stream_id]));
 }
 
 void AttachStreamMem(const int tid, const int stream_id, void* addr) {
-  cudaStreamAttachMemAsync(streams[tid * kNumStreams + stream_id], addr);
+  cudaStreamAttachMemAsync(streams[tid * stored_num_streams + stream_id], addr);
+}
+
+void MemcpyAsync(void* dst, const void* src, const std::size_t bytes,
+                 const int tid, const int stream_id) {
+  HANDLE_ERROR(cudaMemcpyAsync(dst, src, bytes, cudaMemcpyDefault,
+                               streams[tid * stored_num_streams + stream_id]));
+}
+
+Event CreateEvent() {
+  cudaEvent_t event;
+  HANDLE_ERROR(cudaEventCreateWithFlags(&event, cudaEventDisableTiming));
+  return Event{event};
+}
+
+void DestroyEvent(const Event event) {
+  HANDLE_ERROR(cudaEventDestroy(static_cast<cudaEvent_t>(event.handle)));
+}
+
+void EventRecord(const Event event, const int tid, const int stream_id) {
+  HANDLE_ERROR(cudaEventRecord(static_cast<cudaEvent_t>(event.handle),
+                               streams[tid * stored_num_streams + stream_id]));
+}
+
+bool EventQuery(const Event event) {
+  const auto err = cudaEventQuery(static_cast<cudaEvent_t>(event.handle));
+  if (err == cudaErrorNotReady) return false;
+  HANDLE_ERROR(err);
+  return true;
+}
+
+void EventSynchronize(const Event event) {
+  HANDLE_ERROR(cudaEventSynchronize(static_cast<cudaEvent_t>(event.handle)));
+}
+
+bool StreamQuery(const int tid, const int stream_id) {
+  const auto err = cudaStreamQuery(streams[tid * stored_num_streams + stream_id]);
+  if (err == cudaErrorNotReady) return false;
+  HANDLE_ERROR(err);
+  return true;
 }
 
 }  // namespace redwood
\ No newline at end of file
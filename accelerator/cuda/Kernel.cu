@@ -3,35 +3,80 @@
 
 #include "CudaUtils.cuh"
 #include "Functors/DistanceMetrics.hpp"
+#include "LeafReductions.cuh"
 #include "Redwood/Kernel.hpp"
+#include "Redwood/KernelRegistry.hpp"
 #include "Redwood/Point.hpp"
-#include "nn/Reductions.cuh"
 
 namespace redwood {
 
 extern std::vector<cudaStream_t> streams;
+extern int stored_num_streams;
 
 ////////////////////////////////////////////////////////////////////////////////
 // Wrapper function for kernel launch
 ////////////////////////////////////////////////////////////////////////////////
 
-template <typename T, typename Functor>
-void NearestNeighborKernel(const int tid, int stream_id, const T* u_lnt,
-                           int max_leaf_size, const T* u_q,
-                           const int* u_node_idx, int num_active, float* u_out,
-                           Functor functor) {
-  constexpr dim3 dim_grid(1, 1, 1);
-  constexpr dim3 dim_block(1024, 1, 1);
+template <typename Functor, typename ReduceOp, int Dim, typename T>
+void LaunchReduction(const int tid, const int stream_id,
+                     const Point<Dim, T>* u_lnt, const int* u_lnt_offsets,
+                     const Point<Dim, T>* u_q, const int* u_node_idx,
+                     const int num_active,
+                     reduce::ValueOf<ReduceOp, T>* u_out) {
+  if (num_active == 0) return;
+
+  constexpr auto block_size = 256;
   constexpr auto smem_size = 0;
-  const auto my_stream_id = tid * kNumStreams + stream_id;
-  FindMinDistWarp6<<<dim_grid, dim_block, smem_size, streams[my_stream_id]>>>(
-      u_lnt, u_q, u_node_idx, u_out, num_active, max_leaf_size, functor);
+  const auto my_stream_id = tid * stored_num_streams + stream_id;
+
+  if constexpr (ReduceOp::kAssociative) {
+    constexpr auto warps_per_block = block_size / 32;
+    const auto num_blocks =
+        (num_active + warps_per_block - 1) / warps_per_block;
+    LeafReduceWarp<Functor, ReduceOp>
+        <<<num_blocks, block_size, smem_size, streams[my_stream_id]>>>(
+            u_lnt, u_lnt_offsets, u_q, u_node_idx, u_out, num_active);
+  } else {
+    const auto num_blocks = (num_active + block_size - 1) / block_size;
+    LeafReduceThread<Functor, ReduceOp>
+        <<<num_blocks, block_size, smem_size, streams[my_stream_id]>>>(
+            u_lnt, u_lnt_offsets, u_q, u_node_idx, u_out, num_active);
+  }
+}
+
+template <typename Functor, int Dim, typename T>
+void LaunchRadiusSearch(const int tid, const int stream_id,
+                        const Point<Dim, T>* u_lnt, const int* u_lnt_offsets,
+                        const Point<Dim, T>* u_q, const int* u_node_idx,
+                        const int num_active, const T radius, int* u_counts,
+                        int* u_matches, const int match_stride) {
+  if (num_active == 0) return;
+
+  constexpr auto block_size = 256;
+  constexpr auto smem_size = 0;
+  const auto my_stream_id = tid * stored_num_streams + stream_id;
+  const auto num_blocks = (num_active + block_size - 1) / block_size;
+  LeafRadiusThread<Functor>
+      <<<num_blocks, block_size, smem_size, streams[my_stream_id]>>>(
+          u_lnt, u_lnt_offsets, u_q, u_node_idx, radius, u_counts, u_matches,
+          match_stride, num_active);
 }
 
 // Instantiating the ones we are using
-template void NearestNeighborKernel<Point4F, dist::Euclidean>(
-    int tid, int stream_id, const Point4F* u_lnt, int max_leaf_size,
-    const Point4F* u_q, const int* u_node_idx, int num_active, float* u_out,
-    dist::Euclidean functor_type);
+#define INSTANTIATE_REDUCTION(Functor, ReduceOp, PointT)                     \
+  template void LaunchReduction<Functor, ReduceOp>(                          \
+      int tid, int stream_id, const PointT* u_lnt, const int* u_lnt_offsets, \
+      const PointT* u_q, const int* u_node_idx, int num_active,              \
+      reduce::ValueOf<ReduceOp, PointT::Scalar>* u_out);
+
+REDWOOD_KERNEL_LIST(INSTANTIATE_REDUCTION)
+
+#define INSTANTIATE_RADIUS_SEARCH(Functor, PointT)                           \
+  template void LaunchRadiusSearch<Functor>(                                 \
+      int tid, int stream_id, const PointT* u_lnt, const int* u_lnt_offsets, \
+      const PointT* u_q, const int* u_node_idx, int num_active,              \
+      PointT::Scalar radius, int* u_counts, int* u_matches, int match_stride);
+
+REDWOOD_RADIUS_KERNEL_LIST(INSTANTIATE_RADIUS_SEARCH)
 
 }  // namespace redwood
\ No newline at end of file
@@ -0,0 +1,112 @@
+#pragma once
+
+#include <cooperative_groups.h>
+#include <device_launch_parameters.h>
+
+#include "Functors/ReduceOps.hpp"
+#include "Redwood/Point.hpp"
+
+namespace cg = cooperative_groups;
+
+// Generic kernels behind 'redwood::LaunchReduction()'. The functor and the
+// reduce op are template parameters, so each pair gets its own fully inlined
+// kernel. Leaf 'j' is 'lnt[lnt_offsets[j]]' to 'lnt[lnt_offsets[j + 1] - 1]'.
+// The points are any 'Point<Dim, T>', the values are in 'T'. Each value goes
+// with the position of its point in the leaf, see 'reduce::Entry'.
+
+// One warp per item of the batch, lanes stride over the leaf and the partial
+// results are combined with warp shuffles (of whole entries, value and
+// position). For associative ops only.
+template <typename Functor, typename ReduceOp, int Dim, typename T>
+__global__ void LeafReduceWarp(const Point<Dim, T>* lnt, const int* lnt_offsets,
+                               const Point<Dim, T>* u_q, const int* u_node_idx,
+                               reduce::ValueOf<ReduceOp, T>* u_out,
+                               const int num_active) {
+  constexpr auto warp_size = 32u;
+  const Functor functor{};
+
+  const auto cta = cg::this_thread_block();
+  const auto warp = cg::tiled_partition<warp_size>(cta);
+
+  const int warps_per_block = blockDim.x / warp_size;
+  const int num_warps = gridDim.x * warps_per_block;
+  const int lane_id = warp.thread_rank();
+
+  for (int item = blockIdx.x * warps_per_block + threadIdx.x / warp_size;
+       item < num_active; item += num_warps) {
+    const auto begin = lnt_offsets[u_node_idx[item]];
+    const auto end = lnt_offsets[u_node_idx[item] + 1];
+    const auto q = u_q[item];
+
+    auto acc = ReduceOp::template Identity<T>();
+    for (int j = begin + lane_id; j < end; j += warp_size) {
+      const auto value = ReduceOp::Make(functor(lnt[j], q), j - begin);
+      acc = ReduceOp::Combine(acc, value);
+    }
+
+    for (int offset = warp_size / 2; offset > 0; offset /= 2) {
+      acc = ReduceOp::Combine(acc, warp.shfl_down(acc, offset));
+    }
+
+    if (lane_id == 0) {
+      const auto slot = u_out + item * ReduceOp::kStride;
+      reduce::ResetSlot<ReduceOp, T>(slot);
+      ReduceOp::Insert(slot, acc);
+    }
+  }
+}
+
+// One thread per item of the batch, for ops that need the whole result slot,
+// e.g., 'reduce::TopK'.
+template <typename Functor, typename ReduceOp, int Dim, typename T>
+__global__ void LeafReduceThread(const Point<Dim, T>* lnt,
+                                 const int* lnt_offsets,
+                                 const Point<Dim, T>* u_q,
+                                 const int* u_node_idx,
+                                 reduce::ValueOf<ReduceOp, T>* u_out,
+                                 const int num_active) {
+  const Functor functor{};
+
+  for (int item = blockIdx.x * blockDim.x + threadIdx.x; item < num_active;
+       item += gridDim.x * blockDim.x) {
+    const auto begin = lnt_offsets[u_node_idx[item]];
+    const auto end = lnt_offsets[u_node_idx[item] + 1];
+    const auto q = u_q[item];
+    const auto slot = u_out + item * ReduceOp::kStride;
+
+    reduce::ResetSlot<ReduceOp, T>(slot);
+    for (int j = begin; j < end; ++j) {
+      ReduceOp::Insert(slot, ReduceOp::Make(functor(lnt[j], q), j - begin));
+    }
+  }
+}
+
+// One thread per item of the batch, behind 'redwood::LaunchRadiusSearch()'.
+// The matches are written in leaf order, the count is always exact.
+template <typename Functor, int Dim, typename T>
+__global__ void LeafRadiusThread(const Point<Dim, T>* lnt,
+                                 const int* lnt_offsets,
+                                 const Point<Dim, T>* u_q,
+                                 const int* u_node_idx, const T radius,
+                                 int* u_counts, int* u_matches,
+                                 const int match_stride,
+                                 const int num_active) {
+  const Functor functor{};
+
+  for (int item = blockIdx.x * blockDim.x + threadIdx.x; item < num_active;
+       item += gridDim.x * blockDim.x) {
+    const auto begin = lnt_offsets[u_node_idx[item]];
+    const auto end = lnt_offsets[u_node_idx[item] + 1];
+    const auto q = u_q[item];
+    const auto slot = u_matches + item * match_stride;
+
+    auto count = 0;
+    for (int j = begin; j < end; ++j) {
+      if (functor(lnt[j], q) < radius) {
+        if (count < match_stride) slot[count] = j - begin;
+        ++count;
+      }
+    }
+    u_counts[item] = count;
+  }
+}
@@ -2,22 +2,68 @@
 
 #include "CudaUtils.cuh"
 #include "Redwood/Usm.hpp"
+#include "Redwood/UsmPool.hpp"
 
 namespace redwood {
 
-void* UsmMalloc(std::size_t n) {
+static UsmOptions usm_options;
+
+static void* RawMalloc(const std::size_t bytes) {
   void* tmp;
-  HANDLE_ERROR(cudaMallocManaged(&tmp, n));
-  std::cout << "accelerator::UsmMalloc() " << tmp << ": " << n << " bytes."
-            << std::endl;
+  HANDLE_ERROR(cudaMallocManaged(&tmp, bytes));
+  return tmp;
+}
+
+static void RawFree(void* ptr, std::size_t) { HANDLE_ERROR(cudaFree(ptr)); }
+
+static UsmPool& Pool() {
+  static UsmPool pool(RawMalloc, RawFree);
+  return pool;
+}
+
+void* UsmMalloc(std::size_t n) {
+  void* tmp = Pool().Allocate(n);
+  if (usm_options.verbose) {
+    std::cout << "accelerator::UsmMalloc() " << tmp << ": " << n << " bytes."
+              << std::endl;
+  }
+  return tmp;
+}
+
+// Not pooled, the pages of a fresh block have not been migrated anywhere yet
+void* UsmMallocPlaced(const std::size_t n) {
+  void* tmp = Pool().AllocateUncached(n);
+  if (usm_options.verbose) {
+    std::cout << "accelerator::UsmMallocPlaced() " << tmp << ": " << n
+              << " bytes." << std::endl;
+  }
   return tmp;
 }
 
 void UsmFree(void* ptr) {
-  std::cout << "accelerator::UsmFree() " << ptr << std::endl;
-  if (ptr) {
-    HANDLE_ERROR(cudaFree(ptr));
+  if (usm_options.verbose) {
+    std::cout << "accelerator::UsmFree() " << ptr << std::endl;
+  }
+  if (ptr && !Pool().Free(ptr)) {
+    std::cerr << "[warning] UsmFree() of " << ptr
+              << ", which was not allocated by UsmMalloc()." << std::endl;
   }
 }
 
-}  // namespace redwood
\ No newline at end of file
+// Huge pages and pre-faulting are host only, managed memory is migrated by the
+// driver.
+void SetUsmOptions(const UsmOptions& options) { usm_options = options; }
+
+UsmStats GetUsmStats() { return Pool().Stats(); }
+
+void UsmTrim() { Pool().Trim(); }
+
+void* HostMalloc(const std::size_t n) {
+  void* tmp;
+  HANDLE_ERROR(cudaMallocHost(&tmp, n));
+  return tmp;
+}
+
+void HostFree(void* ptr) { HANDLE_ERROR(cudaFreeHost(ptr)); }
+
+}  // namespace redwood
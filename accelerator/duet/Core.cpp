@@ -5,25 +5,56 @@
 #include <sys/stat.h>
 
 #include <cassert>
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
+#include <memory>
+#include <thread>
 #include <vector>
 
 #include "Redwood/Duet/Consts.hpp"
+#include "Redwood/Duet/DuetAPI.hpp"
+#include "Redwood/Numa.hpp"
 #include "Redwood/Point.hpp"
+#include "barnes/Emulator.hpp"
+#include "barnes/Engines.hpp"
 
 // Main entry for Duet
 // Makesure this is the only decleration
 volatile uint64_t* duet_baseaddr = nullptr;
 
+// True when running on the software model instead of '/dev/duet'
+bool duet_emulated = false;
+
 std::vector<int> reduction_called_counter;
 
+namespace duet {
+
+int stored_num_engines = kNEngine;
+
+void SetNumEngines(const int num_engines) {
+  assert(num_engines > 0 && num_engines <= kMaxEngines);
+  stored_num_engines = num_engines;
+}
+
+int NumEngines() { return stored_num_engines; }
+
+}  // namespace duet
+
 namespace redwood {
 
-void Init() {
+std::unique_ptr<duet::Emulator> emulator;
+int stored_num_threads;
+
+void Init(const int num_threads, const int num_streams) {
   std::cout << "redwood::Init()" << std::endl;
+  numa::AssignThreads(num_threads);
+  stored_num_threads = num_threads;
+
+  // Each engine is a 8 KB register window, at 'i << 10' words
+  const long num_engines = duet::NumEngines();
 
   const unsigned leaf_size = 64;
-  const unsigned num_threads = 1;
 
   assert(leaf_size % duet::kDuetLeafSize == 0);
 
@@ -31,30 +62,82 @@ void Init() {
   int fd = open("/dev/duet", O_RDWR);
 
   if (fd == -1) {
+    // Registers must start zeroed, the emulator treats 'kArg != 0' as a push
     duet_baseaddr =
-        static_cast<volatile uint64_t*>(malloc(duet::kNEngine << 13));
+        static_cast<volatile uint64_t*>(calloc(num_engines << 13, 1));
+    duet_emulated = true;
 
-    std::cout << "[info] Failed to open \'/dev/duet\', using malloc instead!"
+    std::cout << "[info] Failed to open \'/dev/duet\', using the software "
+                 "emulator instead!"
               << std::endl;
 
   } else {
     // Only useful when we are simulating in Gem5
     duet_baseaddr = static_cast<volatile uint64_t*>(
-        mmap(nullptr, duet::kNEngine << 13, PROT_READ | PROT_WRITE, MAP_PRIVATE,
+        mmap(nullptr, num_engines << 13, PROT_READ | PROT_WRITE, MAP_PRIVATE,
              fd, 0));
   }
 
-  for (long i = 0; i < duet::kNEngine; ++i) {
+  for (long i = 0; i < num_engines; ++i) {
     duet_baseaddr[i << 10] = static_cast<uint64_t>(duet::kEpssq);
   }
 
-  std::cout << "[info] Duet engine has been initialized!" << std::endl;
+  duet::AssignEngines(num_threads, num_engines);
+
+  if (duet_emulated) {
+    emulator = std::make_unique<duet::Emulator>(
+        duet_baseaddr, num_engines,
+        duet::CallersPerEngine(num_threads, num_engines));
+  }
+
+  std::cout << "[info] " << num_engines
+            << " Duet engine(s) have been initialized!" << std::endl;
+}
+
+void DeviceSynchronize() {
+  for (int tid = 0; tid < stored_num_threads; ++tid) duet::Wait(tid);
 }
 
-void DeviceSynchronize() {}
+// Waits for all the engines of the thread, 'stream_id' does not matter
+void DeviceStreamSynchronize(int tid, int stream_id) { duet::Wait(tid); }
+
+void AttachStreamMem(int tid, int stream_id, void* addr) {}
+
+// Synchronous, the engines write their results to registers, not memory
+void MemcpyAsync(void* dst, const void* src, std::size_t bytes, int tid,
+                 int stream_id) {
+  duet::Wait(tid);
+  std::memcpy(dst, src, bytes);
+}
 
-void DeviceStreamSynchronize(int stream_id) {}
+// The engines have no streams, an event captures all the leaves its thread
+// pushed so far: the finish counts they reach once those are reduced
+struct DuetEvent {
+  long tid = -1;
+  std::vector<uint64_t> counts;
+};
 
-void AttachStreamMem(int stream_id, void* addr) {}
+Event CreateEvent() { return Event{new DuetEvent}; }
+
+void DestroyEvent(Event event) { delete static_cast<DuetEvent*>(event.handle); }
+
+void EventRecord(Event event, int tid, int stream_id) {
+  const auto e = static_cast<DuetEvent*>(event.handle);
+  e->tid = tid;
+  e->counts = duet::FinishCounts(tid);
+}
+
+bool EventQuery(Event event) {
+  const auto e = static_cast<const DuetEvent*>(event.handle);
+  return e->tid < 0 || duet::Reached(e->tid, e->counts);
+}
+
+void EventSynchronize(Event event) {
+  while (!EventQuery(event)) std::this_thread::yield();
+}
+
+bool StreamQuery(int tid, int stream_id) {
+  return duet::Reached(tid, duet::FinishCounts(tid));
+}
 
 }  // namespace redwood
@@ -3,19 +3,50 @@
 #include <cstdlib>
 #include <iostream>
 
-constexpr auto kDuetAlignment = 64;
+#include "Redwood/HostUsm.hpp"
+#include "Redwood/UsmPool.hpp"
 
 namespace redwood {
 
+static UsmPool& Pool() {
+  static UsmPool pool(host::RawMalloc, host::RawFree);
+  return pool;
+}
+
 // 'USM'
 void* UsmMalloc(std::size_t n) {
-  std::cout << "std::aligned_alloc() " << n << std::endl;
-  return aligned_alloc(kDuetAlignment, n);
+  if (host::options.verbose) {
+    std::cout << "std::aligned_alloc() " << n << std::endl;
+  }
+  return Pool().Allocate(n);
+}
+
+void* UsmMallocPlaced(const std::size_t n) {
+  if (host::options.verbose) {
+    std::cout << "mmap() " << n << std::endl;
+  }
+  return Pool().AllocateUncached(n, host::MapPlaced, host::UnmapPlaced);
 }
 
 void UsmFree(void* ptr) {
-  std::cout << "std::free() " << ptr << std::endl;
-  if (ptr) free(ptr);
+  if (host::options.verbose) {
+    std::cout << "std::free() " << ptr << std::endl;
+  }
+  if (ptr && !Pool().Free(ptr)) {
+    std::cerr << "[warning] UsmFree() of " << ptr
+              << ", which was not allocated by UsmMalloc()." << std::endl;
+  }
 }
 
-}  // namespace redwood
\ No newline at end of file
+void SetUsmOptions(const UsmOptions& options) { host::options = options; }
+
+UsmStats GetUsmStats() { return Pool().Stats(); }
+
+void UsmTrim() { Pool().Trim(); }
+
+// 'MemcpyAsync()' is synchronous on this backend anyway
+void* HostMalloc(const std::size_t n) { return std::malloc(n); }
+
+void HostFree(void* ptr) { std::free(ptr); }
+
+}  // namespace redwood
@@ -1,30 +1,107 @@
+#include <algorithm>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+#include "Engines.hpp"
 #include "Redwood/Duet/Consts.hpp"
 #include "Redwood/Duet/DuetAPI.hpp"
 #include "Redwood/Point.hpp"
 #include "RegisterId.hpp"
 
 extern volatile uint64_t* duet_baseaddr;
+extern bool duet_emulated;
 
 namespace duet {
 
-void Start(const long tid, const void* query_element) {
-  auto ptr = reinterpret_cast<const Point3D*>(query_element);
+// Host side bookkeeping of one (thread, engine) pair. Registers are never
+// reset, so the results of a query are the difference with the values seen at
+// 'Start()'.
+struct Context {
+  volatile uint64_t* sri;
+  uint64_t num_pushed;
+  uint64_t fincnt_base;
+  double acc_base[3];
+};
+
+// [tid] -> the engine contexts owned by that thread
+std::vector<std::vector<Context>> thread_contexts;
+
+// [tid] -> the context the next leaf goes to (round-robin)
+std::vector<int> next_context;
+
+inline Context MakeContext(const int engine_id, const long caller_id) {
+  const auto engine_base = duet_baseaddr + engine_id * kEngineWords;
+  Context ctx{};
+  ctx.sri = CallerRegisters(engine_base, caller_id);
+  return ctx;
+}
 
-  const long caller_id = tid;
-  volatile uint64_t* sri = duet_baseaddr + (caller_id << 4) + 16;
+void AssignEngines(const int num_threads, const int num_engines) {
+  thread_contexts.assign(num_threads, {});
+  next_context.assign(num_threads, 0);
+
+  for (int tid = 0; tid < num_threads; ++tid) {
+    if (num_engines >= num_threads) {
+      // Each thread owns 'num_engines / num_threads' (or one more) engines
+      for (int engine_id = tid; engine_id < num_engines;
+           engine_id += num_threads) {
+        thread_contexts[tid].push_back(MakeContext(engine_id, 0));
+      }
+    } else {
+      // Engines are shared, one caller slot per thread
+      thread_contexts[tid].push_back(
+          MakeContext(tid % num_engines, tid / num_engines));
+    }
+  }
+}
+
+int CallersPerEngine(const int num_threads, const int num_engines) {
+  return (num_threads + num_engines - 1) / num_engines;
+}
+
+inline double LoadDouble(const volatile uint64_t* reg) {
+  const uint64_t bits = *reg;
+  double value;
+  std::memcpy(&value, &bits, sizeof(value));
+  return value;
+}
+
+inline uint64_t ToBits(const double value) {
+  uint64_t bits;
+  std::memcpy(&bits, &value, sizeof(bits));
+  return bits;
+}
+
+void Start(const long tid, const void* query_element) {
+  auto ptr = static_cast<const Point3D*>(query_element);
 
   if constexpr (duet::kDebugPrint) {
     std::cout << tid << ": started duet. " << ptr->data[0] << std::endl;
   }
 
-  sri[kPos0X] = *reinterpret_cast<const uint64_t*>(&ptr->data[0]);
-  sri[kPos0Y] = *reinterpret_cast<const uint64_t*>(&ptr->data[1]);
-  sri[kPos0Z] = *reinterpret_cast<const uint64_t*>(&ptr->data[2]);
+  // Leaves of the previous query must not see the new anchors
+  Wait(tid);
+
+  // Every engine of the thread gets the same anchors
+  for (auto& ctx : thread_contexts[tid]) {
+    volatile uint64_t* sri = ctx.sri;
+
+    ctx.num_pushed = 0;
+    ctx.fincnt_base = sri[kFincnt];
+    ctx.acc_base[0] = LoadDouble(&sri[kAccX]);
+    ctx.acc_base[1] = LoadDouble(&sri[kAccY]);
+    ctx.acc_base[2] = LoadDouble(&sri[kAccZ]);
+
+    sri[kPos0X] = ToBits(ptr->data[0]);
+    sri[kPos0Y] = ToBits(ptr->data[1]);
+    sri[kPos0Z] = ToBits(ptr->data[2]);
+  }
 }
 
 void PushLeaf32(const long tid, const void* node_base_addr) {
-  const long caller_id = tid;
-  volatile uint64_t* sri = duet_baseaddr + (caller_id << 4) + 16;
+  auto& contexts = thread_contexts[tid];
+  const auto num_contexts = static_cast<int>(contexts.size());
 
   if constexpr (kDebugPrint) {
     auto ptr = reinterpret_cast<const Point4D*>(node_base_addr);
@@ -32,7 +109,76 @@ void PushLeaf32(const long tid, const void* node_base_addr) {
               << "\taddress: " << node_base_addr << std::endl;
   }
 
-  sri[kArg] = reinterpret_cast<uint64_t>(node_base_addr);
+  // Round-robin over the thread's engines. When emulated, skip the ones still
+  // holding a leaf, so a slow engine does not stall the others.
+  auto& cursor = next_context[tid];
+  auto selected = cursor;
+  if (duet_emulated) {
+    for (int i = 0; i < num_contexts; ++i) {
+      const auto candidate = (cursor + i) % num_contexts;
+      if (__atomic_load_n(&contexts[candidate].sri[kArg], __ATOMIC_ACQUIRE) ==
+          0) {
+        selected = candidate;
+        break;
+      }
+    }
+  }
+  cursor = (selected + 1) % num_contexts;
+
+  auto& ctx = contexts[selected];
+  volatile uint64_t* sri = ctx.sri;
+  ++ctx.num_pushed;
+
+  if (duet_emulated) {
+    // The emulator has no queue, wait until it took the previous leaf
+    while (__atomic_load_n(&sri[kArg], __ATOMIC_ACQUIRE) != 0) {
+      std::this_thread::yield();
+    }
+    __atomic_store_n(&sri[kArg], reinterpret_cast<uint64_t>(node_base_addr),
+                     __ATOMIC_RELEASE);
+  } else {
+    sri[kArg] = reinterpret_cast<uint64_t>(node_base_addr);
+  }
+}
+
+void Wait(const long tid) {
+  for (const auto& ctx : thread_contexts[tid]) {
+    const auto expected = ctx.fincnt_base + ctx.num_pushed;
+    while (__atomic_load_n(&ctx.sri[kFincnt], __ATOMIC_ACQUIRE) < expected) {
+      std::this_thread::yield();
+    }
+  }
+}
+
+std::vector<uint64_t> FinishCounts(const long tid) {
+  std::vector<uint64_t> counts;
+  for (const auto& ctx : thread_contexts[tid]) {
+    counts.push_back(ctx.fincnt_base + ctx.num_pushed);
+  }
+  return counts;
+}
+
+bool Reached(const long tid, const std::vector<uint64_t>& counts) {
+  const auto& contexts = thread_contexts[tid];
+  for (std::size_t i = 0; i < contexts.size(); ++i) {
+    if (__atomic_load_n(&contexts[i].sri[kFincnt], __ATOMIC_ACQUIRE) <
+        counts[i]) {
+      return false;
+    }
+  }
+  return true;
+}
+
+void GetResult(const long tid, void* result) {
+  auto ptr = static_cast<Point3D*>(result);
+  ptr->data[0] = ptr->data[1] = ptr->data[2] = 0.0;
+
+  // Partial sums of each engine
+  for (const auto& ctx : thread_contexts[tid]) {
+    ptr->data[0] += LoadDouble(&ctx.sri[kAccX]) - ctx.acc_base[0];
+    ptr->data[1] += LoadDouble(&ctx.sri[kAccY]) - ctx.acc_base[1];
+    ptr->data[2] += LoadDouble(&ctx.sri[kAccZ]) - ctx.acc_base[2];
+  }
 }
 
 // void ReduceLeafNode(const long tid, const unsigned node_idx,
@@ -0,0 +1,137 @@
+#include "Emulator.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+
+#include "Redwood/Duet/Consts.hpp"
+#include "Redwood/Point.hpp"
+#include "RegisterId.hpp"
+
+namespace duet {
+
+namespace {
+
+double LoadDouble(volatile uint64_t* reg) {
+  const uint64_t bits = __atomic_load_n(reg, __ATOMIC_RELAXED);
+  double value;
+  std::memcpy(&value, &bits, sizeof(value));
+  return value;
+}
+
+void StoreDouble(volatile uint64_t* reg, const double value) {
+  uint64_t bits;
+  std::memcpy(&bits, &value, sizeof(bits));
+  __atomic_store_n(reg, bits, __ATOMIC_RELAXED);
+}
+
+// Same math as the engine's datapath (and 'dist::Gravity'), in double
+void ReduceLeaf(volatile uint64_t* sri, const Point4D* leaf_addr) {
+  const auto x0 = LoadDouble(&sri[kPos0X]);
+  const auto y0 = LoadDouble(&sri[kPos0Y]);
+  const auto z0 = LoadDouble(&sri[kPos0Z]);
+
+  double acc_x = 0.0;
+  double acc_y = 0.0;
+  double acc_z = 0.0;
+  for (int i = 0; i < kDuetLeafSize; ++i) {
+    const auto& p = leaf_addr[i];
+    const auto dx = p.data[0] - x0;
+    const auto dy = p.data[1] - y0;
+    const auto dz = p.data[2] - z0;
+    const auto dist_sqr = dx * dx + dy * dy + dz * dz + kEpssq;
+    const auto inv_dist = 1.0 / std::sqrt(dist_sqr);
+    const auto with_mass = inv_dist * inv_dist * inv_dist * p.data[3];
+    acc_x += dx * with_mass;
+    acc_y += dy * with_mass;
+    acc_z += dz * with_mass;
+  }
+
+  StoreDouble(&sri[kAccX], LoadDouble(&sri[kAccX]) + acc_x);
+  StoreDouble(&sri[kAccY], LoadDouble(&sri[kAccY]) + acc_y);
+  StoreDouble(&sri[kAccZ], LoadDouble(&sri[kAccZ]) + acc_z);
+}
+
+}  // namespace
+
+Emulator::Emulator(volatile uint64_t* base, const int num_engines,
+                   const int num_callers, const EngineModel model)
+    : base_(base),
+      num_engines_(num_engines),
+      num_callers_(std::min(num_callers, kMaxCallers)),
+      model_(model) {
+  for (int engine_id = 0; engine_id < num_engines_; ++engine_id) {
+    workers_.emplace_back([this, engine_id] { Run(engine_id); });
+  }
+}
+
+Emulator::~Emulator() {
+  stop_ = true;
+  for (auto& worker : workers_) worker.join();
+  Report();
+}
+
+double Emulator::LeafLatencyNs() const {
+  const auto bytes = kDuetLeafSize * sizeof(Point4D);
+  const auto compute_cycles =
+      kDuetLeafSize / model_.bodies_per_cycle + model_.pipeline_depth;
+  return model_.mem_latency_ns + bytes / model_.mem_bandwidth_gbs +
+         compute_cycles / model_.clock_ghz;
+}
+
+double Emulator::LeafIntervalNs() const {
+  const auto bytes = kDuetLeafSize * sizeof(Point4D);
+  const auto compute_cycles = kDuetLeafSize / model_.bodies_per_cycle;
+  return std::max(bytes / model_.mem_bandwidth_gbs,
+                  compute_cycles / model_.clock_ghz);
+}
+
+void Emulator::Report() const {
+  const auto leaves = num_leaves_.load();
+  const auto busy_s = busy_ns_.load() * 1e-9;
+  const auto interval_ns = LeafIntervalNs();
+  const auto modeled_s = leaves * interval_ns * 1e-9 / num_engines_;
+
+  std::cout << "[info] Duet emulator processed " << leaves << " leaves on "
+            << num_engines_ << " engine(s).\n"
+            << "\tEmulation time: " << busy_s << "s\n"
+            << "\tModeled leaf latency: " << LeafLatencyNs() << "ns\n"
+            << "\tModeled throughput: "
+            << num_engines_ * 1e3 / interval_ns << " M leaves/s\n"
+            << "\tModeled engine time: " << modeled_s << "s" << std::endl;
+}
+
+void Emulator::Run(const int engine_id) {
+  const auto engine_base = base_ + engine_id * kEngineWords;
+
+  while (!stop_.load(std::memory_order_relaxed)) {
+    auto idle = true;
+    for (long caller_id = 0; caller_id < num_callers_; ++caller_id) {
+      const auto sri = CallerRegisters(engine_base, caller_id);
+
+      const auto arg = __atomic_load_n(&sri[kArg], __ATOMIC_ACQUIRE);
+      if (arg == 0) continue;
+      idle = false;
+
+      const auto start = std::chrono::steady_clock::now();
+      ReduceLeaf(sri, reinterpret_cast<const Point4D*>(arg));
+      const auto end = std::chrono::steady_clock::now();
+
+      // Free the argument register first, so the caller can push the next
+      // leaf, then publish the results.
+      __atomic_store_n(&sri[kArg], uint64_t{0}, __ATOMIC_RELEASE);
+      __atomic_add_fetch(&sri[kFincnt], uint64_t{1}, __ATOMIC_RELEASE);
+
+      ++num_leaves_;
+      busy_ns_ += std::chrono::duration_cast<std::chrono::nanoseconds>(
+                      end - start)
+                      .count();
+    }
+
+    if (idle) std::this_thread::yield();
+  }
+}
+
+}  // namespace duet
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <thread>
+#include <vector>
+
+#include "RegisterId.hpp"
+
+// Software model of the Duet Barnes-Hut engine, used when '/dev/duet' is not
+// available. Helper threads watch the register window the same way the
+// hardware does: a leaf address written to 'kArg' is consumed (reset to 0),
+// its 'kDuetLeafSize' bodies are accumulated into 'kAccX..Z' against the
+// 'kPos0X..Z' anchor, then 'kFincnt' is incremented.
+//
+// Besides the results, it reports how long the engine would have taken,
+// according to 'EngineModel', when it shuts down.
+
+namespace duet {
+
+// Simple analytical model of one engine, a pipelined datapath fed by a memory
+// port. Adjust the defaults to the configuration being studied.
+struct EngineModel {
+  double clock_ghz = 1.0;
+  double mem_latency_ns = 80.0;   // First word of a leaf
+  double mem_bandwidth_gbs = 16;  // Sustained, per engine
+  int pipeline_depth = 24;        // Cycles from the last body to 'kFincnt'
+  int bodies_per_cycle = 1;
+};
+
+class Emulator {
+ public:
+  Emulator(volatile uint64_t* base, int num_engines, int num_callers,
+           EngineModel model = {});
+
+  Emulator(const Emulator&) = delete;
+  Emulator& operator=(const Emulator&) = delete;
+
+  // Stops the helper threads and prints the report
+  ~Emulator();
+
+  // Modeled time of one leaf in isolation, and the interval between two
+  // leaves when the engine is kept busy.
+  double LeafLatencyNs() const;
+  double LeafIntervalNs() const;
+
+  void Report() const;
+
+ private:
+  void Run(int engine_id);
+
+  volatile uint64_t* base_;
+  int num_engines_;
+  int num_callers_;
+  EngineModel model_;
+
+  std::atomic<bool> stop_{false};
+  std::atomic<uint64_t> num_leaves_{0};
+  std::atomic<uint64_t> busy_ns_{0};
+
+  std::vector<std::thread> workers_;
+};
+
+}  // namespace duet
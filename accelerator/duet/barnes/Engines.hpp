@@ -0,0 +1,18 @@
+#pragma once
+
+// Mapping of the traversal threads to the Duet engines, set up by
+// 'redwood::Init()'.
+//
+// With at least as many engines as threads, each thread owns its engines
+// exclusively (engine 'e' belongs to thread 'e % num_threads') and its leaf
+// pushes are spread over them. Otherwise engines are shared, thread 'tid' uses
+// caller slot 'tid / num_engines' of engine 'tid % num_engines'.
+
+namespace duet {
+
+void AssignEngines(int num_threads, int num_engines);
+
+// How many caller slots are in use on each engine
+int CallersPerEngine(int num_threads, int num_engines);
+
+}  // namespace duet
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <cstdint>
+
 // Duet Registers IDs
 // Need to match these in the Gem5 Duet implementation
 // Max 16 registers
@@ -11,3 +13,14 @@ constexpr auto kFincnt = 4;
 constexpr auto kAccX = 5;
 constexpr auto kAccY = 6;
 constexpr auto kAccZ = 7;
+
+// Registers of each caller (thread) are 16 words, starting at word 16 of the
+// engine's 8 KB window.
+constexpr auto kEngineWords = 1 << 10;
+constexpr auto kCallerWords = 16;
+constexpr auto kMaxCallers = kEngineWords / kCallerWords - 1;
+
+inline volatile uint64_t* CallerRegisters(volatile uint64_t* base,
+                                          const long caller_id) {
+  return base + (caller_id << 4) + 16;
+}
@@ -0,0 +1,202 @@
+#include <gtest/gtest.h>
+#include <omp.h>
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "../barnes/Emulator.hpp"
+#include "../barnes/Engines.hpp"
+#include "../barnes/RegisterId.hpp"
+#include "Redwood.hpp"
+#include "Redwood/Core.hpp"
+#include "Redwood/Duet/Consts.hpp"
+#include "Redwood/Duet/DuetAPI.hpp"
+
+// Without '/dev/duet', so everything runs on the software emulator
+
+namespace {
+
+constexpr int kNumLeaves = 40;
+
+std::vector<Point4D> MakeBodies(const int n, const unsigned seed) {
+  std::mt19937 gen(seed);
+  std::uniform_real_distribution<double> dis(0, 100);
+
+  std::vector<Point4D> bodies(n);
+  for (auto& p : bodies) {
+    for (auto& x : p.data) x = dis(gen);
+  }
+  return bodies;
+}
+
+// Force of 'n' bodies on 'pos', one at a time, with the engine's math
+Point3D DirectSum(const Point4D* bodies, const int n, const Point3D& pos) {
+  Point3D force{};
+  for (int i = 0; i < n; ++i) {
+    const auto& p = bodies[i];
+    const auto dx = p.data[0] - pos.data[0];
+    const auto dy = p.data[1] - pos.data[1];
+    const auto dz = p.data[2] - pos.data[2];
+    const auto dist_sqr = dx * dx + dy * dy + dz * dz + duet::kEpssq;
+    const auto inv_dist = 1.0 / std::sqrt(dist_sqr);
+    const auto with_mass = inv_dist * inv_dist * inv_dist * p.data[3];
+    force.data[0] += dx * with_mass;
+    force.data[1] += dy * with_mass;
+    force.data[2] += dz * with_mass;
+  }
+  return force;
+}
+
+// The engines sum leaf by leaf, and their registers are never reset
+double RelativeError(const Point3D& res, const Point3D& expected) {
+  auto error = 0.0;
+  for (int i = 0; i < 3; ++i) {
+    error = std::max(error, std::abs(res.data[i] - expected.data[i]) /
+                                std::max(1.0, std::abs(expected.data[i])));
+  }
+  return error;
+}
+
+double LoadDouble(const volatile uint64_t* reg) {
+  const uint64_t bits = __atomic_load_n(reg, __ATOMIC_ACQUIRE);
+  double value;
+  std::memcpy(&value, &bits, sizeof(value));
+  return value;
+}
+
+uint64_t ToBits(const double value) {
+  uint64_t bits;
+  std::memcpy(&bits, &value, sizeof(bits));
+  return bits;
+}
+
+}  // namespace
+
+TEST(DuetEmulatorTest, ReducesPushedLeaves) {
+  constexpr int num_engines = 2;
+  constexpr int num_callers = 3;
+  const auto bodies = MakeBodies(4 * duet::kDuetLeafSize, 114514);
+  const Point3D pos{{30.0, 60.0, 90.0}};
+
+  const auto base = static_cast<volatile uint64_t*>(
+      calloc(num_engines * kEngineWords, sizeof(uint64_t)));
+  {
+    duet::Emulator emulator(base, num_engines, num_callers);
+
+    // Last caller of the last engine, as the host side does it
+    const auto sri = CallerRegisters(base + kEngineWords, num_callers - 1);
+    sri[kPos0X] = ToBits(pos.data[0]);
+    sri[kPos0Y] = ToBits(pos.data[1]);
+    sri[kPos0Z] = ToBits(pos.data[2]);
+
+    for (int leaf = 0; leaf < 4; ++leaf) {
+      while (__atomic_load_n(&sri[kArg], __ATOMIC_ACQUIRE) != 0) {
+        std::this_thread::yield();
+      }
+      __atomic_store_n(
+          &sri[kArg],
+          reinterpret_cast<uint64_t>(&bodies[leaf * duet::kDuetLeafSize]),
+          __ATOMIC_RELEASE);
+    }
+    while (__atomic_load_n(&sri[kFincnt], __ATOMIC_ACQUIRE) < 4) {
+      std::this_thread::yield();
+    }
+
+    const Point3D res{
+        {LoadDouble(&sri[kAccX]), LoadDouble(&sri[kAccY]),
+         LoadDouble(&sri[kAccZ])}};
+    EXPECT_LT(RelativeError(res, DirectSum(bodies.data(),
+                                           4 * duet::kDuetLeafSize, pos)),
+              1e-12);
+
+    // Nothing else was touched
+    EXPECT_EQ(CallerRegisters(base, num_callers - 1)[kFincnt], 0u);
+    EXPECT_EQ(CallerRegisters(base + kEngineWords, 0)[kFincnt], 0u);
+  }
+  free(const_cast<uint64_t*>(base));
+}
+
+TEST(DuetEnginesTest, CallersPerEngine) {
+  EXPECT_EQ(duet::CallersPerEngine(1, 1), 1);
+  EXPECT_EQ(duet::CallersPerEngine(2, 4), 1);
+  EXPECT_EQ(duet::CallersPerEngine(3, 2), 2);
+  EXPECT_EQ(duet::CallersPerEngine(4, 1), 4);
+}
+
+// Each thread pushes its own leaves to the engines it was assigned, owned
+// (more engines than threads) or shared through the caller slots (fewer)
+TEST(DuetEnginesTest, SameAsDirectSum) {
+  const auto bodies = MakeBodies(kNumLeaves * duet::kDuetLeafSize, 1919810);
+
+  for (const auto num_threads : {1, 2, 3}) {
+    for (const auto num_engines : {1, 2, 4}) {
+      SCOPED_TRACE(std::to_string(num_threads) + " threads, " +
+                   std::to_string(num_engines) + " engines");
+
+      duet::SetNumEngines(num_engines);
+      redwood::Init(num_threads, 1);
+
+      std::vector<double> errors(num_threads);
+#pragma omp parallel for num_threads(num_threads)
+      for (int tid = 0; tid < num_threads; ++tid) {
+        for (int q = 0; q < 10; ++q) {
+          const Point3D pos{{10.0 * q, 50.0 + tid, 25.0}};
+
+          // A different subset of the leaves for each query
+          const auto num_leaves = kNumLeaves - q - tid;
+          duet::Start(tid, &pos);
+          for (int leaf = 0; leaf < num_leaves; ++leaf) {
+            duet::PushLeaf32(tid, &bodies[leaf * duet::kDuetLeafSize]);
+          }
+          duet::Wait(tid);
+
+          Point3D res;
+          duet::GetResult(tid, &res);
+          const auto expected = DirectSum(
+              bodies.data(), num_leaves * duet::kDuetLeafSize, pos);
+          errors[tid] = std::max(errors[tid], RelativeError(res, expected));
+        }
+      }
+
+      for (int tid = 0; tid < num_threads; ++tid) {
+        EXPECT_LT(errors[tid], 1e-9) << "thread " << tid;
+      }
+    }
+  }
+}
+
+// An event is only complete once the engines reduced every leaf pushed before
+// it was recorded, the results are then ready without 'Wait()'
+TEST(DuetEnginesTest, EventsTrackThePushedLeaves) {
+  const auto bodies = MakeBodies(kNumLeaves * duet::kDuetLeafSize, 42);
+  duet::SetNumEngines(2);
+  redwood::Init(1, 1);
+
+  const auto event = redwood::CreateEvent();
+  EXPECT_TRUE(redwood::EventQuery(event));
+
+  const Point3D pos{{20.0, 40.0, 60.0}};
+  duet::Start(0, &pos);
+  for (int leaf = 0; leaf < kNumLeaves; ++leaf) {
+    duet::PushLeaf32(0, &bodies[leaf * duet::kDuetLeafSize]);
+  }
+  redwood::EventRecord(event, 0, 0);
+  redwood::EventSynchronize(event);
+  EXPECT_TRUE(redwood::EventQuery(event));
+  EXPECT_TRUE(redwood::StreamQuery(0, 0));
+
+  Point3D res;
+  duet::GetResult(0, &res);
+  EXPECT_LT(RelativeError(res, DirectSum(bodies.data(),
+                                         kNumLeaves * duet::kDuetLeafSize,
+                                         pos)),
+            1e-9);
+  redwood::DestroyEvent(event);
+}
@@ -1,6 +1,4 @@
 #pragma once
 
-constexpr auto kNumStreams = 2;
-
 // This is how much you can use on SYCl
 constexpr auto kBlockThreads = 256;
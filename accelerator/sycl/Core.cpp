@@ -4,12 +4,15 @@
 #include <CL/sycl.hpp>
 
 #include "Consts.hpp"
+#include "Redwood/Numa.hpp"
 #include "SyclUtils.hpp"
 
 // Global Variables
 sycl::device device;
 sycl::context ctx;
-sycl::queue qs[kNumStreams];
+// One queue per (tid, stream_id) pair
+std::vector<sycl::queue> qs;
+int stored_num_streams;
 
 void SyclWarmUp(sycl::queue& q) {
   int sum;
@@ -23,7 +26,7 @@ void SyclWarmUp(sycl::queue& q) {
 
 namespace redwood {
 
-void Init() {
+void Init(const int num_threads, const int num_streams) {
   try {
     device = sycl::device(sycl::gpu_selector_v);
   } catch (const sycl::exception& e) {
@@ -31,22 +34,63 @@ void Init() {
     exit(1);
   }
 
-  qs[0] = sycl::queue(device);
-  for (int i = 1; i < kNumStreams; i++)
-    qs[i] = sycl::queue(qs[0].get_context(), device);
+  stored_num_streams = num_streams;
+  numa::AssignThreads(num_threads);
+
+  qs.clear();
+  qs.emplace_back(device);
+  for (int i = 1; i < num_threads * num_streams; i++)
+    qs.emplace_back(qs[0].get_context(), device);
 
   ShowDevice(qs[0]);
   SyclWarmUp(qs[0]);
 }
 
-void DeviceStreamSynchronize(const int stream_id) { qs[stream_id].wait(); }
+void DeviceStreamSynchronize(const int tid, const int stream_id) {
+  qs[tid * stored_num_streams + stream_id].wait();
+}
 
 void DeviceSynchronize() {
-  for (int i = 0; i < kNumStreams; ++i) DeviceStreamSynchronize(i);
+  for (auto& q : qs) q.wait();
 }
 
-void AttachStreamMem(const int stream_id, void* addr) {
+void AttachStreamMem(const int tid, const int stream_id, void* addr) {
   // No Op
 }
 
+// The queues are out-of-order, so depend on everything submitted before
+void MemcpyAsync(void* dst, const void* src, const std::size_t bytes,
+                 const int tid, const int stream_id) {
+  auto& q = qs[tid * stored_num_streams + stream_id];
+  const auto before = q.ext_oneapi_submit_barrier();
+  q.memcpy(dst, src, bytes, before);
+}
+
+// The handle points to a 'sycl::event' of a barrier submitted to the queue
+Event CreateEvent() { return Event{new sycl::event}; }
+
+void DestroyEvent(const Event event) {
+  delete static_cast<sycl::event*>(event.handle);
+}
+
+void EventRecord(const Event event, const int tid, const int stream_id) {
+  *static_cast<sycl::event*>(event.handle) =
+      qs[tid * stored_num_streams + stream_id].ext_oneapi_submit_barrier();
+}
+
+bool EventQuery(const Event event) {
+  const auto status =
+      static_cast<sycl::event*>(event.handle)
+          ->get_info<sycl::info::event::command_execution_status>();
+  return status == sycl::info::event_command_status::complete;
+}
+
+void EventSynchronize(const Event event) {
+  static_cast<sycl::event*>(event.handle)->wait();
+}
+
+bool StreamQuery(const int tid, const int stream_id) {
+  return qs[tid * stored_num_streams + stream_id].ext_oneapi_empty();
+}
+
 }  // namespace redwood
\ No newline at end of file
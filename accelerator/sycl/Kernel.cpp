@@ -3,11 +3,16 @@
 #include <CL/sycl.hpp>
 #include <cmath>
 #include <iostream>
+#include <vector>
 
 #include "Consts.hpp"
+#include "Functors/DistanceMetrics.hpp"
+#include "Functors/ReduceOps.hpp"
+#include "Redwood/KernelRegistry.hpp"
 #include "Redwood/Point.hpp"
 
-extern sycl::queue qs[kNumStreams];
+extern std::vector<sycl::queue> qs;
+extern int stored_num_streams;
 
 namespace redwood {
 
@@ -144,4 +149,87 @@ void LaunchNnKenrnel(const int* u_leaf_indices,  /**/
                      const Point4F* u_lnt_data,  /**/
                      const int max_leaf_size, const int stream_id) {}
 
+// One work-item per item of the batch, the whole leaf is folded into its
+// result slot, from the identity.
+template <typename Functor, typename ReduceOp, int Dim, typename T>
+void LaunchReduction(const int tid, const int stream_id,
+                     const Point<Dim, T>* u_lnt, const int* u_lnt_offsets,
+                     const Point<Dim, T>* u_q, const int* u_node_idx,
+                     const int num_active,
+                     reduce::ValueOf<ReduceOp, T>* u_out) {
+  if (num_active == 0) return;
+
+  qs[tid * stored_num_streams + stream_id].submit([&](sycl::handler& h) {
+    h.parallel_for(sycl::range(num_active), [=](const sycl::id<1> idx) {
+      const Functor functor{};
+      const auto item = idx[0];
+      const auto begin = u_lnt_offsets[u_node_idx[item]];
+      const auto end = u_lnt_offsets[u_node_idx[item] + 1];
+      const auto q = u_q[item];
+      const auto slot = u_out + item * ReduceOp::kStride;
+
+      reduce::ResetSlot<ReduceOp, T>(slot);
+      if constexpr (ReduceOp::kAssociative) {
+        auto acc = ReduceOp::template Identity<T>();
+        for (int i = begin; i < end; ++i) {
+          const auto value = ReduceOp::Make(functor(u_lnt[i], q), i - begin);
+          acc = ReduceOp::Combine(acc, value);
+        }
+        ReduceOp::Insert(slot, acc);
+      } else {
+        for (int i = begin; i < end; ++i) {
+          ReduceOp::Insert(slot,
+                           ReduceOp::Make(functor(u_lnt[i], q), i - begin));
+        }
+      }
+    });
+  });
+}
+
+// One work-item per item of the batch, like 'LaunchReduction()'
+template <typename Functor, int Dim, typename T>
+void LaunchRadiusSearch(const int tid, const int stream_id,
+                        const Point<Dim, T>* u_lnt, const int* u_lnt_offsets,
+                        const Point<Dim, T>* u_q, const int* u_node_idx,
+                        const int num_active, const T radius, int* u_counts,
+                        int* u_matches, const int match_stride) {
+  if (num_active == 0) return;
+
+  qs[tid * stored_num_streams + stream_id].submit([&](sycl::handler& h) {
+    h.parallel_for(sycl::range(num_active), [=](const sycl::id<1> idx) {
+      const Functor functor{};
+      const auto item = idx[0];
+      const auto begin = u_lnt_offsets[u_node_idx[item]];
+      const auto end = u_lnt_offsets[u_node_idx[item] + 1];
+      const auto q = u_q[item];
+      const auto slot = u_matches + item * match_stride;
+
+      auto count = 0;
+      for (int i = begin; i < end; ++i) {
+        if (functor(u_lnt[i], q) < radius) {
+          if (count < match_stride) slot[count] = i - begin;
+          ++count;
+        }
+      }
+      u_counts[item] = count;
+    });
+  });
+}
+
+#define INSTANTIATE_REDUCTION(Functor, ReduceOp, PointT)                     \
+  template void LaunchReduction<Functor, ReduceOp>(                          \
+      int tid, int stream_id, const PointT* u_lnt, const int* u_lnt_offsets, \
+      const PointT* u_q, const int* u_node_idx, int num_active,              \
+      reduce::ValueOf<ReduceOp, PointT::Scalar>* u_out);
+
+REDWOOD_KERNEL_LIST(INSTANTIATE_REDUCTION)
+
+#define INSTANTIATE_RADIUS_SEARCH(Functor, PointT)                           \
+  template void LaunchRadiusSearch<Functor>(                                 \
+      int tid, int stream_id, const PointT* u_lnt, const int* u_lnt_offsets, \
+      const PointT* u_q, const int* u_node_idx, int num_active,              \
+      PointT::Scalar radius, int* u_counts, int* u_matches, int match_stride);
+
+REDWOOD_RADIUS_KERNEL_LIST(INSTANTIATE_RADIUS_SEARCH)
+
 }  // namespace redwood
\ No newline at end of file
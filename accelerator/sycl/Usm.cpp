@@ -3,24 +3,65 @@
 #include <CL/sycl.hpp>
 #include <iostream>
 
+#include "Redwood/UsmPool.hpp"
+
 namespace redwood {
 
 extern sycl::device device;
 extern sycl::context ctx;
 
+static UsmOptions usm_options;
+
+static void* RawMalloc(const std::size_t bytes) {
+  return sycl::malloc_shared(bytes, device, ctx);
+}
+
+static void RawFree(void* ptr, std::size_t) { sycl::free(ptr, ctx); }
+
+static UsmPool& Pool() {
+  static UsmPool pool(RawMalloc, RawFree);
+  return pool;
+}
+
 void* UsmMalloc(const std::size_t n) {
-  void* tmp;
-  std::cout << "accelerator::UsmMalloc() " << tmp << ": " << n << " bytes."
-            << std::endl;
-  tmp = sycl::malloc_shared(n, device, ctx);
+  void* tmp = Pool().Allocate(n);
+  if (usm_options.verbose) {
+    std::cout << "accelerator::UsmMalloc() " << tmp << ": " << n << " bytes."
+              << std::endl;
+  }
+  return tmp;
+}
+
+// Not pooled, the pages of a fresh block have not been migrated anywhere yet
+void* UsmMallocPlaced(const std::size_t n) {
+  void* tmp = Pool().AllocateUncached(n);
+  if (usm_options.verbose) {
+    std::cout << "accelerator::UsmMallocPlaced() " << tmp << ": " << n
+              << " bytes." << std::endl;
+  }
   return tmp;
 }
 
 void UsmFree(void* ptr) {
-  std::cout << "accelerator::UsmFree() " << ptr << std::endl;
-  if (ptr) {
-    sycl::free(ptr, ctx);
+  if (usm_options.verbose) {
+    std::cout << "accelerator::UsmFree() " << ptr << std::endl;
+  }
+  if (ptr && !Pool().Free(ptr)) {
+    std::cerr << "[warning] UsmFree() of " << ptr
+              << ", which was not allocated by UsmMalloc()." << std::endl;
   }
 }
 
-}  // namespace redwood
\ No newline at end of file
+// Huge pages and pre-faulting are host only, shared allocations are migrated
+// by the runtime.
+void SetUsmOptions(const UsmOptions& options) { usm_options = options; }
+
+UsmStats GetUsmStats() { return Pool().Stats(); }
+
+void UsmTrim() { Pool().Trim(); }
+
+void* HostMalloc(const std::size_t n) { return sycl::malloc_host(n, ctx); }
+
+void HostFree(void* ptr) { sycl::free(ptr, ctx); }
+
+}  // namespace redwood
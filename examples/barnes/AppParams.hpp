@@ -1,15 +1,18 @@
 #pragma once
 
 #include <iostream>
+#include <string>
 
 // For NN and KNN
 struct AppParams {
   int max_leaf_size;
   int batch_size;
   int num_threads;
+  int num_streams;
   int m;
   float theta;
   bool cpu;
+  std::string lnt_placement;
 };
 
 inline AppParams app_params;
@@ -19,8 +22,10 @@ inline std::ostream& operator<<(std::ostream& os, const AppParams& params) {
   os << "\tMax Leaf Size: " << params.max_leaf_size << '\n';
   os << "\tBatch Size: " << params.batch_size << '\n';
   os << "\tNum Threads: " << params.num_threads << '\n';
+  os << "\tNum Streams: " << params.num_streams << '\n';
   os << "\tM: " << params.m << '\n';
   os << "\tTheta: " << params.theta << '\n';
   os << "\tRunning Cpu: " << std::boolalpha << params.cpu << '\n';
+  os << "\tLNT Placement: " << params.lnt_placement << '\n';
   return os;
 }
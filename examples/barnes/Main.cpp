@@ -113,7 +113,7 @@ class Executor {
       if (cur->bodies.empty()) return;
 
       // ------------------------------------------------------------
-      const auto leaf_addr = rdc::LntDataAddrAt(cur->uid);
+      const auto leaf_addr = rdc::LntDataAddrAt(my_tid_, cur->uid);
       for (int i = 0; i < app_params.max_leaf_size; ++i) {
         host_result_ += functor(my_q_, leaf_addr[i]);
       }
@@ -151,10 +151,12 @@ int main(int argc, char** argv) {
     ("f,file", "Input file name", cxxopts::value<std::string>())
     ("m,query", "Number of particles to query", cxxopts::value<int>()->default_value("1048576"))
     ("t,thread", "Number of threads", cxxopts::value<int>()->default_value("1"))
+    ("s,streams", "Number of batches in flight per thread", cxxopts::value<int>()->default_value("2"))
     ("theta", "Theta Value", cxxopts::value<float>()->default_value("0.2"))
     ("l,leaf", "Maximum leaf node size", cxxopts::value<int>()->default_value("32"))
     ("b,batch_size", "Batch size (GPU)", cxxopts::value<int>()->default_value("2048"))
     ("c,cpu", "Enable CPU baseline", cxxopts::value<bool>()->default_value("false"))
+    ("lnt", "NUMA placement of the leaf node table (first_touch, interleave, replicate)", cxxopts::value<std::string>()->default_value("first_touch"))
     ("h,help", "Print usage");
   // clang-format on
 
@@ -176,10 +178,12 @@ int main(int argc, char** argv) {
   const auto data_file = result["file"].as<std::string>();
   app_params.m = result["query"].as<int>();
   app_params.num_threads = result["thread"].as<int>();
+  app_params.num_streams = result["streams"].as<int>();
   app_params.theta = result["theta"].as<float>();
   app_params.max_leaf_size = result["leaf"].as<int>();
   app_params.batch_size = result["batch_size"].as<int>();
   app_params.cpu = result["cpu"].as<bool>();
+  app_params.lnt_placement = result["lnt"].as<std::string>();
   std::cout << app_params << std::endl;
 
   std::cout << "Loading Data..." << std::endl;
@@ -209,14 +213,17 @@ int main(int argc, char** argv) {
   tree.BuildTree();
 
   // Init
-  rdc::Init(app_params.num_threads, app_params.batch_size);
+  rdc::Init(app_params.num_threads, app_params.batch_size,
+            app_params.num_streams);
   omp_set_num_threads(app_params.num_threads);
 
   const auto num_leaf_nodes = tree.GetStats().num_leaf_nodes;
   auto [lnt_addr, lnt_size_addr] =
-      rdc::AllocateLnt(num_leaf_nodes, app_params.max_leaf_size);
+      rdc::AllocateLnt(num_leaf_nodes, app_params.max_leaf_size,
+                       redwood::numa::ParsePlacement(app_params.lnt_placement));
 
   tree.LoadPayload(lnt_addr, lnt_size_addr);
+  rdc::SyncLnt();
 
   std::vector<float> final_results;
   final_results.resize(app_params.m);  // need to discard the first
@@ -235,6 +242,7 @@ int main(int argc, char** argv) {
       // Run
 #pragma omp parallel for
       for (int tid = 0; tid < app_params.num_threads; ++tid) {
+        const redwood::numa::ScopedPin pin(tid);
         while (!q_data[tid].empty()) {
           const auto [q_idx, q] = q_data[tid].front();
           cpu_exe[tid].StartQueryCpu(q, tree.GetRoot());
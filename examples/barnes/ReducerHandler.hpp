@@ -1,7 +1,7 @@
 #pragma once
 
-#include <array>
 #include <utility>
+#include <vector>
 
 #include "../Utils.hpp"
 #include "Functors/DistanceMetrics.hpp"
@@ -15,38 +15,76 @@ inline Point4F* lnt_base_addr = nullptr;
 inline int* lnt_size_base_addr = nullptr;
 inline int stored_max_leaf_size;
 
+// With 'kReplicate', one copy of the LNT per NUMA node, [0] are the base ones
+inline std::vector<Point4F*> lnt_replicas;
+inline std::vector<int*> lnt_size_replicas;
+inline std::size_t stored_num_leaf_nodes;
+
+// Fill the returned tables ('LoadPayload()'), then call 'SyncLnt()' to update
+// the other replicas.
 _NODISCARD inline std::pair<Point4F*, int*> AllocateLnt(
-    const int num_leaf_nodes, const int max_leaf_size) {
+    const int num_leaf_nodes, const int max_leaf_size,
+    const redwood::numa::Placement placement =
+        redwood::numa::Placement::kFirstTouch) {
   stored_max_leaf_size = max_leaf_size;
+  stored_num_leaf_nodes = num_leaf_nodes;
 
-  lnt_base_addr = redwood::UsmMalloc<Point4F>(num_leaf_nodes * max_leaf_size);
-  lnt_size_base_addr = redwood::UsmMalloc<int>(num_leaf_nodes);
+  lnt_replicas = redwood::numa::AllocatePlaced<Point4F>(
+      stored_num_leaf_nodes * max_leaf_size, placement);
+  lnt_size_replicas =
+      redwood::numa::AllocatePlaced<int>(stored_num_leaf_nodes, placement);
+  lnt_base_addr = lnt_replicas[0];
+  lnt_size_base_addr = lnt_size_replicas[0];
 
   return std::make_pair(lnt_base_addr, lnt_size_base_addr);
 }
 
+inline void SyncLnt() {
+  redwood::numa::SyncReplicas(lnt_replicas,
+                              stored_num_leaf_nodes * stored_max_leaf_size);
+  redwood::numa::SyncReplicas(lnt_size_replicas, stored_num_leaf_nodes);
+}
+
 _NODISCARD inline const Point4F* LntDataAddrAt(const int node_idx) {
   return lnt_base_addr + node_idx * stored_max_leaf_size;
 }
 
+// Same, from the LNT copy closest to thread 'tid'
+_NODISCARD inline const Point4F* LntDataAddrAt(const int tid,
+                                               const int node_idx) {
+  const auto node = redwood::numa::NodeOf(tid);
+  const auto base = node < static_cast<int>(lnt_replicas.size())
+                        ? lnt_replicas[node]
+                        : lnt_base_addr;
+  return base + node_idx * stored_max_leaf_size;
+}
+
 using IndicesBuffer = redwood::UsmVector<int>;
 
 inline int stored_num_threads;
-inline std::vector<std::array<IndicesBuffer, 2>> buffers;
-inline std::vector<std::array<float*, 2>> result_addr;
-inline std::vector<std::array<Point4F, 2>> h_query;
-inline std::vector<std::array<float, 2>> h_br_result;
-
-inline void Init(const int num_thread, const int batch_size) {
-  redwood::Init(num_thread);
+inline int stored_num_streams;
+
+// [tid][stream_id]
+inline std::vector<std::vector<IndicesBuffer>> buffers;
+inline std::vector<std::vector<float*>> result_addr;
+// Host copy of 'result_addr', updated on the stream after each launch
+inline std::vector<std::vector<float>> h_result;
+inline std::vector<std::vector<Point4F>> h_query;
+inline std::vector<std::vector<float>> h_br_result;
+
+inline void Init(const int num_thread, const int batch_size,
+                 const int num_streams = 2) {
+  redwood::Init(num_thread, num_streams);
   stored_num_threads = num_thread;
+  stored_num_streams = num_streams;
 
-  buffers.resize(num_thread);
-  result_addr.resize(num_thread);
-  h_query.resize(num_thread);
-  h_br_result.resize(num_thread);
+  buffers.assign(num_thread, std::vector<IndicesBuffer>(num_streams));
+  result_addr.assign(num_thread, std::vector<float*>(num_streams));
+  h_result.assign(num_thread, std::vector<float>(num_streams));
+  h_query.assign(num_thread, std::vector<Point4F>(num_streams));
+  h_br_result.assign(num_thread, std::vector<float>(num_streams));
   for (int tid = 0; tid < num_thread; ++tid) {
-    for (int i = 0; i < 2; ++i) {
+    for (int i = 0; i < num_streams; ++i) {
       // Unified Shared Memory
       buffers[tid][i].reserve(batch_size);
       result_addr[tid][i] = redwood::UsmMalloc<float>(1);
@@ -59,7 +97,7 @@ inline void Init(const int num_thread, const int batch_size) {
 
 inline void Release() {
   for (int tid = 0; tid < stored_num_threads; ++tid) {
-    for (int i = 0; i < 2; ++i) {
+    for (int i = 0; i < stored_num_streams; ++i) {
       redwood::UsmFree(result_addr[tid][i]);
 
       // Mannuelly free a std::vector
@@ -68,19 +106,21 @@ inline void Release() {
     }
   }
 
-  redwood::UsmFree(lnt_base_addr);
-  redwood::UsmFree(lnt_size_base_addr);
+  redwood::numa::FreePlaced(lnt_replicas);
+  redwood::numa::FreePlaced(lnt_size_replicas);
 }
 
 inline void ResetBuffer(const int tid, const int cur_stream) {
   buffers[tid][cur_stream].clear();
   // Reset accumulator
   *result_addr[tid][cur_stream] = 0.0f;
+  h_result[tid][cur_stream] = 0.0f;
   h_br_result[tid][cur_stream] = 0.0f;
 }
 
+// Valid once the stream's batch has finished, reads the host copy only
 _NODISCARD inline float GetResultValue(const int tid, const int stream_id) {
-  const auto device_result = *result_addr[tid][stream_id];
+  const auto device_result = h_result[tid][stream_id];
   const auto host_result = h_br_result[tid][stream_id];
   return device_result + host_result;
 }
@@ -136,5 +176,8 @@ inline void LaunchAsyncWorkQueue(const int tid, const int stream_id) {
   //     tid, stream_id, lnt_base_addr, stored_max_leaf_size,
   //     buffers[tid][stream_id].u_qs, buffers[tid][stream_id].u_leaf_idx,
   //     num_active, result_addr[tid][stream_id].underlying_dat, functor);
+
+  redwood::MemcpyAsync(&h_result[tid][stream_id], result_addr[tid][stream_id],
+                       sizeof(float), tid, stream_id);
 }
 }  // namespace rdc
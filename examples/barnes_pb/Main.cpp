@@ -317,12 +317,11 @@ int main(int argc, char** argv) {
       const auto next = rdc::NextStream(cur_stream);
       redwood::DeviceStreamSynchronize(next);
 
+      // Read results that were computed and synchronized before
+      // Todo: this q_idx is not true, should be the last one
+      const auto results = rdc::GetResultValues_PB<float>(tid, next);
+      final_results.insert(final_results.end(), results, results + block_size);
       for (int i = 0; i < block_size; i++) {
-        // Read results that were computed and synchronized before
-        const auto result =
-            rdc::GetResultValueUnchecked_PB<float>(tid, next, i);
-        // Todo: this q_idx is not true, should be the last one
-        final_results.push_back(result);
         rdc::ClearBuffer(tid, i, next);
       }
       // Switch buffer ( A->B, B-A)
@@ -335,10 +334,8 @@ int main(int argc, char** argv) {
     redwood::DeviceSynchronize();
     const auto next = rdc::NextStream(cur_stream);
 
-    for (int i = 0; i < block_size; i++) {
-      const auto result = rdc::GetResultValueUnchecked_PB<float>(tid, next, i);
-      final_results.push_back(result);
-    }
+    const auto results = rdc::GetResultValues_PB<float>(tid, next);
+    final_results.insert(final_results.end(), results, results + block_size);
   });
 
   for (int i = 0; i < m; ++i) {
@@ -300,15 +300,9 @@ class Octree {
   const Node<T>* GetRoot() const { return root_; }
 
  private:
-  static int GetNextLeafId() {
-    static int uid_counter = 0;
-    return uid_counter++;
-  }
-
-  static int GetNextBranchId() {
-    static int uid_counter = 0;
-    return uid_counter++;
-  }
+  // Per tree, so each tree's leaf uids index its own leaf node table
+  int GetNextLeafId() { return next_leaf_uid_++; }
+  int GetNextBranchId() { return next_branch_uid_++; }
 
   Node<T>* root_;
 
@@ -316,5 +310,7 @@ class Octree {
   OctreeStatistic statistic_;
   const PointT* data_;
   const int data_size_;
+  int next_leaf_uid_ = 0;
+  int next_branch_uid_ = 0;
 };
 }  // namespace oct
\ No newline at end of file
@@ -146,11 +146,12 @@ inline void LuanchKernelAsync_PB(const int tid, const int stream_id, int block_s
       i);
 }
 
+// The results of all the blocked points of the stream's last batch, one per
+// 'pb_idx', contiguous. Read them in bulk after synchronizing the stream.
 template <typename T>
-_NODISCARD T GetResultValueUnchecked_PB(const int tid, const int stream_id,
-                                        const int pb_idx) {
-  return rhs[tid].UsmResultAddr(stream_id)[pb_idx];
-                                        }
+_NODISCARD const T* GetResultValues_PB(const int tid, const int stream_id) {
+  return rhs[tid].UsmResultAddr(stream_id);
+}
 
 // -------------------- Yanwen's addition End ----------------------------
 
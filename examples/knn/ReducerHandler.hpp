@@ -1,6 +1,6 @@
 #pragma once
 
-#include <array>
+#include <vector>
 
 #include "../Utils.hpp"
 #include "../nn/DistanceMetrics.hpp"
@@ -68,25 +68,29 @@ struct ResultBuffer {
   int stored_k;
 };
 
-inline std::array<Buffer, 2> buffers;
-inline std::array<ResultBuffer, 2> result_addr;
+inline int stored_num_streams;
+inline std::vector<Buffer> buffers;
+inline std::vector<ResultBuffer> result_addr;
 
-inline void Init(const int batch_size) {
-  redwood::Init();
+inline void Init(const int batch_size, const int num_streams = 2) {
+  redwood::Init(1, num_streams);
+  stored_num_streams = num_streams;
 
-  for (int i = 0; i < 2; ++i) {
+  buffers.resize(num_streams);
+  result_addr.resize(num_streams);
+  for (int i = 0; i < num_streams; ++i) {
     buffers[i].Alloc(batch_size);
     // K = 32
     result_addr[i].Alloc(batch_size, 32);
 
-    redwood::AttachStreamMem(i, buffers[i].u_leaf_idx);
-    redwood::AttachStreamMem(i, buffers[i].u_qs);
-    redwood::AttachStreamMem(i, result_addr[i].underlying_dat);
+    redwood::AttachStreamMem(0, i, buffers[i].u_leaf_idx);
+    redwood::AttachStreamMem(0, i, buffers[i].u_qs);
+    redwood::AttachStreamMem(0, i, result_addr[i].underlying_dat);
   }
 }
 
 inline void Release() {
-  for (int i = 0; i < 2; ++i) {
+  for (int i = 0; i < stored_num_streams; ++i) {
     buffers[i].DeAlloc();
     result_addr[i].DeAlloc();
   }
@@ -1,14 +1,32 @@
 #pragma once
 
 #include <iostream>
+#include <string>
 
 // For NN and KNN
 struct AppParams {
   int max_leaf_size;
   int batch_size;
   int num_threads;
+  int num_streams;
   int m;
   bool cpu;
+  bool huge_pages;
+  bool populate;
+  std::string lnt_placement;
+  std::string tree_layout;
+  std::string split_policy;
+  std::string index_file;
+  std::string save_index_file;
+  int insert_batch;
+  int dims;
+  bool use_double;
+  double radius;
+  bool count_only;
+  double epsilon;
+  int max_leaves;
+  bool dual_tree;
+  bool self_join;
 };
 
 inline AppParams app_params;
@@ -18,7 +36,24 @@ inline std::ostream& operator<<(std::ostream& os, const AppParams& params) {
   os << "\tMax Leaf Size: " << params.max_leaf_size << '\n';
   os << "\tBatch Size: " << params.batch_size << '\n';
   os << "\tNum Threads: " << params.num_threads << '\n';
+  os << "\tNum Streams: " << params.num_streams << '\n';
   os << "\tM: " << params.m << '\n';
   os << "\tRunning Cpu: " << std::boolalpha << params.cpu << '\n';
+  os << "\tHuge Pages: " << params.huge_pages << '\n';
+  os << "\tPopulate: " << params.populate << '\n';
+  os << "\tLNT Placement: " << params.lnt_placement << '\n';
+  os << "\tTree Layout: " << params.tree_layout << '\n';
+  os << "\tSplit Policy: " << params.split_policy << '\n';
+  os << "\tIndex File: " << params.index_file << '\n';
+  os << "\tSave Index File: " << params.save_index_file << '\n';
+  os << "\tInsert Batch: " << params.insert_batch << '\n';
+  os << "\tDims: " << params.dims << '\n';
+  os << "\tDouble: " << params.use_double << '\n';
+  os << "\tRadius: " << params.radius << '\n';
+  os << "\tCount Only: " << params.count_only << '\n';
+  os << "\tEpsilon: " << params.epsilon << '\n';
+  os << "\tMax Leaves: " << params.max_leaves << '\n';
+  os << "\tDual Tree: " << params.dual_tree << '\n';
+  os << "\tSelf Join: " << params.self_join << '\n';
   return os;
 }
@@ -0,0 +1,614 @@
+#pragma once
+
+#include <omp.h>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <deque>
+#include <limits>
+#include <utility>
+#include <vector>
+
+#include "../Utils.hpp"
+#include "Functors/LeafKernels.hpp"
+#include "KDTree.hpp"
+#include "KnnSet.hpp"
+#include "ReducerHandler.hpp"
+#include "Redwood.hpp"
+
+// Of the last join of a 'DualTreeKnn'
+struct JoinStats {
+  std::size_t num_queries = 0;
+  // (query group, reference node) pairs visited, and how many were pruned,
+  // see 'Gather()'
+  std::size_t num_pairs = 0;
+  std::size_t num_pruned = 0;
+  // (query point, reference leaf) items pushed into the batches
+  std::size_t num_leaves = 0;
+};
+
+// All k-nearest-neighbors of a whole query set at once, with a kd-tree of the
+// queries walked against the reference tree (dual-tree search). The points of
+// a query leaf are a group, and so is the pivot of a branch node on its own. A
+// group skips a reference subtree together when their bounding boxes are
+// farther apart than the worst k-th distance of its points so far.
+//
+// The reference leaves a group did not skip are its candidates. Each point of
+// the group then goes through them nearest first, one leaf at a time, until
+// the next one is out of range. The leaf is pushed into the thread's batch
+// like in 'Executor', with the points of many groups, so the batches stay
+// full, and the streams are rotated as in 'QueryEngine'. A point only pushes
+// its next leaf once the result of the last one is in, so it prunes with
+// bounds that are up to date. The kernels return the K nearest points of each
+// leaf ('rdc::SetNumNeighbors()'), K + 1 in a self-join, where one of them may
+// be the query itself. The pivots of the reference branch nodes are in no
+// leaf, they are compared on the host.
+//
+// Euclidean only, the metric of the leaf kernels ('rdc::LeafFunctor'). The
+// reference leaves are the ones of the leaf node table: call 'rdc::Init()'
+// and 'LoadPayload()' before. One join at a time, which sets the result slots
+// of the batches, after a fixed-radius search too.
+template <typename Tree, int K = 1>
+class DualTreeKnn {
+  using PointT = typename Tree::PointT;
+  static constexpr int Dim = PointT::kDims;
+  using T = typename PointT::Scalar;
+  using Functor = rdc::LeafFunctor;
+
+ public:
+  // In ascending order of distance, see 'KnnSet::Sorted()'
+  using Neighbors = std::array<Neighbor<T>, K>;
+
+  explicit DualTreeKnn(const Tree& reference)
+      : reference_(reference),
+        num_threads_(rdc::stored_num_threads),
+        num_streams_(rdc::stored_num_streams),
+        batch_size_(rdc::stored_batch_size) {
+    ref_boxes_ =
+        Boxes(reference_, [](const kdt::Node<T>& leaf, const int pos) {
+          return rdc::LntDataAddrAt<Dim, T>(
+              leaf.uid)[pos - leaf.node_type.leaf.idx_left];
+        });
+  }
+
+  DualTreeKnn(const DualTreeKnn&) = delete;
+  DualTreeKnn& operator=(const DualTreeKnn&) = delete;
+
+  // Bichromatic, 'results[i]' are the neighbors of 'queries[i]' among the
+  // reference points. The queries get a kd-tree of their own, with the leaf
+  // size of the reference tree.
+  _NODISCARD std::vector<Neighbors> Run(const std::vector<PointT>& queries) {
+    const auto n = static_cast<int>(queries.size());
+    if (n == 0) return {};
+
+    const kdt::KdtParams params{reference_.GetParams().leaf_max_size,
+                                num_threads_};
+    const Tree query_tree(params, queries.data(), n);
+    return Join(query_tree, queries.data(), n, false);
+  }
+
+  // Each reference point against all the others, e.g., for a kNN graph.
+  // 'results[id]' are the neighbors of the point of id 'id', itself excluded.
+  // The reference tree is the query tree too, the points are read back from
+  // the leaf node table, so this also works on a loaded index.
+  _NODISCARD std::vector<Neighbors> SelfJoin() {
+    const auto n = reference_.NumLeafPoints() +
+                   reference_.GetStats().num_branch_nodes;
+    std::vector<PointT> points(n);
+    CollectPoints(Tree::kRoot, points);
+    return Join(reference_, points.data(), n, true);
+  }
+
+  _NODISCARD JoinStats Stats() const {
+    JoinStats total;
+    total.num_queries = sets_.size();
+    for (const auto& stats : thread_stats_) {
+      total.num_pairs += stats.num_pairs;
+      total.num_pruned += stats.num_pruned;
+      total.num_leaves += stats.num_leaves;
+    }
+    return total;
+  }
+
+ private:
+  // Bounding box of the points under a node, leaves and pivots, which are the
+  // positions [first, last] of the tree's accessor ('KdTree::PointId()')
+  struct Box {
+    std::array<T, Dim> lo;
+    std::array<T, Dim> hi;
+    int first;
+    int last;
+  };
+
+  // What a slot of a batch is for: query id, reference leaf node, and the
+  // index of the search it is from, -1 for a seed
+  struct Pending {
+    int query;
+    int leaf;
+    int search;
+  };
+
+  // A query point on its own, after its group was joined: the reference
+  // leaves it may have a neighbor in, and their distance to it, nearest last
+  struct Search {
+    int query;
+    std::vector<std::pair<T, int>> leaves;
+  };
+
+  // Per traversal thread
+  struct Worker {
+    int tid;
+    int cur_stream;
+    // [stream_id][slot]
+    std::vector<std::vector<Pending>> pending;
+    // The ones not in 'free_searches' are in progress, 'num_active' of them.
+    // The ones in 'ready' have no leaf in a batch.
+    std::vector<Search> searches;
+    std::vector<int> free_searches;
+    std::vector<int> ready;
+    int num_active;
+    // Reference leaves of the current group and their distance to it, see
+    // 'Gather()'
+    std::vector<std::pair<T, int>> candidates;
+    JoinStats stats;
+  };
+
+  // Query points joined together: the points of the leaf 'node' of the query
+  // tree, or only the pivot of the branch 'node'. A task of a thread is a
+  // subtree of the query tree, all of its groups, or only the pivot of a node
+  // above them.
+  struct Group {
+    int node;
+    bool pivot_only;
+  };
+
+  _NODISCARD std::vector<Neighbors> Join(const Tree& query_tree,
+                                         const PointT* queries, const int n,
+                                         const bool self) {
+    query_tree_ = &query_tree;
+    queries_ = queries;
+    self_ = self;
+    query_boxes_ =
+        self ? ref_boxes_
+             : Boxes(query_tree, [&](const kdt::Node<T>&, const int pos) {
+                 return queries[query_tree.PointId(pos)];
+               });
+    seeds_.assign(n, Tree::kNull);
+    seeding_.assign(n, 0);
+    sets_.resize(n);
+    for (auto& set : sets_) set.Reset();
+    rdc::SetNumNeighbors<Dim, T>(self ? K + 1 : K);
+
+    // About 4 subtrees per thread, like 'KdTree::BuildTree()'
+    auto task_depth = 0;
+    while (num_threads_ > 1 && (1 << task_depth) < 4 * num_threads_) {
+      ++task_depth;
+    }
+    std::vector<Group> tasks;
+    SplitQueryTree(Tree::kRoot, 0, task_depth, tasks);
+
+    std::atomic<int> next{0};
+    thread_stats_.assign(num_threads_, JoinStats{});
+
+#pragma omp parallel for num_threads(num_threads_)
+    for (int tid = 0; tid < num_threads_; ++tid) {
+      const redwood::numa::ScopedPin pin(tid);
+
+      Worker worker{tid, 0, std::vector<std::vector<Pending>>(num_streams_),
+                    {}, {}, {}, 0, {}, JoinStats{}};
+      for (auto& pending : worker.pending) pending.reserve(batch_size_);
+
+      // The groups of the tasks taken, one after the other
+      std::vector<Group> groups;
+      std::size_t next_group = 0;
+      const auto next_task = [&] {
+        const auto i = next++;
+        if (i >= static_cast<int>(tasks.size())) return false;
+        groups.clear();
+        next_group = 0;
+        if (tasks[i].pivot_only) {
+          groups.push_back(tasks[i]);
+        } else {
+          CollectGroups(tasks[i].node, groups);
+        }
+        return true;
+      };
+
+      // Seeded, and joined once the results of their seeds are in
+      std::deque<Group> seeded;
+      while (true) {
+        while (true) {
+          PushSearches(worker);
+          if (BatchFull(worker)) break;
+
+          if (!seeded.empty() && SeedsDone(seeded.front())) {
+            JoinGroup(worker, seeded.front());
+            seeded.pop_front();
+          } else if (next_group < groups.size() || next_task()) {
+            seeded.push_back(groups[next_group++]);
+            Seed(worker, seeded.back());
+          } else {
+            break;
+          }
+        }
+
+        if (worker.num_active == 0 && seeded.empty() &&
+            next_group == groups.size()) {
+          break;
+        }
+        Flush(worker);
+      }
+
+      thread_stats_[tid] = worker.stats;
+    }
+
+    std::vector<Neighbors> results(n);
+    for (int i = 0; i < n; ++i) results[i] = sets_[i].Sorted();
+    return results;
+  }
+
+  void SplitQueryTree(const int node_idx, const int depth,
+                      const int task_depth,
+                      std::vector<Group>& tasks) const {
+    if (depth == task_depth || query_tree_->GetNode(node_idx).IsLeaf()) {
+      tasks.push_back({node_idx, false});
+      return;
+    }
+
+    tasks.push_back({node_idx, true});
+    SplitQueryTree(query_tree_->Child(node_idx, kdt::Dir::kLeft), depth + 1,
+                   task_depth, tasks);
+    SplitQueryTree(query_tree_->Child(node_idx, kdt::Dir::kRight), depth + 1,
+                   task_depth, tasks);
+  }
+
+  // Every group of the subtree of query node 'q'
+  void CollectGroups(const int q, std::vector<Group>& groups) const {
+    if (query_tree_->GetNode(q).IsLeaf()) {
+      groups.push_back({q, false});
+      return;
+    }
+
+    groups.push_back({q, true});
+    CollectGroups(query_tree_->Child(q, kdt::Dir::kLeft), groups);
+    CollectGroups(query_tree_->Child(q, kdt::Dir::kRight), groups);
+  }
+
+  // 'f(id)' for each query point of 'group'
+  template <typename F>
+  void ForEachQuery(const Group& group, const F& f) const {
+    if (group.pivot_only) {
+      f(query_tree_->PivotId(group.node));
+      return;
+    }
+
+    const auto& box = query_boxes_[group.node];
+    for (auto pos = box.first; pos <= box.last; ++pos) {
+      f(query_tree_->PointId(pos));
+    }
+  }
+
+  _NODISCARD Box GroupBox(const Group& group) const {
+    if (!group.pivot_only) return query_boxes_[group.node];
+
+    const auto& pivot = queries_[query_tree_->PivotId(group.node)];
+    Box box;
+    std::copy_n(pivot.data, Dim, box.lo.begin());
+    std::copy_n(pivot.data, Dim, box.hi.begin());
+    return box;
+  }
+
+  // The worst k-th distance of the points of 'group'
+  _NODISCARD T GroupBound(const Group& group) const {
+    auto bound = T(0);
+    ForEachQuery(group, [&](const int id) {
+      bound = std::max(bound, sets_[id].WorstDist());
+    });
+    return bound;
+  }
+
+  // Each point of 'group' against the reference leaf it is in, before
+  // anything else. Otherwise nothing is pruned while the candidates are
+  // gathered, each point starts with the bound a single-tree search has after
+  // its first leaf. The group is joined once they are back, see 'SeedsDone()',
+  // meanwhile the batches are filled with other groups.
+  void Seed(Worker& worker, const Group& group) {
+    ForEachQuery(group, [&](const int id) {
+      const auto& q = queries_[id];
+      auto r = Tree::kRoot;
+      while (!reference_.GetNode(r).IsLeaf()) {
+        const auto& node = reference_.GetNode(r);
+        r = reference_.Child(r, q.data[node.axis] < node.split
+                                    ? kdt::Dir::kLeft
+                                    : kdt::Dir::kRight);
+      }
+
+      seeds_[id] = r;
+      Push(worker, id, r, -1);
+      seeding_[id] = 1;
+    });
+  }
+
+  _NODISCARD bool SeedsDone(const Group& group) const {
+    auto done = true;
+    ForEachQuery(group, [&](const int id) { done = done && !seeding_[id]; });
+    return done;
+  }
+
+  // The candidates of 'group', then a search for each of its points that has
+  // any in range. By distance to the group, so each point stops at its own
+  // bound.
+  void JoinGroup(Worker& worker, const Group& group) {
+    auto bound = GroupBound(group);
+    worker.candidates.clear();
+    Gather(worker, group, GroupBox(group), Tree::kRoot, bound);
+    std::sort(worker.candidates.begin(), worker.candidates.end());
+
+    ForEachQuery(group, [&](const int id) {
+      if (worker.free_searches.empty()) {
+        worker.free_searches.push_back(
+            static_cast<int>(worker.searches.size()));
+        worker.searches.emplace_back();
+      }
+      const auto index = worker.free_searches.back();
+      auto& search = worker.searches[index];
+      search.query = id;
+      search.leaves.clear();
+
+      // No closer to the point than to the group
+      const auto worst = sets_[id].WorstDist();
+      for (const auto& [group_dist, r] : worker.candidates) {
+        if (!(group_dist < worst)) break;
+        if (r == seeds_[id]) continue;
+        const auto dist = MinDist(queries_[id], ref_boxes_[r]);
+        if (dist < worst) search.leaves.emplace_back(dist, r);
+      }
+      if (search.leaves.empty()) return;
+
+      std::sort(search.leaves.begin(), search.leaves.end(),
+                [](const auto& a, const auto& b) { return a.first > b.first; });
+      worker.free_searches.pop_back();
+      worker.ready.push_back(index);
+      ++worker.num_active;
+    });
+  }
+
+  // The reference leaves under 'r' the points of 'group' may have a neighbor
+  // in, nearest subtree first, into 'worker.candidates'. The pivots on the way
+  // are compared on the host, they tighten 'bound', the worst k-th distance of
+  // the group.
+  void Gather(Worker& worker, const Group& group, const Box& box, const int r,
+              T& bound) {
+    ++worker.stats.num_pairs;
+    const auto dist = MinDist(box, ref_boxes_[r]);
+    if (dist >= bound) {
+      ++worker.stats.num_pruned;
+      return;
+    }
+
+    if (reference_.GetNode(r).IsLeaf()) {
+      worker.candidates.emplace_back(dist, r);
+      return;
+    }
+
+    // **** Reduction at tree node ****
+    const auto& pivot = reference_.GetPivot(r);
+    if (MinDist(pivot, box) < bound) {
+      const auto pivot_id = reference_.PivotId(r);
+      bound = T(0);
+      ForEachQuery(group, [&](const int id) {
+        Insert(id, pivot, pivot_id);
+        bound = std::max(bound, sets_[id].WorstDist());
+      });
+    }
+    // **********************************
+
+    auto near = reference_.Child(r, kdt::Dir::kLeft);
+    auto far = reference_.Child(r, kdt::Dir::kRight);
+    if (MinDist(box, ref_boxes_[far]) < MinDist(box, ref_boxes_[near])) {
+      std::swap(near, far);
+    }
+    Gather(worker, group, box, near, bound);
+    Gather(worker, group, box, far, bound);
+  }
+
+  // The next leaf of every ready search, until the batch is full. The
+  // searches with none left in range are done.
+  void PushSearches(Worker& worker) {
+    while (!worker.ready.empty() && !BatchFull(worker)) {
+      const auto index = worker.ready.back();
+      worker.ready.pop_back();
+
+      auto& search = worker.searches[index];
+      auto& leaves = search.leaves;
+      if (leaves.empty() ||
+          !(leaves.back().first < sets_[search.query].WorstDist())) {
+        worker.free_searches.push_back(index);
+        --worker.num_active;
+        continue;
+      }
+
+      Push(worker, search.query, leaves.back().second, index);
+      leaves.pop_back();
+    }
+  }
+
+  void Insert(const int id, const PointT& p, const int p_id) {
+    if (self_ && p_id == id) return;
+
+    constexpr Functor functor;
+    sets_[id].Insert(functor(p, queries_[id]), p_id);
+  }
+
+  _NODISCARD bool BatchFull(const Worker& worker) const {
+    return static_cast<int>(worker.pending[worker.cur_stream].size()) ==
+           batch_size_;
+  }
+
+  // Query 'id' against reference leaf 'leaf', in the current batch, for
+  // search 'search' (-1 for a seed). A full batch is launched first.
+  void Push(Worker& worker, const int id, const int leaf, const int search) {
+    if (BatchFull(worker)) Flush(worker);
+
+    auto& pending = worker.pending[worker.cur_stream];
+    [[maybe_unused]] const auto slot = rdc::ReduceLeafNode<Dim, T>(
+        worker.tid, worker.cur_stream, {id, queries_[id]},
+        reference_.GetNode(leaf).uid);
+    assert(slot == static_cast<int>(pending.size()));
+    pending.push_back({id, leaf, search});
+    ++worker.stats.num_leaves;
+  }
+
+  // Launches the current batch, if anything is in it, switches to the next
+  // stream and inserts the results of its batch once it has finished
+  void Flush(Worker& worker) {
+    const auto tid = worker.tid;
+    if (!worker.pending[worker.cur_stream].empty()) {
+      rdc::LaunchAsyncWorkQueue<Dim, T>(tid, worker.cur_stream);
+    }
+
+    worker.cur_stream = (worker.cur_stream + 1) % num_streams_;
+    rdc::WaitBatch(tid, worker.cur_stream);
+
+    auto& pending = worker.pending[worker.cur_stream];
+    const auto results = rdc::BatchResults<Dim, T>(tid, worker.cur_stream);
+    for (std::size_t slot = 0; slot < pending.size(); ++slot) {
+      const auto& item = pending[slot];
+      InsertLeaf(item, results.At(static_cast<int>(slot)), results.stride);
+      if (item.search < 0) {
+        seeding_[item.query] = 0;
+      } else {
+        worker.ready.push_back(item.search);
+      }
+    }
+    pending.clear();
+    rdc::ResetBuffer<Dim, T>(tid, worker.cur_stream);
+  }
+
+  // The 'n' nearest points of a reference leaf, in ascending order, by
+  // position in the leaf. In a self-join, the query itself is skipped.
+  void InsertLeaf(const Pending& item, const reduce::Entry<T>* nearest,
+                  const int n) {
+    auto& set = sets_[item.query];
+    const auto idx_left =
+        reference_.GetNode(item.leaf).node_type.leaf.idx_left;
+    for (int i = 0; i < n && nearest[i].value < set.WorstDist(); ++i) {
+      const auto id = reference_.PointId(idx_left + nearest[i].pos);
+      if (!(self_ && id == item.query)) set.Insert(nearest[i].value, id);
+    }
+  }
+
+  // Lower bounds of the distance between the points of two boxes, and between
+  // a point and the points of a box
+  _NODISCARD static T MinDist(const Box& a, const Box& b) {
+    auto dist_sqr = T(0);
+    for (int d = 0; d < Dim; ++d) {
+      const auto gap = std::max({a.lo[d] - b.hi[d], b.lo[d] - a.hi[d], T(0)});
+      dist_sqr += gap * gap;
+    }
+    return Functor().FromSquared(dist_sqr);
+  }
+
+  _NODISCARD static T MinDist(const PointT& p, const Box& b) {
+    auto dist_sqr = T(0);
+    for (int d = 0; d < Dim; ++d) {
+      const auto gap =
+          std::max({p.data[d] - b.hi[d], b.lo[d] - p.data[d], T(0)});
+      dist_sqr += gap * gap;
+    }
+    return Functor().FromSquared(dist_sqr);
+  }
+
+  // By node index of 'tree'. 'leaf_point(leaf, pos)' is the point at position
+  // 'pos' of a leaf node (see 'Box').
+  template <typename LeafPoint>
+  _NODISCARD static std::vector<Box> Boxes(const Tree& tree,
+                                           const LeafPoint& leaf_point) {
+    std::vector<Box> boxes(tree.NumNodes());
+    BoxesRecursive(tree, Tree::kRoot, leaf_point, boxes);
+    return boxes;
+  }
+
+  template <typename LeafPoint>
+  static void BoxesRecursive(const Tree& tree, const int node_idx,
+                             const LeafPoint& leaf_point,
+                             std::vector<Box>& boxes) {
+    const auto& node = tree.GetNode(node_idx);
+    auto& box = boxes[node_idx];
+    box.lo.fill(std::numeric_limits<T>::max());
+    box.hi.fill(std::numeric_limits<T>::lowest());
+
+    if (node.IsLeaf()) {
+      box.first = node.node_type.leaf.idx_left;
+      box.last = node.node_type.leaf.idx_right;
+      for (auto pos = box.first; pos <= box.last; ++pos) {
+        Extend(box, leaf_point(node, pos));
+      }
+      return;
+    }
+
+    const auto left = tree.Child(node_idx, kdt::Dir::kLeft);
+    const auto right = tree.Child(node_idx, kdt::Dir::kRight);
+    BoxesRecursive(tree, left, leaf_point, boxes);
+    BoxesRecursive(tree, right, leaf_point, boxes);
+
+    box.first = boxes[left].first;
+    box.last = boxes[right].last;
+    Extend(box, tree.GetPivot(node_idx));
+    for (const auto child : {left, right}) {
+      for (int d = 0; d < Dim; ++d) {
+        box.lo[d] = std::min(box.lo[d], boxes[child].lo[d]);
+        box.hi[d] = std::max(box.hi[d], boxes[child].hi[d]);
+      }
+    }
+  }
+
+  static void Extend(Box& box, const PointT& p) {
+    for (int d = 0; d < Dim; ++d) {
+      box.lo[d] = std::min(box.lo[d], p.data[d]);
+      box.hi[d] = std::max(box.hi[d], p.data[d]);
+    }
+  }
+
+  // Every point of the reference tree, by id
+  void CollectPoints(const int node_idx, std::vector<PointT>& points) const {
+    const auto& node = reference_.GetNode(node_idx);
+    if (node.IsLeaf()) {
+      const auto& box = ref_boxes_[node_idx];
+      const auto leaf_addr = rdc::LntDataAddrAt<Dim, T>(node.uid);
+      for (auto pos = box.first; pos <= box.last; ++pos) {
+        points[reference_.PointId(pos)] = leaf_addr[pos - box.first];
+      }
+      return;
+    }
+
+    points[reference_.PivotId(node_idx)] = reference_.GetPivot(node_idx);
+    CollectPoints(reference_.Child(node_idx, kdt::Dir::kLeft), points);
+    CollectPoints(reference_.Child(node_idx, kdt::Dir::kRight), points);
+  }
+
+  const Tree& reference_;
+  int num_threads_;
+  int num_streams_;
+  int batch_size_;
+
+  // By node index of the reference tree
+  std::vector<Box> ref_boxes_;
+
+  // Of the current join. 'queries_' and 'sets_' are by query id.
+  const Tree* query_tree_ = nullptr;
+  const PointT* queries_ = nullptr;
+  bool self_ = false;
+  std::vector<Box> query_boxes_;
+  std::vector<KnnSet<T, K>> sets_;
+
+  // By query id, see 'Seed()', and whether it is still in a batch
+  std::vector<int> seeds_;
+  std::vector<char> seeding_;
+
+  // Of the last join, [tid]
+  std::vector<JoinStats> thread_stats_;
+};
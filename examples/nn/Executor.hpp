@@ -1,55 +1,155 @@
 #pragma once
 
+#include <array>
+#include <cassert>
+#include <type_traits>
+
 #include "GlobalVars.hpp"
 #include "KDTree.hpp"
+#include "KnnSet.hpp"
+#include "RadiusSet.hpp"
 #include "ReducerHandler.hpp"
 
-using Task = std::pair<int, Point4F>;
-
 enum class ExecutionState { kWorking, kFinished };
 
+// Arya-Mount incremental distance from the query to the cell of a node.
+// 'off[d]' is how far the query is outside the cell along dimension 'd', and
+// 'dist_sqr' the sum of their squares. Going to the far side of a split only
+// changes one of them, so it is updated in O(1).
+template <int Dim, typename T>
+struct CellBound {
+  _NODISCARD CellBound FarChild(const int axis, const T diff) const {
+    auto bound = *this;
+    bound.dist_sqr += diff * diff - off[axis] * off[axis];
+    bound.off[axis] = diff;
+    return bound;
+  }
+
+  std::array<T, Dim> off{};
+  T dist_sqr = T(0);
+};
+
+// Per query, trading accuracy for latency. The defaults are an exact search.
+struct SearchOptions {
+  // (1 + epsilon)-approximate: a cell is pruned once it is farther than the
+  // result so far divided by (1 + epsilon), so the nearest neighbor found is
+  // at most (1 + epsilon) times farther than the true one. For fixed-radius
+  // search, points closer than radius / (1 + epsilon) are all found.
+  double epsilon = 0.0;
+
+  // Reduce at most this many leaf nodes and return the result so far, 0 for
+  // no limit. The near side of a split is searched first, so the first
+  // leaves are the most promising ones.
+  int max_leaves = 0;
+};
+
+template <int Dim, typename T>
 struct CallStackField {
-  kdt::Node* current;
+  int current;
   int axis;
-  float train;
+  T train;
   kdt::Dir dir;
+  CellBound<Dim, T> bound;
 };
 
-// Nn/Knn Algorithm
-template <typename Functor>
+// Nn/Knn Algorithm, over the trees of 'Point<Dim, T>' ('query_trees'). With a
+// 'KnnSet<T, K>', the batches must have room for the K nearest points of a
+// leaf, see 'rdc::SetNumNeighbors()'. With a 'RadiusSet', fixed-radius search
+// instead, with the radius of 'rdc::SetRadius()'.
+template <typename Functor, int Dim, typename T,
+          typename ResultSet = KnnSet<T, 1>>
 class Executor {
+  using Tree = kdt::KdTree<Dim, T>;
+
+  static constexpr bool kRadius = std::is_same_v<ResultSet, RadiusSet<T>>;
+  static constexpr int kNumNeighbors = kNumNeighborsOf<ResultSet>;
+
  public:
   // Thread id, i.e., [0, .., n_threads]
-  // Stream id in the thread, i.e., [0, 1]
+  // Stream id in the thread, i.e., [0, .., n_streams]
   // My id in the group executor, i.e., [0,...,1023]
   Executor(const int tid, const int stream_id, const int uid)
-      : cur_(),
+      : cur_(Tree::kNull),
         state_(ExecutionState::kFinished),
         my_tid_(tid),
         my_stream_id_(stream_id),
         my_uid_(uid) {
     stack_.reserve(16);
-    my_assigned_result_addr = rdc::RequestResultAddr(tid, stream_id, uid);
   }
 
   _NODISCARD bool Finished() const {
     return state_ == ExecutionState::kFinished;
   }
 
-  void SetQuery(const Task& task) { my_task_ = task; }
+  void SetQuery(const Task<Dim, T>& task) { my_task_ = task; }
+
+  // For the next queries
+  void SetOptions(const SearchOptions& options) {
+    options_ = options;
+    prune_scale_ = static_cast<T>(1.0 + options.epsilon);
+  }
 
   void StartQuery() {
     stack_.clear();
-    result_set->Reset();
+    ResetResult();
     Execute();
   }
 
-  void Resume() { Execute(); }
+  // 'results' are the ones of the batch the last leaf node was pushed into
+  void Resume(const rdc::ResultSpan<T>& results) {
+    assert(results.stride >= kNumNeighbors);
+    InsertLeaf(cur_, results.At(pending_slot_), results.stride);
+    Execute();
+  }
 
-  _NODISCARD float CpuTraverse() {
-    result_set->Reset();
-    TraversalRecursive(tree_ref->root_);
-    return result_set->WorstDist();
+  // Same, for fixed-radius search
+  void Resume(const rdc::MatchSpan& matches) {
+    const auto count = matches.Count(pending_slot_);
+    if (result_set.CountOnly()) {
+      result_set.Add(count);
+    } else if (count <= matches.stride) {
+      const auto idx_left = tree_->GetNode(cur_).node_type.leaf.idx_left;
+      const auto positions = matches.At(pending_slot_);
+      for (int i = 0; i < count; ++i) {
+        result_set.Append(tree_->PointId(idx_left + positions[i]));
+      }
+    } else {
+      ScanLeaf(cur_);
+    }
+    Execute();
+  }
+
+  // Returns the distance to the nearest neighbor, or the number of points in
+  // range for fixed-radius search. The whole query at once, without batches.
+  auto CpuTraverse() {
+    ResetResult();
+    for (const auto tree : query_trees<Dim, T>) {
+      if (truncated_) break;
+      tree_ = tree;
+      TraversalRecursive(Tree::kRoot, CellBound<Dim, T>{});
+    }
+    return Result();
+  }
+
+  // Of the last finished query, its id is -1 if nothing was found
+  _NODISCARD Neighbor<T> Nearest() const { return result_set.Sorted()[0]; }
+
+  // Of the last finished query, leaf nodes reduced and whether it stopped at
+  // 'max_leaves'
+  _NODISCARD int NumLeaves() const { return num_leaves_; }
+  _NODISCARD bool Truncated() const { return truncated_; }
+
+  // The result of the last finished query, 'Nearest()', all K of them in
+  // ascending order ('KnnSet::Sorted()') or a 'RadiusResult' (its ids are
+  // moved out). Once per query.
+  _NODISCARD auto TakeResult() {
+    if constexpr (kRadius) {
+      return result_set.Take();
+    } else if constexpr (kNumNeighbors > 1) {
+      return result_set.Sorted();
+    } else {
+      return Nearest();
+    }
   }
 
  protected:
@@ -58,113 +158,203 @@ class Executor {
 
     if (state_ == ExecutionState::kWorking) goto my_resume_point;
     state_ = ExecutionState::kWorking;
-    cur_ = tree_ref->root_;
-
-    // Begin Iteration
-    while (cur_ != nullptr || !stack_.empty()) {
-      // Traverse all the way to left most leaf node
-      while (cur_ != nullptr) {
-        if (cur_->IsLeaf()) {
-          // **** Reduction at Leaf Node (replaced with Redwood API) ****
 
-          rdc::ReduceLeafNode(my_tid_, my_stream_id_, my_task_, cur_->uid);
+    // Fan out to every tree, the result so far prunes the next ones
+    for (tree_idx_ = 0; tree_idx_ < query_trees<Dim, T>.size() && !truncated_;
+         ++tree_idx_) {
+      tree_ = query_trees<Dim, T>[tree_idx_];
+      cur_ = Tree::kRoot;
+      bound_ = CellBound<Dim, T>{};
+
+      // Begin Iteration
+      while (cur_ != Tree::kNull || !stack_.empty()) {
+        // Traverse all the way to left most leaf node
+        while (cur_ != Tree::kNull) {
+          // The whole cell is out of range (the result may have improved since
+          // the check on the parent)
+          if (Pruned(bound_)) {
+            cur_ = Tree::kNull;
+            continue;
+          }
+
+          if (tree_->GetNode(cur_).IsLeaf()) {
+            if (OutOfLeaves()) {
+              stack_.clear();
+              cur_ = Tree::kNull;
+              continue;
+            }
+
+            // **** Reduction at Leaf Node (replaced with Redwood API) ****
+
+            pending_slot_ =
+                rdc::ReduceLeafNode(my_tid_, my_stream_id_, my_task_,
+                                    tree_->GetNode(cur_).uid);
+
+            // **** Coroutine Reuturn (API) ****
+            return;
+          my_resume_point:
+            // ****************************
+
+            cur_ = Tree::kNull;
+            continue;
+          }
+
+          // **** Reduction at tree node ****
+          const auto& node = tree_->GetNode(cur_);
+          const auto dist = functor(tree_->GetPivot(cur_), my_task_.second);
+
+          result_set.Insert(dist, tree_->PivotId(cur_));
+          // **********************************
+
+          // Determine which child node to traverse next
+          const auto axis = node.axis;
+          const auto train = node.split;
+          const auto dir = my_task_.second.data[axis] < train
+                               ? kdt::Dir::kLeft
+                               : kdt::Dir::kRight;
+
+          // Recursion 1, the near child has the same bound
+          stack_.push_back({cur_, axis, train, dir, bound_});
+          cur_ = tree_->Child(cur_, dir);
+        }
 
-          // **** Coroutine Reuturn (API) ****
-          return;
-        my_resume_point:
-          // ****************************
+        if (!stack_.empty()) {
+          const auto [last_cur, axis, train, dir, bound] = stack_.back();
+          stack_.pop_back();
 
-          cur_ = nullptr;
-          continue;
+          // Recursion 2, pruned at the top of the loop if out of range
+          bound_ = bound.FarChild(axis, my_task_.second.data[axis] - train);
+          cur_ = tree_->Child(last_cur, FlipDir(dir));
         }
+      }
+    }
 
-        // **** Reduction at tree node ****
-        const unsigned accessor_idx =
-            tree_ref->v_acc_[cur_->node_type.tree.idx_mid];
-        const float dist =
-            functor(tree_ref->in_data_ref_[accessor_idx], my_task_.second);
-
-        result_set->Insert(dist);
-        // **********************************
+    // Done traversals, see 'TakeResult()'
+    state_ = ExecutionState::kFinished;
+  }
 
-        // Determine which child node to traverse next
-        const auto axis = cur_->node_type.tree.axis;
-        const auto train = tree_ref->in_data_ref_[accessor_idx].data[axis];
-        const auto dir = my_task_.second.data[axis] < train ? kdt::Dir::kLeft
-                                                            : kdt::Dir::kRight;
+  void ResetResult() {
+    num_leaves_ = 0;
+    truncated_ = false;
+    if constexpr (kRadius) {
+      const auto& radius = rdc::radius_query<Dim, T>;
+      result_set.Reset(radius.radius, radius.count_only);
+    } else {
+      result_set.Reset();
+    }
+  }
 
-        // Recursion 1
-        stack_.push_back({cur_, axis, train, dir});
-        cur_ = cur_->GetChild(dir);
-      }
+  _NODISCARD bool Pruned(const CellBound<Dim, T>& bound) const {
+    constexpr Functor functor;
+    return functor.FromSquared(bound.dist_sqr) * prune_scale_ >=
+           result_set.WorstDist();
+  }
 
-      if (!stack_.empty()) {
-        const auto [last_cur, axis, train, dir] = stack_.back();
-        stack_.pop_back();
+  // Counts the leaf about to be reduced, true (and nothing counted) once the
+  // budget is spent
+  _NODISCARD bool OutOfLeaves() {
+    if (options_.max_leaves > 0 && num_leaves_ >= options_.max_leaves) {
+      truncated_ = true;
+    } else {
+      ++num_leaves_;
+    }
+    return truncated_;
+  }
 
-        if (const auto diff = functor(my_task_.second.data[axis], train);
-            diff < result_set->WorstDist()) {
-          // Recursion 2
-          cur_ = last_cur->GetChild(FlipDir(dir));
-        }
-      }
+  _NODISCARD auto Result() const {
+    if constexpr (kRadius) {
+      return result_set.Count();
+    } else {
+      return result_set.WorstDist();
     }
+  }
 
-    // Done traversals
-    state_ = ExecutionState::kFinished;
+  // The 'n' nearest points of a leaf, in ascending order, by position in the
+  // leaf. Stops at the first one that does not improve the result, which
+  // includes the missing ones of a small leaf.
+  void InsertLeaf(const int node_idx, const reduce::Entry<T>* nearest,
+                  const int n) {
+    const auto idx_left = tree_->GetNode(node_idx).node_type.leaf.idx_left;
+    for (int i = 0; i < n && nearest[i].value < result_set.WorstDist(); ++i) {
+      result_set.Insert(nearest[i].value,
+                        tree_->PointId(idx_left + nearest[i].pos));
+    }
+  }
 
-    final_results1[my_task_.first] = result_set->WorstDist();
+  // Every point of the leaf against the radius (or into the K nearest), on the
+  // host
+  void ScanLeaf(const int node_idx) {
+    constexpr Functor functor;
+    const auto& node = tree_->GetNode(node_idx);
+    const auto leaf_addr = rdc::LntDataAddrAt<Dim, T>(my_tid_, node.uid);
+    const auto leaf_size = rdc::LntLeafSize(my_tid_, node.uid);
+    for (int i = 0; i < leaf_size; ++i) {
+      result_set.Insert(functor(leaf_addr[i], my_task_.second),
+                        tree_->PointId(node.node_type.leaf.idx_left + i));
+    }
   }
 
-  void TraversalRecursive(const kdt::Node* cur) {
+  void TraversalRecursive(const int cur, const CellBound<Dim, T>& bound) {
     constexpr Functor functor;
+    const auto& node = tree_->GetNode(cur);
+
+    if (truncated_ || Pruned(bound)) return;
+
+    if (node.IsLeaf()) {
+      if (OutOfLeaves()) return;
 
-    if (cur->IsLeaf()) {
       // **** Reduction at leaf node ****
-      const auto leaf_addr = rdc::LntDataAddrAt(cur->uid);
-      for (int i = 0; i < rdc::stored_max_leaf_size; ++i) {
-        const float dist = functor(leaf_addr[i], my_task_.second);
-        result_set->Insert(dist);
+      if constexpr (kRadius || kNumNeighbors > 1) {
+        ScanLeaf(cur);
+      } else {
+        const auto leaf_addr = rdc::LntDataAddrAt<Dim, T>(my_tid_, node.uid);
+        const auto leaf_size = rdc::LntLeafSize(my_tid_, node.uid);
+        const auto nearest =
+            leaf::Nearest(functor, leaf_addr, leaf_size, my_task_.second);
+        InsertLeaf(cur, &nearest, 1);
       }
       // **********************************
     } else {
       // **** Reduction at tree node ****
-      const unsigned accessor_idx =
-          tree_ref->v_acc_[cur->node_type.tree.idx_mid];
-      const float dist =
-          functor(tree_ref->in_data_ref_[accessor_idx], my_task_.second);
-      result_set->Insert(dist);
+      const auto dist = functor(tree_->GetPivot(cur), my_task_.second);
+      result_set.Insert(dist, tree_->PivotId(cur));
       // **********************************
 
       // Determine which child node to traverse next
-      const auto axis = cur->node_type.tree.axis;
-      const auto train = tree_ref->in_data_ref_[accessor_idx].data[axis];
+      const auto axis = node.axis;
+      const auto train = node.split;
       const auto dir = my_task_.second.data[axis] < train ? kdt::Dir::kLeft
                                                           : kdt::Dir::kRight;
 
       // Will update 'k_dist' (dependency)
-      TraversalRecursive(cur->GetChild(dir));
+      TraversalRecursive(tree_->Child(cur, dir), bound);
 
       // Check if we need to traverse the other side (optional)
-      if (const auto diff = functor(my_task_.second.data[axis], train);
-          diff < result_set->WorstDist()) {
-        TraversalRecursive(cur->GetChild(FlipDir(dir)));
-      }
+      TraversalRecursive(
+          tree_->Child(cur, FlipDir(dir)),
+          bound.FarChild(axis, my_task_.second.data[axis] - train));
     }
   }
 
  public:
   // Current processing task and its result (kSet)
-  Task my_task_;
+  Task<Dim, T> my_task_;
+  ResultSet result_set;
+
+  // Where the result of the last pushed leaf node will be in its batch
+  int pending_slot_ = -1;
 
-  union {
-    float* my_assigned_result_addr;
-    KnnSet<float, 1>* result_set = nullptr;
-  };
+  SearchOptions options_;
+  T prune_scale_ = T(1);
+  int num_leaves_ = 0;
+  bool truncated_ = false;
 
   // Couroutine related
-  std::vector<CallStackField> stack_;
-  kdt::Node* cur_;
+  std::vector<CallStackField<Dim, T>> stack_;
+  std::size_t tree_idx_ = 0;
+  const Tree* tree_ = nullptr;
+  int cur_;
+  CellBound<Dim, T> bound_;
   ExecutionState state_;
 
   // Store some reference used (const)
@@ -0,0 +1,280 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <future>
+#include <limits>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "../Utils.hpp"
+#include "KDTree.hpp"
+#include "ReducerHandler.hpp"
+#include "Redwood/Point.hpp"
+
+// Dynamic index, for a reference set that keeps changing (logarithmic method).
+// The points live in a forest of static 'KdTree's, slot 'i' holding at most
+// 'base_size << i' of them. A batch of inserts is merged with the smaller
+// members into the first free slot it fits in, so a point is part of
+// O(log(n)) rebuilds. Merges run on a background thread, the members they
+// replace are searched until 'Poll()' or 'Sync()' installs the result.
+//
+// Removed points are tombstones: their copies in the leaf node table (or the
+// pivot of their branch node) are moved to infinity, so no query finds them,
+// and the next merge they are part of drops them.
+//
+// The forest owns rdc's leaf node table, one region per slot sized for the
+// slot's capacity, so installing a member only writes its own region. The
+// members' leaves are renumbered to be unique across the forest, the executors
+// search all of 'Trees()' ('query_trees').
+//
+// Not thread safe. Call the mutators between query batches, when no leaf is
+// being reduced.
+
+namespace kdt {
+
+template <int Dim, typename T>
+class Forest {
+  using PointT = Point<Dim, T>;
+  using Tree = KdTree<Dim, T>;
+
+ public:
+  explicit Forest(const KdtParams params, const int base_size = 1024,
+                  const redwood::numa::Placement placement =
+                      redwood::numa::Placement::kFirstTouch)
+      : params_(params),
+        base_size_(std::max(base_size, params.leaf_max_size)),
+        placement_(placement) {}
+
+  Forest(const Forest&) = delete;
+  Forest& operator=(const Forest&) = delete;
+
+  ~Forest() {
+    if (pending_.valid()) pending_.wait();
+  }
+
+  // Returns the ids of the new points, in order. They are searched once the
+  // merge they start is installed. Waits for the previous merge if needed.
+  std::vector<int> Insert(const PointT* points, const int n) {
+    Sync();
+    if (n <= 0) return {};
+
+    std::vector<int> ids(n);
+    for (int i = 0; i < n; ++i) {
+      ids[i] = static_cast<int>(points_.size());
+      points_.push_back(points[i]);
+      removed_.push_back(false);
+      locations_.push_back(Location{});
+    }
+
+    // Absorb members until a free slot can hold everything
+    auto merged = ids;
+    auto slot = 0;
+    for (;; ++slot) {
+      if (slot < NumSlots() && members_[slot].tree) {
+        for (const auto id : members_[slot].tree->v_acc_) {
+          if (!removed_[id]) merged.push_back(id);
+        }
+      } else if (static_cast<int>(merged.size()) <= Capacity(slot)) {
+        break;
+      }
+    }
+
+    std::vector<PointT> data(merged.size());
+    for (std::size_t i = 0; i < merged.size(); ++i) {
+      data[i] = points_[merged[i]];
+    }
+
+    pending_slot_ = slot;
+    pending_ids_ = std::move(merged);
+    pending_ = std::async(
+        std::launch::async, [params = params_, data = std::move(data)] {
+          return std::make_unique<Tree>(params, data.data(),
+                                        static_cast<int>(data.size()));
+        });
+    return ids;
+  }
+
+  // Ids that are unknown or already removed are ignored
+  void Remove(const std::vector<int>& ids) {
+    for (const auto id : ids) {
+      if (id < 0 || id >= static_cast<int>(points_.size()) || removed_[id]) {
+        continue;
+      }
+      removed_[id] = true;
+      ++num_removed_;
+      Bury(id);
+    }
+    rdc::SyncLnt<Dim, T>();
+  }
+
+  // Non-blocking. Installs the background merge if it has finished, returns
+  // whether 'Trees()' changed.
+  bool Poll() {
+    if (!pending_.valid() || pending_.wait_for(std::chrono::seconds(0)) !=
+                                 std::future_status::ready) {
+      return false;
+    }
+    Install();
+    return true;
+  }
+
+  void Sync() {
+    if (pending_.valid()) Install();
+  }
+
+  // The members, largest first, for 'query_trees'
+  _NODISCARD std::vector<const Tree*> Trees() const {
+    std::vector<const Tree*> trees;
+    for (auto it = members_.rbegin(); it != members_.rend(); ++it) {
+      if (it->tree) trees.push_back(it->tree.get());
+    }
+    return trees;
+  }
+
+  // Points inserted and not removed, searched or not yet
+  _NODISCARD int Size() const {
+    return static_cast<int>(points_.size()) - num_removed_;
+  }
+
+ private:
+  // The tree's 'v_acc_' holds forest ids, see 'Install()'
+  struct Member {
+    std::unique_ptr<Tree> tree;
+  };
+
+  // Where the copy of a point that the queries see is
+  struct Location {
+    static constexpr int kNoSlot = -1;
+
+    int slot = kNoSlot;
+    // Position in the leaf node table, or branch node of 'slot's tree
+    int index = 0;
+    bool is_pivot = false;
+  };
+
+  _NODISCARD int NumSlots() const { return static_cast<int>(members_.size()); }
+
+  _NODISCARD int Capacity(const int slot) const { return base_size_ << slot; }
+
+  // Regions of slot 'slot' in the leaf node table and its offset table. A
+  // leaf has at least one point, so 'Capacity()' leaves plus the end offset.
+  _NODISCARD int PointBase(const int slot) const {
+    return base_size_ * ((1 << slot) - 1);
+  }
+
+  _NODISCARD int UidBase(const int slot) const {
+    return PointBase(slot) + slot;
+  }
+
+  void Install() {
+    auto tree = pending_.get();
+    const auto slot = pending_slot_;
+
+    if (slot >= NumSlots()) Grow(slot + 1);
+
+    // The tree was built on 'data', point 'i' of it is 'pending_ids_[i]'. Its
+    // points are only known by their forest ids afterwards, so the executors
+    // report those ('KdTree::PointId()').
+    for (auto& id : tree->v_acc_) id = pending_ids_[id];
+    pending_ids_.clear();
+
+    // Every member below 'slot' was absorbed
+    for (int s = 0; s < slot; ++s) members_[s] = Member{};
+    members_[slot] = Member{std::move(tree)};
+
+    auto num_leaves = 0;
+    auto num_loaded = 0;
+    LoadRecursive(slot, Tree::kRoot, num_leaves, num_loaded);
+    rdc::lnt_offsets_base_addr[UidBase(slot) + num_leaves] =
+        PointBase(slot) + num_loaded;
+
+    rdc::SyncLnt<Dim, T>();
+  }
+
+  // Reallocates the leaf node table for 'num_slots' slots, the regions of the
+  // existing ones do not move.
+  void Grow(const int num_slots) {
+    const auto old_num_slots = NumSlots();
+
+    // 'AllocateLnt()' frees the current table, keep what is in use of it
+    std::vector<PointT> old_lnt;
+    std::vector<int> old_offsets;
+    if (old_num_slots > 0) {
+      old_lnt.assign(rdc::lnt_base_addr<Dim, T>,
+                     rdc::lnt_base_addr<Dim, T> + PointBase(old_num_slots));
+      old_offsets.assign(rdc::lnt_offsets_base_addr,
+                         rdc::lnt_offsets_base_addr + UidBase(old_num_slots));
+    }
+
+    const auto [lnt, offsets] = rdc::AllocateLnt<Dim, T>(
+        UidBase(num_slots) - 1, PointBase(num_slots), placement_);
+    std::copy(old_lnt.begin(), old_lnt.end(), lnt);
+    std::copy(old_offsets.begin(), old_offsets.end(), offsets);
+
+    members_.resize(num_slots);
+  }
+
+  // Copies the leaves of member 'slot' into its region in depth first order,
+  // and gives them forest-wide uids
+  void LoadRecursive(const int slot, const int node_idx, int& num_leaves,
+                     int& num_loaded) {
+    auto& member = members_[slot];
+    auto& node = member.tree->nodes_[node_idx];
+
+    if (node.IsLeaf()) {
+      node.uid = UidBase(slot) + num_leaves++;
+      rdc::lnt_offsets_base_addr[node.uid] = PointBase(slot) + num_loaded;
+
+      for (auto i = node.node_type.leaf.idx_left;
+           i <= node.node_type.leaf.idx_right; ++i) {
+        const auto id = member.tree->PointId(i);
+        const auto pos = PointBase(slot) + num_loaded++;
+        rdc::lnt_base_addr<Dim, T>[pos] = points_[id];
+        Place(id, Location{slot, pos, false});
+      }
+      return;
+    }
+
+    LoadRecursive(slot, member.tree->Child(node_idx, Dir::kLeft), num_leaves,
+                  num_loaded);
+    Place(member.tree->PivotId(node_idx), Location{slot, node_idx, true});
+    LoadRecursive(slot, member.tree->Child(node_idx, Dir::kRight), num_leaves,
+                  num_loaded);
+  }
+
+  // Removed while the merge was running
+  void Place(const int id, const Location location) {
+    locations_[id] = location;
+    if (removed_[id]) Bury(id);
+  }
+
+  void Bury(const int id) {
+    const auto& location = locations_[id];
+    if (location.slot == Location::kNoSlot) return;
+
+    auto& copy = location.is_pivot
+                     ? members_[location.slot].tree->pivots_[location.index]
+                     : rdc::lnt_base_addr<Dim, T>[location.index];
+    copy.data[0] = std::numeric_limits<T>::max();
+  }
+
+  KdtParams params_;
+  int base_size_;
+  redwood::numa::Placement placement_;
+
+  std::vector<Member> members_;
+
+  // By id
+  std::vector<PointT> points_;
+  std::vector<bool> removed_;
+  std::vector<Location> locations_;
+  int num_removed_ = 0;
+
+  std::future<std::unique_ptr<Tree>> pending_;
+  int pending_slot_ = 0;
+  std::vector<int> pending_ids_;
+};
+
+}  // namespace kdt
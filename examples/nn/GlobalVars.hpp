@@ -1,17 +1,30 @@
 #pragma once
 
 #include <iostream>
-#include <memory>
 #include <vector>
 
 #include "KDTree.hpp"
+#include "RadiusSet.hpp"
 
 // Global vars
-inline std::shared_ptr<kdt::KdTree> tree_ref;
+
+// What the executors of 'Point<Dim, T>' search, in order: the tree built (or
+// loaded) alone, or the members of a 'kdt::Forest'
+template <int Dim, typename T>
+inline std::vector<const kdt::KdTree<Dim, T>*> query_trees;
 
 // Debug
 // inline std::vector<std::vector<int>> leaf_node_visited1;
-inline std::vector<float> final_results1;
+
+// By query index, in 'double' so it holds the results of any scalar type
+inline std::vector<double> final_results1;
+
+// Id of the point each of 'final_results1' is the distance to, see 'Neighbor'
+inline std::vector<int> final_ids1;
+
+// With fixed-radius search, 'final_results1' are the number of points in range
+// and these their ids (unless count only)
+inline std::vector<NeighborList> final_lists1;
 
 inline void PrintLeafNodeVisited(const std::vector<std::vector<int>>& d,
                                  size_t n) {
@@ -27,7 +40,7 @@ inline void PrintLeafNodeVisited(const std::vector<std::vector<int>>& d,
   }
 }
 
-inline void PrintFinalResult(const std::vector<float>& d, size_t n) {
+inline void PrintFinalResult(const std::vector<double>& d, size_t n) {
   n = std::min(n, d.size());
   for (auto i = 0u; i < n; ++i)
     std::cout << "Query " << i << ": " << d[i] << '\n';
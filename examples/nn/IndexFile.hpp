@@ -0,0 +1,303 @@
+#pragma once
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "../Utils.hpp"
+#include "KDTree.hpp"
+#include "Redwood/Point.hpp"
+
+// Binary image of a built 'kdt::KdTree<Dim, T>' and its leaf node table, so a
+// static reference set is indexed once and later runs skip both the build and
+// 'LoadPayload()'. All native endian:
+//
+//   IndexHeader
+//   nodes         [num_nodes]           Node<T>
+//   pivots        [num_nodes]           Point<Dim, T>
+//   v_acc         [num_points]          int
+//   lnt           [num_leaf_points]     Point<Dim, T>
+//   lnt_offsets   [num_leaf_nodes + 1]  int
+//
+// Every section starts on a page boundary, so it can be used in place from
+// the mapping ('MappedIndex::Section()') or copied with a single memcpy.
+
+namespace kdt {
+
+constexpr std::array<char, 8> kIndexMagic = {'R', 'D', 'W', 'D',
+                                             'K', 'D', 'T', '\0'};
+
+// Bump whenever the layout of the file, 'Node' or 'IndexHeader' changes
+constexpr uint32_t kIndexVersion = 2;
+
+constexpr uint64_t kIndexAlignment = 4096;
+
+enum IndexSection {
+  kNodes = 0,
+  kPivots,
+  kAccessor,
+  kLnt,
+  kLntOffsets,
+  kNumIndexSections,
+};
+
+struct IndexHeader {
+  std::array<char, 8> magic;
+  uint32_t version;
+
+  // Written as 0x01020304, catches files from a machine of another endianness
+  uint32_t byte_order;
+  uint32_t node_size;
+  uint32_t point_size;
+
+  // Of the points, 'Point<dims, T>' with 'sizeof(T) == scalar_size'
+  uint32_t dims;
+  uint32_t scalar_size;
+
+  int32_t leaf_max_size;
+  int32_t layout;
+  int32_t num_leaf_nodes;
+  int32_t num_branch_nodes;
+  int32_t max_depth;
+  int32_t num_points;
+
+  // In bytes, from the start of the file
+  std::array<uint64_t, kNumIndexSections> offsets;
+  std::array<uint64_t, kNumIndexSections> sizes;
+};
+
+namespace detail {
+
+constexpr uint32_t kByteOrderMark = 0x01020304;
+
+inline uint64_t AlignUp(const uint64_t bytes) {
+  return (bytes + kIndexAlignment - 1) / kIndexAlignment * kIndexAlignment;
+}
+
+}  // namespace detail
+
+// 'lnt' and 'lnt_offsets' are the tables filled by 'tree.LoadPayload()'
+template <int Dim, typename T>
+void SaveIndex(const std::string& path, const KdTree<Dim, T>& tree,
+               const Point<Dim, T>* lnt, const int* lnt_offsets) {
+  const auto params = tree.GetParams();
+  const auto stats = tree.GetStats();
+
+  const std::array<const void*, kNumIndexSections> data{
+      tree.nodes_.data(), tree.pivots_.data(), tree.v_acc_.data(), lnt,
+      lnt_offsets};
+
+  IndexHeader header{};
+  header.magic = kIndexMagic;
+  header.version = kIndexVersion;
+  header.byte_order = detail::kByteOrderMark;
+  header.node_size = sizeof(Node<T>);
+  header.point_size = sizeof(Point<Dim, T>);
+  header.dims = Dim;
+  header.scalar_size = sizeof(T);
+  header.leaf_max_size = params.leaf_max_size;
+  header.layout = static_cast<int32_t>(params.layout);
+  header.num_leaf_nodes = stats.num_leaf_nodes;
+  header.num_branch_nodes = stats.num_branch_nodes;
+  header.max_depth = stats.max_depth;
+  header.num_points = static_cast<int32_t>(tree.v_acc_.size());
+  header.sizes = {tree.nodes_.size() * sizeof(Node<T>),
+                  tree.pivots_.size() * sizeof(Point<Dim, T>),
+                  tree.v_acc_.size() * sizeof(int),
+                  tree.NumLeafPoints() * sizeof(Point<Dim, T>),
+                  (stats.num_leaf_nodes + 1) * sizeof(int)};
+
+  auto end = detail::AlignUp(sizeof(IndexHeader));
+  for (int s = 0; s < kNumIndexSections; ++s) {
+    header.offsets[s] = end;
+    end = detail::AlignUp(end + header.sizes[s]);
+  }
+
+  std::ofstream out(path, std::ios::binary | std::ios::trunc);
+  if (!out.is_open()) {
+    throw std::runtime_error("Failed to open file: " + path);
+  }
+
+  // The gaps between the sections read as zeros
+  out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  for (int s = 0; s < kNumIndexSections; ++s) {
+    out.seekp(static_cast<std::streamoff>(header.offsets[s]));
+    out.write(static_cast<const char*>(data[s]),
+              static_cast<std::streamsize>(header.sizes[s]));
+  }
+
+  if (!out) {
+    throw std::runtime_error("Failed to write index: " + path);
+  }
+}
+
+// Read-only mapping of an index file, validated when opened. The point type
+// is checked by the typed accessors.
+class MappedIndex {
+ public:
+  explicit MappedIndex(const std::string& path) : path_(path) {
+    const auto fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+      throw std::runtime_error("Failed to open file: " + path);
+    }
+
+    struct stat st {};
+    if (fstat(fd, &st) != 0 ||
+        static_cast<std::size_t>(st.st_size) < sizeof(IndexHeader)) {
+      close(fd);
+      throw std::runtime_error("Error: '" + path + "' is not an index file.");
+    }
+    size_ = static_cast<std::size_t>(st.st_size);
+
+    // Everything is read once anyway, fault it all in up front
+    const auto addr =
+        mmap(nullptr, size_, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+    close(fd);
+    if (addr == MAP_FAILED) {
+      throw std::runtime_error("Failed to map file: " + path);
+    }
+    base_ = static_cast<const char*>(addr);
+
+    try {
+      Validate();
+    } catch (...) {
+      munmap(const_cast<char*>(base_), size_);
+      throw;
+    }
+  }
+
+  MappedIndex(const MappedIndex&) = delete;
+  MappedIndex& operator=(const MappedIndex&) = delete;
+
+  ~MappedIndex() { munmap(const_cast<char*>(base_), size_); }
+
+  _NODISCARD const IndexHeader& Header() const {
+    return *reinterpret_cast<const IndexHeader*>(base_);
+  }
+
+  template <typename T>
+  _NODISCARD const T* Section(const IndexSection section) const {
+    return reinterpret_cast<const T*>(base_ + Header().offsets[section]);
+  }
+
+  template <typename T>
+  _NODISCARD int Count(const IndexSection section) const {
+    return static_cast<int>(Header().sizes[section] / sizeof(T));
+  }
+
+  _NODISCARD int NumLeafPoints() const {
+    return static_cast<int>(Header().sizes[kLnt] / Header().point_size);
+  }
+
+  // Throws unless the file holds 'Point<Dim, T>'s
+  template <int Dim, typename T>
+  void CheckPointType() const {
+    const auto& header = Header();
+    if (header.dims != Dim || header.scalar_size != sizeof(T) ||
+        header.point_size != sizeof(Point<Dim, T>) ||
+        header.node_size != sizeof(Node<T>)) {
+      throw std::runtime_error(
+          "Error: '" + path_ + "' holds " + std::to_string(header.dims) +
+          "D points of " + std::to_string(header.scalar_size) +
+          "-byte scalars, expected " + std::to_string(Dim) + "D points of " +
+          std::to_string(sizeof(T)) + "-byte scalars.");
+    }
+  }
+
+  // Into the tables returned by 'rdc::AllocateLnt()'
+  template <int Dim, typename T>
+  void CopyLnt(Point<Dim, T>* lnt, int* lnt_offsets) const {
+    CheckPointType<Dim, T>();
+    std::memcpy(lnt, Section<Point<Dim, T>>(kLnt), Header().sizes[kLnt]);
+    std::memcpy(lnt_offsets, Section<int>(kLntOffsets),
+                Header().sizes[kLntOffsets]);
+  }
+
+ private:
+  void Validate() const {
+    const auto& header = Header();
+    if (header.magic != kIndexMagic) {
+      throw std::runtime_error("Error: '" + path_ + "' is not an index file.");
+    }
+    if (header.version != kIndexVersion) {
+      throw std::runtime_error("Error: '" + path_ + "' is index version " +
+                               std::to_string(header.version) + ", expected " +
+                               std::to_string(kIndexVersion) + ".");
+    }
+    if (header.byte_order != detail::kByteOrderMark) {
+      throw std::runtime_error("Error: '" + path_ +
+                               "' was written on an incompatible machine.");
+    }
+
+    for (int s = 0; s < kNumIndexSections; ++s) {
+      if (header.offsets[s] % kIndexAlignment != 0 ||
+          header.offsets[s] + header.sizes[s] > size_) {
+        throw std::runtime_error("Error: '" + path_ + "' is truncated.");
+      }
+    }
+
+    // With 'kEytzinger' there are more nodes than leaves and branches
+    if (header.node_size == 0 || header.point_size == 0 ||
+        header.sizes[kNodes] / header.node_size !=
+            header.sizes[kPivots] / header.point_size ||
+        Count<int>(kAccessor) != header.num_points ||
+        Count<int>(kLntOffsets) != header.num_leaf_nodes + 1) {
+      throw std::runtime_error("Error: '" + path_ + "' is inconsistent.");
+    }
+
+    // The leaf node table holds all the points but the pivots, and the leaves
+    // are ranges of it in order, so no leaf is read past its end
+    const auto num_leaf_points =
+        int64_t{header.num_points} - header.num_branch_nodes;
+    const auto lnt_offsets = Section<int>(kLntOffsets);
+    const auto lnt_offsets_end = lnt_offsets + header.num_leaf_nodes + 1;
+    if (num_leaf_points < 0 ||
+        header.sizes[kLnt] !=
+            static_cast<uint64_t>(num_leaf_points) * header.point_size ||
+        lnt_offsets[0] != 0 ||
+        !std::is_sorted(lnt_offsets, lnt_offsets_end) ||
+        lnt_offsets_end[-1] != num_leaf_points) {
+      throw std::runtime_error("Error: '" + path_ +
+                               "' has a corrupt leaf node table.");
+    }
+  }
+
+  std::string path_;
+  const char* base_;
+  std::size_t size_;
+};
+
+// The tree of an index file of 'Point<Dim, T>'s. It does not reference the
+// mapping, which can be closed afterwards.
+template <int Dim, typename T>
+_NODISCARD KdTree<Dim, T> LoadTree(const MappedIndex& index) {
+  index.CheckPointType<Dim, T>();
+  const auto& header = index.Header();
+
+  KdtStatistic stats;
+  stats.num_leaf_nodes = header.num_leaf_nodes;
+  stats.num_branch_nodes = header.num_branch_nodes;
+  stats.max_depth = header.max_depth;
+
+  using PointT = Point<Dim, T>;
+  const auto nodes = index.Section<Node<T>>(kNodes);
+  const auto pivots = index.Section<PointT>(kPivots);
+  const auto v_acc = index.Section<int>(kAccessor);
+  return KdTree<Dim, T>(
+      KdtParams{header.leaf_max_size, 1, static_cast<Layout>(header.layout)},
+      stats, std::vector<Node<T>>(nodes, nodes + index.Count<Node<T>>(kNodes)),
+      std::vector<PointT>(pivots, pivots + index.Count<PointT>(kPivots)),
+      std::vector<int>(v_acc, v_acc + index.Count<int>(kAccessor)));
+}
+
+}  // namespace kdt
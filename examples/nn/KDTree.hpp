@@ -1,12 +1,23 @@
 #pragma once
 
+#ifdef _OPENMP
+#include <omp.h>
+
+#include <parallel/algorithm>
+#endif
+
 #include <algorithm>
 #include <cassert>
-#include <limits>
 #include <numeric>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
 
 #include "../Utils.hpp"
+#include "Redwood/Numa.hpp"
 #include "Redwood/Point.hpp"
+#include "SplitPolicies.hpp"
 
 namespace kdt {
 enum class Dir { kLeft = 0, kRight };
@@ -15,13 +26,17 @@ inline Dir FlipDir(const Dir dir) {
   return dir == Dir::kLeft ? Dir::kRight : Dir::kLeft;
 }
 
+// 16 bytes with 'float' coordinates. The nodes are stored contiguously, in
+// depth first order, in 'KdTree::nodes_', and the children are indices in it.
+template <typename T>
 struct Node {
-  _NODISCARD bool IsLeaf() const {
-    return left_child == nullptr && right_child == nullptr;
-  }
+  static constexpr int kLeafAxis = -1;
+
+  _NODISCARD bool IsLeaf() const { return axis == kLeafAxis; }
 
-  _NODISCARD Node* GetChild(const Dir dir) const {
-    return dir == Dir::kLeft ? left_child : right_child;
+  _NODISCARD int GetChild(const Dir dir) const {
+    return dir == Dir::kLeft ? node_type.tree.left_child
+                             : node_type.tree.right_child;
   }
 
   union {
@@ -33,25 +48,58 @@ struct Node {
     } leaf;
 
     struct {
-      // Dimension used for subdivision. (e.g. 0, 1, 2)
-      int axis;
-      int idx_mid;
+      int left_child;
+      int right_child;
     } tree;
   } node_type;
 
-  Node* left_child;
-  Node* right_child;
-  int uid;  // In this version this is used only for leaf nodes.
+  union {
+    T split;  // Branch: coordinate of the median on 'axis'
+    int uid;  // Leaf: index in the leaf node table
+  };
+
+  // Dimension used for subdivision. (e.g. 0, 1, 2), 'kLeafAxis' for leaves
+  int axis;
 };
 
+static_assert(sizeof(Node<float>) == 16);
+
+// Order of the nodes in 'KdTree::nodes_'
+enum class Layout {
+  // Pre-order, a left child comes right after its parent
+  kDepthFirst,
+  // Breadth first, children of 'i' at '2i + 1' and '2i + 2', computed instead
+  // of loaded. Leaves one level above the deepest ones leave holes.
+  kEytzinger,
+  // Recursively split into a top half tree and its bottom subtrees, each one
+  // contiguous, so a root to leaf path touches O(log_B(n)) cache lines.
+  kVanEmdeBoas,
+};
+
+// 'name' is one of dfs, eytzinger, veb
+inline Layout ParseLayout(const std::string& name) {
+  if (name == "dfs") return Layout::kDepthFirst;
+  if (name == "eytzinger") return Layout::kEytzinger;
+  if (name == "veb") return Layout::kVanEmdeBoas;
+  throw std::runtime_error("Error: unknown tree layout '" + name + "'.");
+}
+
 struct KdtParams {
-  explicit KdtParams(const int leaf_size = 32) : leaf_max_size(leaf_size) {
-    if (leaf_size == 0) {
-      throw std::runtime_error("Error: 'leaf_size' must be above zero. ");
+  explicit KdtParams(const int leaf_size = 32, const int threads = 1,
+                     const Layout node_layout = Layout::kDepthFirst)
+      : leaf_max_size(leaf_size), num_threads(threads), layout(node_layout) {
+    // A branch node needs at least 3 points, the pivot and one on each side
+    if (leaf_size < 2) {
+      throw std::runtime_error("Error: 'leaf_size' must be at least 2. ");
     }
   }
 
   int leaf_max_size;
+
+  // Used to build the tree, the resulting tree does not depend on it
+  int num_threads;
+
+  Layout layout;
 };
 
 struct KdtStatistic {
@@ -66,23 +114,92 @@ struct KdtStatistic {
   int total_elements_reduced = 0;
 };
 
+// Over points of any dimension and scalar type, e.g., 'KdTree<3, float>' for
+// 'Point3F'. Splits and pivots are in 'T'.
+template <int Dim, typename T>
 class KdTree {
-  using T = Point4F;
-
  public:
+  using PointT = Point<Dim, T>;
+
+  static constexpr int kRoot = 0;
+  static constexpr int kNull = -1;
+
   KdTree() = delete;
 
-  explicit KdTree(const KdtParams params, const T* in_data, const int n)
-      : root_(), in_data_ref_(in_data), params_(params) {
-    BuildTree(n);
+  // 'SplitPolicy' is one of 'SplitPolicies.hpp'
+  template <typename SplitPolicy = MedianSplit>
+  explicit KdTree(const KdtParams params, const PointT* in_data, const int n,
+                  SplitPolicy = {})
+      : in_data_ref_(in_data), params_(params) {
+    BuildTree<SplitPolicy>(n);
+  }
+
+  // Adopts a tree built earlier, e.g., by 'LoadTree()' (IndexFile.hpp). There
+  // is no input data, only 'LoadPayload()' needs it.
+  KdTree(const KdtParams params, const KdtStatistic statistic,
+         std::vector<Node<T>> nodes, std::vector<PointT> pivots,
+         std::vector<int> v_acc)
+      : nodes_(std::move(nodes)),
+        pivots_(std::move(pivots)),
+        v_acc_(std::move(v_acc)),
+        in_data_ref_(nullptr),
+        params_(params),
+        statistic_(statistic) {
+    IndexPivots();
   }
 
+  // The top levels are built one node at a time, each partitioned by all the
+  // threads. Below 'task_depth', the subtrees are independent and are built in
+  // parallel, one per task, into their own arrays, then appended to 'nodes_'.
+  // Leaf uids and statistics are assigned afterwards, in depth first order,
+  // and the nodes are moved to 'params_.layout' order.
+  template <typename SplitPolicy>
   void BuildTree(const int size) {
     v_acc_.resize(size);
     std::iota(v_acc_.begin(), v_acc_.end(), 0u);
 
-    root_ = BuildRecursive(0u, static_cast<int>(size) - 1, 0);
+    nodes_.clear();
+    pivots_.clear();
+    statistic_ = KdtStatistic{};
+    next_leaf_uid_ = 0;
+
+    const auto num_threads = std::max(1, params_.num_threads);
+
+#ifdef _OPENMP
+    // '__gnu_parallel' algorithms use as many threads as OpenMP allows
+    const auto saved_max_threads = omp_get_max_threads();
+    omp_set_num_threads(num_threads);
+#endif
+
+    // About 4 subtrees per thread, to balance the load
+    auto task_depth = 0;
+    while (num_threads > 1 && (1 << task_depth) < 4 * num_threads) {
+      ++task_depth;
+    }
+
+    std::vector<Subtree> tasks;
+    BuildTop<SplitPolicy>(kNull, Dir::kLeft, 0, size - 1, 0, task_depth,
+                          tasks);
+
+#pragma omp parallel for schedule(dynamic, 1) num_threads(num_threads)
+    for (int i = 0; i < static_cast<int>(tasks.size()); ++i) {
+      BuildRecursive<SplitPolicy>(tasks[i], tasks[i].left_idx,
+                                  tasks[i].right_idx, tasks[i].depth);
+    }
+
+#ifdef _OPENMP
+    omp_set_num_threads(saved_max_threads);
+#endif
+
+    for (auto& task : tasks) AppendSubtree(task);
 
+    FinalizeRecursive(kRoot, 0);
+    ApplyLayout();
+    IndexPivots();
+  }
+
+  // Not printed by the constructors, a forest builds many trees
+  void PrintStatistic() const {
     if constexpr (constexpr auto print = true) {
       std::cout << "Tree Statistic: \n"
                 << "\tNum leaf nodes: \t" << statistic_.num_leaf_nodes << '\n'
@@ -94,96 +211,386 @@ class KdTree {
     }
   }
 
-  void LoadPayload(T* usm_leaf_node_table) {
+  // Packs the leaves back to back in depth first (uid) order, leaf 'uid' is
+  // [leaf_offsets[uid], leaf_offsets[uid + 1]) of 'usm_leaf_node_table'. The
+  // tables hold 'NumLeafPoints()' and 'num_leaf_nodes + 1' items.
+  //
+  // The leaves are copied by 'params_.num_threads' threads, a contiguous block
+  // of uids each, thread 'i' pinned like traversal thread 'i'. With first-touch
+  // placement, each block's pages are on the node of the thread that reads
+  // them. Call after 'redwood::Init()', the threads stay pinned.
+  void LoadPayload(PointT* usm_leaf_node_table, int* leaf_offsets) const {
+    assert(in_data_ref_ != nullptr);
     assert(usm_leaf_node_table != nullptr);
-    LoadPayloadRecursive(root_, usm_leaf_node_table);
+    assert(leaf_offsets != nullptr);
+
+    const auto num_leaves = statistic_.num_leaf_nodes;
+
+    // Node of each uid, and where its points start
+    std::vector<int> leaves(num_leaves);
+    for (int i = 0; i < static_cast<int>(nodes_.size()); ++i) {
+      if (nodes_[i].IsLeaf() && nodes_[i].uid >= 0) leaves[nodes_[i].uid] = i;
+    }
+    std::vector<int> offsets(num_leaves + 1);
+    for (int uid = 0; uid < num_leaves; ++uid) {
+      const auto& leaf = nodes_[leaves[uid]].node_type.leaf;
+      offsets[uid + 1] = offsets[uid] + leaf.idx_right - leaf.idx_left + 1;
+    }
+
+#pragma omp parallel num_threads(std::max(1, params_.num_threads))
+    {
+#ifdef _OPENMP
+      const redwood::numa::ScopedPin pin(omp_get_thread_num());
+#endif
+
+#pragma omp for schedule(static)
+      for (int uid = 0; uid < num_leaves; ++uid) {
+        const auto& leaf = nodes_[leaves[uid]].node_type.leaf;
+        leaf_offsets[uid] = offsets[uid];
+
+        auto out = usm_leaf_node_table + offsets[uid];
+        for (auto i = leaf.idx_left; i <= leaf.idx_right; ++i) {
+          *out++ = in_data_ref_[v_acc_[i]];
+        }
+      }
+    }
+    leaf_offsets[num_leaves] = offsets[num_leaves];
   }
 
+  // All the points but the pivots of the branch nodes
+  _NODISCARD int NumLeafPoints() const {
+    return static_cast<int>(v_acc_.size()) - statistic_.num_branch_nodes;
+  }
+
+  // Size of the node array, holes of the layout included, so per-node data
+  // can be indexed like 'GetNode()'
+  _NODISCARD int NumNodes() const { return static_cast<int>(nodes_.size()); }
+
   _NODISCARD KdtStatistic GetStats() const { return statistic_; }
   _NODISCARD KdtParams GetParams() const { return params_; }
-  _NODISCARD const Node* GetRoot() const { return root_; }
+  _NODISCARD const Node<T>& GetNode(const int node_idx) const {
+    return nodes_[node_idx];
+  }
+  _NODISCARD const PointT& GetPivot(const int node_idx) const {
+    return pivots_[node_idx];
+  }
 
-  Node* BuildRecursive(const int left_idx, const int right_idx,
-                       const int depth) {
-    const auto node = new Node;
+  // Index in the input of the point at 'v_acc_' position 'acc_idx', e.g.,
+  // 'idx_left + j' for the j-th point of a leaf in the leaf node table
+  _NODISCARD int PointId(const int acc_idx) const { return v_acc_[acc_idx]; }
 
-    if (right_idx - left_idx <= params_.leaf_max_size)  // minimum is 1
-    {
+  // Index in the input of the pivot of branch node 'node_idx'
+  _NODISCARD int PivotId(const int node_idx) const {
+    return v_acc_[pivot_acc_[node_idx]];
+  }
+
+  // Use this rather than 'Node::GetChild()', works with every layout
+  _NODISCARD int Child(const int node_idx, const Dir dir) const {
+    if (params_.layout == Layout::kEytzinger) {
+      return 2 * node_idx + 1 + static_cast<int>(dir);
+    }
+    return nodes_[node_idx].GetChild(dir);
+  }
+
+  // At most 'leaf_max_size' points
+  _NODISCARD bool IsLeafRange(const int left_idx, const int right_idx) const {
+    return right_idx - left_idx < params_.leaf_max_size;
+  }
+
+  // Put the 'mid_idx'-th smallest of [left_idx, right_idx] (on 'axis') at
+  // 'mid_idx', smaller ones before it. Ties are broken by index, so which
+  // points go to each side does not depend on the algorithm doing it.
+  void Partition(const int left_idx, const int mid_idx, const int right_idx,
+                 const int axis, const bool parallel) {
+    const auto less = [&](const int lhs, const int rhs) {
+      const auto lhs_val = in_data_ref_[lhs].data[axis];
+      const auto rhs_val = in_data_ref_[rhs].data[axis];
+      return lhs_val < rhs_val || (lhs_val == rhs_val && lhs < rhs);
+    };
+
+    const auto begin = v_acc_.begin() + left_idx;
+    const auto nth = v_acc_.begin() + mid_idx;
+    const auto end = v_acc_.begin() + right_idx + 1;
+#ifdef _OPENMP
+    if (parallel) {
+      __gnu_parallel::nth_element(begin, nth, end, less);
+      return;
+    }
+#endif
+    std::nth_element(begin, nth, end, less);
+  }
+
+  _NODISCARD Node<T> MakeLeaf(const int left_idx, const int right_idx) {
+    // Same order whatever partitioned the points
+    std::sort(v_acc_.begin() + left_idx, v_acc_.begin() + right_idx + 1);
+
+    Node<T> node{};
+    node.node_type.leaf.idx_left = left_idx;
+    node.node_type.leaf.idx_right = right_idx;
+    node.uid = -1;
+    node.axis = Node<T>::kLeafAxis;
+    return node;
+  }
+
+  // Splits where 'SplitPolicy' says. The point at 'mid_idx' becomes the node's
+  // pivot, then everything on the left will be in left child, everything on
+  // the right in the right child. The children are left to the caller.
+  template <typename SplitPolicy>
+  _NODISCARD Node<T> MakeBranch(const int left_idx, const int right_idx,
+                                const int depth, const bool parallel,
+                                int& mid_idx) {
+    const auto split =
+        SplitPolicy::Choose(in_data_ref_, v_acc_.data() + left_idx,
+                            right_idx - left_idx + 1, depth);
+    mid_idx = left_idx + split.mid;
+    Partition(left_idx, mid_idx, right_idx, split.axis, parallel);
+
+    Node<T> node{};
+    node.split = in_data_ref_[v_acc_[mid_idx]].data[split.axis];
+    node.axis = split.axis;
+    return node;
+  }
+
+  // A subtree left to build, and where to link it. Its nodes and pivots are
+  // indexed from 0 (its root) until 'AppendSubtree()'.
+  struct Subtree {
+    int parent;
+    Dir dir;
+    int left_idx;
+    int right_idx;
+    int depth;
+    std::vector<Node<T>> nodes;
+    std::vector<PointT> pivots;
+  };
+
+  void LinkChild(const int parent, const Dir dir, const int child) {
+    if (parent == kNull) return;
+    auto& children = nodes_[parent].node_type.tree;
+    (dir == Dir::kLeft ? children.left_child : children.right_child) = child;
+  }
+
+  template <typename SplitPolicy>
+  void BuildTop(const int parent, const Dir dir, const int left_idx,
+                const int right_idx, const int depth, const int task_depth,
+                std::vector<Subtree>& tasks) {
+    if (depth == task_depth || IsLeafRange(left_idx, right_idx)) {
+      tasks.push_back({parent, dir, left_idx, right_idx, depth, {}, {}});
+      return;
+    }
+
+    int mid_idx;
+    const auto node_idx = static_cast<int>(nodes_.size());
+    nodes_.push_back(
+        MakeBranch<SplitPolicy>(left_idx, right_idx, depth, true, mid_idx));
+    pivots_.push_back(in_data_ref_[v_acc_[mid_idx]]);
+    LinkChild(parent, dir, node_idx);
+
+    BuildTop<SplitPolicy>(node_idx, Dir::kLeft, left_idx, mid_idx - 1,
+                          depth + 1, task_depth, tasks);
+    BuildTop<SplitPolicy>(node_idx, Dir::kRight, mid_idx + 1, right_idx,
+                          depth + 1, task_depth, tasks);
+  }
+
+  // Returns the index of the subtree's root in 'task.nodes'
+  template <typename SplitPolicy>
+  int BuildRecursive(Subtree& task, const int left_idx, const int right_idx,
+                     const int depth) {
+    const auto node_idx = static_cast<int>(task.nodes.size());
+
+    if (IsLeafRange(left_idx, right_idx)) {
+      task.nodes.push_back(MakeLeaf(left_idx, right_idx));
+      task.pivots.emplace_back();
+      return node_idx;
+    }
+
+    int mid_idx;
+    task.nodes.push_back(
+        MakeBranch<SplitPolicy>(left_idx, right_idx, depth, false, mid_idx));
+    task.pivots.push_back(in_data_ref_[v_acc_[mid_idx]]);
+
+    const auto left =
+        BuildRecursive<SplitPolicy>(task, left_idx, mid_idx - 1, depth + 1);
+    const auto right =
+        BuildRecursive<SplitPolicy>(task, mid_idx + 1, right_idx, depth + 1);
+    task.nodes[node_idx].node_type.tree.left_child = left;
+    task.nodes[node_idx].node_type.tree.right_child = right;
+    return node_idx;
+  }
+
+  void AppendSubtree(Subtree& task) {
+    const auto offset = static_cast<int>(nodes_.size());
+    for (auto node : task.nodes) {
+      if (!node.IsLeaf()) {
+        node.node_type.tree.left_child += offset;
+        node.node_type.tree.right_child += offset;
+      }
+      nodes_.push_back(node);
+    }
+    pivots_.insert(pivots_.end(), task.pivots.begin(), task.pivots.end());
+    LinkChild(task.parent, task.dir, offset);
+
+    std::vector<Node<T>>().swap(task.nodes);
+    std::vector<PointT>().swap(task.pivots);
+  }
+
+  // Leaf uids and statistics, sequentially
+  void FinalizeRecursive(const int node_idx, const int depth) {
+    auto& node = nodes_[node_idx];
+    if (node.IsLeaf()) {
       ++statistic_.num_leaf_nodes;
       statistic_.max_depth = std::max(depth, statistic_.max_depth);
-
-      // Build as leaf node
-      node->node_type.leaf.idx_left = left_idx;
-      node->node_type.leaf.idx_right = right_idx;
-      node->left_child = nullptr;
-      node->right_child = nullptr;
-      node->uid = GetNextId();
+      node.uid = GetNextId();
     } else {
       ++statistic_.num_branch_nodes;
+      FinalizeRecursive(node.node_type.tree.left_child, depth + 1);
+      FinalizeRecursive(node.node_type.tree.right_child, depth + 1);
+    }
+  }
 
-      // Build as tree node
-      const auto axis = depth % 4;
-      const auto mid_idx = (left_idx + right_idx) / 2;
+  // Nodes of the subtree of 'node_idx' that are 'depth' levels below it, from
+  // left to right (depth first order)
+  void CollectAtDepth(const int node_idx, const int depth,
+                      std::vector<int>& out) const {
+    if (depth == 0) {
+      out.push_back(node_idx);
+    } else if (!nodes_[node_idx].IsLeaf()) {
+      CollectAtDepth(nodes_[node_idx].GetChild(Dir::kLeft), depth - 1, out);
+      CollectAtDepth(nodes_[node_idx].GetChild(Dir::kRight), depth - 1, out);
+    }
+  }
 
-      // I am splitting at the median
-      std::nth_element(
-          v_acc_.begin() + left_idx, v_acc_.begin() + mid_idx,
-          v_acc_.begin() + right_idx + 1, [&](const auto lhs, const auto rhs) {
-            return in_data_ref_[lhs].data[axis] < in_data_ref_[rhs].data[axis];
-          });
+  // Appends the first 'height' levels of the subtree of 'node_idx'
+  void VanEmdeBoasOrder(const int node_idx, const int height,
+                        std::vector<int>& order) const {
+    if (height == 1) {
+      order.push_back(node_idx);
+      return;
+    }
 
-      // Mid point as the node, then everything on the left will
-      // be in left child, everything on the right in the right
-      // child.
-      node->node_type.tree.axis = axis;
-      node->node_type.tree.idx_mid = mid_idx;
-      node->left_child = BuildRecursive(left_idx, mid_idx - 1, depth + 1);
-      node->right_child = BuildRecursive(mid_idx + 1, right_idx, depth + 1);
-      node->uid = -1;
+    const auto top_height = height / 2;
+    VanEmdeBoasOrder(node_idx, top_height, order);
+
+    std::vector<int> bottom_roots;
+    CollectAtDepth(node_idx, top_height, bottom_roots);
+    for (const auto root : bottom_roots) {
+      VanEmdeBoasOrder(root, height - top_height, order);
     }
+  }
 
-    return node;
+  void EytzingerOrder(const int node_idx, const int position,
+                      std::vector<int>& new_idx) const {
+    new_idx[node_idx] = position;
+    if (!nodes_[node_idx].IsLeaf()) {
+      EytzingerOrder(nodes_[node_idx].GetChild(Dir::kLeft), 2 * position + 1,
+                     new_idx);
+      EytzingerOrder(nodes_[node_idx].GetChild(Dir::kRight), 2 * position + 2,
+                     new_idx);
+    }
   }
 
-  void LoadPayloadRecursive(const Node* cur, T* usm_leaf_node_table) {
-    if (cur->IsLeaf()) {
-      auto counter = 0;
-      const auto offset = cur->uid * params_.leaf_max_size;
+  void DepthFirstOrder(const int node_idx, std::vector<int>& order) const {
+    order.push_back(node_idx);
+    if (!nodes_[node_idx].IsLeaf()) {
+      DepthFirstOrder(nodes_[node_idx].GetChild(Dir::kLeft), order);
+      DepthFirstOrder(nodes_[node_idx].GetChild(Dir::kRight), order);
+    }
+  }
 
-      for (auto i = cur->node_type.leaf.idx_left;
-           i <= cur->node_type.leaf.idx_right; ++i) {
-        const auto idx = v_acc_[i];
-        usm_leaf_node_table[offset + counter] = in_data_ref_[idx];
-        ++counter;
-      }
+  // Moves the nodes to 'params_.layout' order. The leaf uids, hence the leaf
+  // node table, are unchanged.
+  void ApplyLayout() {
+    const auto num_nodes = static_cast<int>(nodes_.size());
+    std::vector<int> new_idx(num_nodes);
+    auto new_size = num_nodes;
+
+    // Eytzinger is only worth it for (nearly) balanced trees, e.g., median
+    // splits, otherwise the array is mostly holes
+    if (params_.layout == Layout::kEytzinger &&
+        (statistic_.max_depth >= 30 ||
+         (2 << statistic_.max_depth) - 1 > 4 * num_nodes)) {
+      std::cerr << "[warning] Tree too unbalanced for the Eytzinger layout, "
+                   "using depth first instead."
+                << std::endl;
+      params_.layout = Layout::kDepthFirst;
+    }
 
-      // Making sure remaining are filled.
-      while (counter < params_.leaf_max_size) {
-        usm_leaf_node_table[offset + counter].data[0] =
-            std::numeric_limits<float>::max();
-        ++counter;
-      }
+    if (params_.layout == Layout::kEytzinger) {
+      new_size = (2 << statistic_.max_depth) - 1;
+      EytzingerOrder(kRoot, 0, new_idx);
+    } else if (params_.layout == Layout::kVanEmdeBoas) {
+      std::vector<int> order;
+      order.reserve(num_nodes);
+      VanEmdeBoasOrder(kRoot, statistic_.max_depth + 1, order);
+      for (int i = 0; i < num_nodes; ++i) new_idx[order[i]] = i;
     } else {
-      LoadPayloadRecursive(cur->left_child, usm_leaf_node_table);
-      LoadPayloadRecursive(cur->right_child, usm_leaf_node_table);
+      std::vector<int> order;
+      order.reserve(num_nodes);
+      DepthFirstOrder(kRoot, order);
+      for (int i = 0; i < num_nodes; ++i) new_idx[order[i]] = i;
+    }
+
+    // Holes are never reached, but look like (empty) leaves
+    Node<T> hole{};
+    hole.axis = Node<T>::kLeafAxis;
+    hole.uid = -1;
+
+    std::vector<Node<T>> nodes(new_size, hole);
+    std::vector<PointT> pivots(new_size);
+    for (int i = 0; i < num_nodes; ++i) {
+      auto node = nodes_[i];
+      if (!node.IsLeaf()) {
+        auto& children = node.node_type.tree;
+        children.left_child = new_idx[children.left_child];
+        children.right_child = new_idx[children.right_child];
+      }
+      nodes[new_idx[i]] = node;
+      pivots[new_idx[i]] = pivots_[i];
     }
+
+    nodes_.swap(nodes);
+    pivots_.swap(pivots);
+  }
+
+  // Nodes only store their pivot, not where it is in 'v_acc_'. It is right
+  // after the left subtree, so it is found from the leaves' ranges, also for a
+  // tree built earlier. Returns the last position of the subtree.
+  void IndexPivots() {
+    pivot_acc_.assign(nodes_.size(), 0);
+    if (!nodes_.empty()) IndexPivotsRecursive(kRoot);
   }
 
-  static int GetNextId() {
-    static int uid_counter = 0;
-    return uid_counter++;
+  int IndexPivotsRecursive(const int node_idx) {
+    const auto& node = nodes_[node_idx];
+    if (node.IsLeaf()) return node.node_type.leaf.idx_right;
+
+    const auto last_left = IndexPivotsRecursive(Child(node_idx, Dir::kLeft));
+    pivot_acc_[node_idx] = last_left + 1;
+    return IndexPivotsRecursive(Child(node_idx, Dir::kRight));
   }
 
+  // Leaf uids are per tree, [0, num_leaf_nodes) in depth first order, so they
+  // index the tree's own leaf node table
+  int GetNextId() { return next_leaf_uid_++; }
+
+  // All the nodes, 'kRoot' first, in 'params_.layout' order
+  std::vector<Node<T>> nodes_;
+
+  // Median point of each branch node, by node index (unused for leaves)
+  std::vector<PointT> pivots_;
+
   // Accessor
-  Node* root_;
   std::vector<int> v_acc_;
 
+  // 'v_acc_' position of the pivot of each branch node, see 'PivotId()'
+  std::vector<int> pivot_acc_;
+
   // Datasets (ref to Input Data, and the Node Contents)
   // Note: dangerous, do not use after LoadPayload
-  const T* in_data_ref_;
+  const PointT* in_data_ref_;
 
   // Statistics informations for/of the tree construction
   KdtParams params_;
   KdtStatistic statistic_;
+  int next_leaf_uid_ = 0;
 };
 }  // namespace kdt
@@ -1,50 +1,93 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
 #include <iostream>
 #include <limits>
 
 #include "../Utils.hpp"
 
+// A neighbor of a query. 'id' is the index of the point in the input of the
+// tree it was found in ('KdTree::PointId()'), or in the whole forest for the
+// members of a 'kdt::Forest'. -1 until something is found.
+template <typename T>
+struct Neighbor {
+  T dist;
+  int id;
+};
+
+template <typename T>
+_NODISCARD bool operator<(const Neighbor<T>& a, const Neighbor<T>& b) {
+  return a.dist < b.dist;
+}
+
+// The 'K' nearest neighbors seen so far, as a bounded max-heap on the distance:
+// the worst one is at the root, so a closer neighbor replaces it and sifts
+// down. O(log(K)) per insert, and nothing moves for the (most) ones that do
+// not make it.
 template <typename T, int K>
-struct KnnSet {
-  // Insert a distance into the current result set, and matain the set is still
-  // sorted. Shift everything after the inserted value to the back by one.
-  void Insert(const T value) {
-    auto low = std::lower_bound(rank, rank + K, value);
-    if (low != std::end(rank)) {
-      // Shif the rest to the right
-      for (int i = K - 2; i >= low - std::begin(rank); --i) {
-        rank[i + 1] = rank[i];
-      }
-      *low = value;
+class KnnSet {
+ public:
+  void Insert(const T dist, const int id) {
+    if (!(dist < heap_[0].dist)) return;
+
+    // Sift the hole at the root down to where the new neighbor fits
+    auto i = 0;
+    for (auto child = 1; child < K; child = 2 * i + 1) {
+      if (child + 1 < K && heap_[child].dist < heap_[child + 1].dist) ++child;
+      if (!(dist < heap_[child].dist)) break;
+      heap_[i] = heap_[child];
+      i = child;
     }
+    heap_[i] = {dist, id};
   }
 
-  void Reset() { std::fill_n(rank, K, std::numeric_limits<T>::max()); }
+  void Reset() { heap_.fill({std::numeric_limits<T>::max(), -1}); }
 
   // Use this to get the least "Nearest" neighbor
-  _NODISCARD T WorstDist() const { return rank[K - 1]; }
+  _NODISCARD T WorstDist() const { return heap_[0].dist; }
+
+  // In ascending order of distance, the missing ones (fewer than 'K' points
+  // seen) last
+  _NODISCARD std::array<Neighbor<T>, K> Sorted() const {
+    auto sorted = heap_;
+    std::sort_heap(sorted.begin(), sorted.end());
+    return sorted;
+  }
 
   void DebugPrint() const {
+    const auto sorted = Sorted();
     for (int i = 0; i < K; ++i) {
-      std::cout << i << ":\t" << rank[i] << '\n';
+      std::cout << i << ":\t" << sorted[i].dist << " (" << sorted[i].id
+                << ")\n";
     }
   }
 
-  // Assume sorted
  private:
-  T rank[K];
+  std::array<Neighbor<T>, K> heap_;
 };
 
 // Specialization For NN
 template <typename T>
-struct KnnSet<T, 1> {
-  void Insert(const T value) {
-    if (value < dat) dat = value;
+class KnnSet<T, 1> {
+ public:
+  void Insert(const T dist, const int id) {
+    if (dist < best_.dist) best_ = {dist, id};
   }
 
-  void Reset() { dat = std::numeric_limits<T>::max(); }
+  void Reset() { best_ = {std::numeric_limits<T>::max(), -1}; }
 
-  _NODISCARD T WorstDist() const { return dat; }
+  _NODISCARD T WorstDist() const { return best_.dist; }
+
+  _NODISCARD std::array<Neighbor<T>, 1> Sorted() const { return {best_}; }
 
  private:
-  T dat;
-};
\ No newline at end of file
+  Neighbor<T> best_;
+};
+
+// 'K' of a 'KnnSet<T, K>', 0 for any other result set
+template <typename ResultSet>
+inline constexpr int kNumNeighborsOf = 0;
+
+template <typename T, int K>
+inline constexpr int kNumNeighborsOf<KnnSet<T, K>> = K;
@@ -6,30 +6,224 @@
 #include <limits>
 #include <memory>
 #include <numeric>
-#include <queue>
 #include <random>
+#include <type_traits>
+#include <utility>
 #include <vector>
 
 #include "../LoadFile.hpp"
 #include "../Utils.hpp"
 #include "../cxxopts.hpp"
 #include "AppParams.hpp"
+#include "DualTree.hpp"
 #include "Executor.hpp"
+#include "Forest.hpp"
 #include "Functors/DistanceMetrics.hpp"
 #include "GlobalVars.hpp"
+#include "IndexFile.hpp"
 #include "KDTree.hpp"
+#include "KnnSet.hpp"
+#include "QueryEngine.hpp"
+#include "RadiusSet.hpp"
 #include "ReducerHandler.hpp"
 #include "Redwood.hpp"
 
-_NODISCARD inline Point4F RandPoint() {
-  Point4F p;
-  p.data[0] = MyRand(0, 1024);
-  p.data[1] = MyRand(0, 1024);
-  p.data[2] = MyRand(0, 1024);
-  p.data[3] = MyRand(0, 1024);
+template <int Dim, typename T>
+_NODISCARD Point<Dim, T> RandPoint() {
+  Point<Dim, T> p;
+  for (auto& x : p.data) x = static_cast<T>(MyRand(0, 1024));
   return p;
 }
 
+// Runs all the queries, the results go to 'final_results1' and 'final_ids1'
+// (or 'final_lists1')
+template <typename ResultSet, int Dim, typename T>
+void Traverse(const std::vector<Point<Dim, T>>& queries) {
+  QueryEngine<kdt::KdTree<Dim, T>, dist::Euclidean, ResultSet> engine(
+      app_params.cpu);
+
+  SearchOptions options;
+  options.epsilon = app_params.epsilon;
+  options.max_leaves = app_params.max_leaves;
+  engine.SetOptions(options);
+
+  std::vector<typename decltype(engine)::Result> results;
+  TimeTask(app_params.cpu ? "CPU Traversal" : "GPU Traversal",
+           [&] { results = engine.Run(queries); });
+
+  const auto stats = engine.Stats();
+  std::cout << "Leaf Nodes Reduced: " << stats.num_leaves << " ("
+            << static_cast<double>(stats.num_leaves) /
+                   std::max<std::size_t>(stats.num_queries, 1)
+            << " per query), " << stats.num_truncated
+            << " queries stopped at the leaf budget." << std::endl;
+
+  for (std::size_t i = 0; i < results.size(); ++i) {
+    if constexpr (std::is_same_v<ResultSet, RadiusSet<T>>) {
+      final_results1[i] = results[i].count;
+      if (!app_params.count_only) final_lists1[i] = std::move(results[i].ids);
+    } else {
+      final_results1[i] = results[i].dist;
+      final_ids1[i] = results[i].id;
+    }
+  }
+}
+
+// All the queries at once, by a dual-tree join against 'tree', or every point
+// of the tree against the others with '--self_join'. The nearest neighbors go
+// to 'final_results1' and 'final_ids1'.
+template <int Dim, typename T>
+void Join(const kdt::KdTree<Dim, T>& tree,
+          const std::vector<Point<Dim, T>>& queries) {
+  DualTreeKnn<kdt::KdTree<Dim, T>> join(tree);
+
+  std::vector<typename decltype(join)::Neighbors> results;
+  TimeTask("Dual-Tree Join", [&] {
+    results = app_params.self_join ? join.SelfJoin() : join.Run(queries);
+  });
+
+  const auto stats = join.Stats();
+  std::cout << "Node Pairs: " << stats.num_pairs << " (" << stats.num_pruned
+            << " pruned), Leaf Nodes Reduced: " << stats.num_leaves << " ("
+            << static_cast<double>(stats.num_leaves) /
+                   std::max<std::size_t>(stats.num_queries, 1)
+            << " per query)." << std::endl;
+
+  final_results1.resize(results.size());
+  final_ids1.resize(results.size());
+  for (std::size_t i = 0; i < results.size(); ++i) {
+    final_results1[i] = results[i][0].dist;
+    final_ids1[i] = results[i][0].id;
+  }
+}
+
+// Everything after the options, for an input file of 'Point<Dim, T>'s
+template <int Dim, typename T>
+int Run(const cxxopts::ParseResult& result) {
+  using PointT = Point<Dim, T>;
+  using Tree = kdt::KdTree<Dim, T>;
+
+  std::vector<PointT> queries(app_params.m);
+  for (auto& q : queries) q = RandPoint<Dim, T>();
+
+  redwood::UsmOptions usm_options;
+  usm_options.huge_pages = app_params.huge_pages;
+  usm_options.populate = app_params.populate;
+  redwood::SetUsmOptions(usm_options);
+
+  const auto lnt_placement =
+      redwood::numa::ParsePlacement(app_params.lnt_placement);
+
+  // Init, before the leaf node table is filled: the traversal threads have
+  // to be assigned to their NUMA nodes for 'LoadPayload()'
+  rdc::Init<Dim, T>(app_params.num_threads, app_params.batch_size,
+                    app_params.num_streams);
+
+  // One of the two
+  std::shared_ptr<Tree> tree_ref;
+  std::unique_ptr<kdt::Forest<Dim, T>> forest;
+
+  if (app_params.index_file.empty()) {
+    std::cout << "Loading Data..." << std::endl;
+
+    const auto in_data =
+        load_data_from_file<PointT>(result["file"].as<std::string>());
+    const auto n = in_data.size();
+
+    omp_set_num_threads(app_params.num_threads);
+    const kdt::KdtParams params{app_params.max_leaf_size,
+                                app_params.num_threads,
+                                kdt::ParseLayout(app_params.tree_layout)};
+
+    if (app_params.insert_batch > 0) {
+      const auto batch = static_cast<std::size_t>(app_params.insert_batch);
+      forest = std::make_unique<kdt::Forest<Dim, T>>(
+          params, app_params.insert_batch, lnt_placement);
+
+      TimeTask("Inserting into kd Forest", [&] {
+        for (std::size_t i = 0; i < n; i += batch) {
+          const auto count = std::min(batch, n - i);
+          forest->Insert(in_data.data() + i, static_cast<int>(count));
+          forest->Poll();
+        }
+        forest->Sync();
+      });
+    } else {
+      std::cout << "Building kd Tree..." << std::endl;
+
+      kdt::WithSplitPolicy(app_params.split_policy, [&](const auto policy) {
+        tree_ref = std::make_shared<Tree>(params, in_data.data(), n, policy);
+      });
+
+      const auto num_leaf_nodes = tree_ref->GetStats().num_leaf_nodes;
+      auto [lnt_addr, lnt_offsets_addr] = rdc::AllocateLnt<Dim, T>(
+          num_leaf_nodes, tree_ref->NumLeafPoints(), lnt_placement);
+      tree_ref->LoadPayload(lnt_addr, lnt_offsets_addr);
+
+      if (!app_params.save_index_file.empty()) {
+        std::cout << "Saving Index..." << std::endl;
+        kdt::SaveIndex(app_params.save_index_file, *tree_ref, lnt_addr,
+                       lnt_offsets_addr);
+      }
+    }
+  } else {
+    // The tree's own parameters (leaf size, layout) are in the file
+    TimeTask("Loading Index", [&] {
+      const kdt::MappedIndex index(app_params.index_file);
+      tree_ref = std::make_shared<Tree>(kdt::LoadTree<Dim, T>(index));
+
+      auto [lnt_addr, lnt_offsets_addr] =
+          rdc::AllocateLnt<Dim, T>(tree_ref->GetStats().num_leaf_nodes,
+                                   index.NumLeafPoints(), lnt_placement);
+      index.CopyLnt(lnt_addr, lnt_offsets_addr);
+    });
+  }
+  rdc::SyncLnt<Dim, T>();
+
+  if (forest) {
+    query_trees<Dim, T> = forest->Trees();
+    std::cout << "Forest: " << forest->Size() << " points in "
+              << query_trees<Dim, T>.size() << " trees." << std::endl;
+  } else {
+    query_trees<Dim, T> = {tree_ref.get()};
+    tree_ref->PrintStatistic();
+  }
+
+  final_results1.resize(app_params.m);
+  final_ids1.resize(app_params.m);
+
+  std::cout << "Starting Traversal..." << std::endl;
+  if (app_params.radius > 0) {
+    // Same parameters for all members of a forest
+    const auto leaf_max_size = tree_ref ? tree_ref->GetParams().leaf_max_size
+                                        : app_params.max_leaf_size;
+    rdc::SetRadius<Dim, T>(static_cast<T>(app_params.radius),
+                           app_params.count_only, leaf_max_size);
+    if (!app_params.count_only) final_lists1.resize(app_params.m);
+
+    Traverse<RadiusSet<T>>(queries);
+
+    const auto total =
+        std::accumulate(final_results1.begin(), final_results1.end(), 0.0);
+    std::cout << "Radius Search: " << static_cast<std::size_t>(total)
+              << " points in range." << std::endl;
+  } else if (app_params.dual_tree || app_params.self_join) {
+    Join(*tree_ref, queries);
+  } else {
+    Traverse<KnnSet<T, 1>>(queries);
+  }
+  std::cout << "Program Execution Completed. " << std::endl;
+
+  rdc::Release<Dim, T>();
+
+  const auto usm_stats = redwood::GetUsmStats();
+  std::cout << "USM: " << usm_stats.peak_bytes_reserved / 1024 << " KB peak, "
+            << usm_stats.num_raw_allocs << " device allocations, "
+            << usm_stats.num_reused << " reused." << std::endl;
+  redwood::UsmTrim();
+  return EXIT_SUCCESS;
+}
+
 int main(int argc, char** argv) {
   cxxopts::Options options("Nearest Neighbor (NN)",
                            "Redwood NN demo implementation");
@@ -39,9 +233,26 @@ int main(int argc, char** argv) {
     ("f,file", "Input file name", cxxopts::value<std::string>())
     ("m,query", "Number of particles to query", cxxopts::value<int>()->default_value("1048576"))
     ("t,thread", "Number of threads", cxxopts::value<int>()->default_value("1"))
+    ("s,streams", "Number of batches in flight per thread", cxxopts::value<int>()->default_value("2"))
     ("l,leaf", "Maximum leaf node size", cxxopts::value<int>()->default_value("32"))
     ("b,batch_size", "Batch size (GPU)", cxxopts::value<int>()->default_value("1024"))
     ("c,cpu", "Enable CPU baseline", cxxopts::value<bool>()->default_value("false"))
+    ("huge_pages", "Back large USM blocks with huge pages (CPU backends)", cxxopts::value<bool>()->default_value("false"))
+    ("populate", "Pre-fault large USM blocks (CPU backends)", cxxopts::value<bool>()->default_value("false"))
+    ("lnt", "NUMA placement of the leaf node table (first_touch, interleave, replicate)", cxxopts::value<std::string>()->default_value("first_touch"))
+    ("layout", "Order of the kd-tree nodes in memory (dfs, eytzinger, veb)", cxxopts::value<std::string>()->default_value("dfs"))
+    ("split", "kd-tree split policy (median, max_spread, max_variance, sliding_midpoint, cost)", cxxopts::value<std::string>()->default_value("median"))
+    ("index", "Load the kd-tree and leaf node table from this index file instead of building them", cxxopts::value<std::string>()->default_value(""))
+    ("save_index", "Save the kd-tree and leaf node table to this index file", cxxopts::value<std::string>()->default_value(""))
+    ("insert_batch", "Insert the points into a dynamic kd-tree forest, this many at a time, instead of building one tree", cxxopts::value<int>()->default_value("0"))
+    ("dims", "Dimension of the points (2, 3, 4)", cxxopts::value<int>()->default_value("4"))
+    ("double", "The points are made of doubles instead of floats", cxxopts::value<bool>()->default_value("false"))
+    ("radius", "Find every point closer than this to each query instead of the nearest one (0 = off)", cxxopts::value<double>()->default_value("0"))
+    ("count_only", "With --radius, only count the points in range", cxxopts::value<bool>()->default_value("false"))
+    ("epsilon", "Approximate search, results at most (1 + epsilon) times farther than the exact ones", cxxopts::value<double>()->default_value("0"))
+    ("max_leaves", "Reduce at most this many leaf nodes per query (0 = no limit)", cxxopts::value<int>()->default_value("0"))
+    ("dual_tree", "Answer the queries with one dual-tree join instead of a traversal each", cxxopts::value<bool>()->default_value("false"))
+    ("self_join", "Find the nearest neighbor of every input point instead (dual-tree self-join)", cxxopts::value<bool>()->default_value("false"))
     ("h,help", "Print usage");
   // clang-format on
 
@@ -54,138 +265,61 @@ int main(int argc, char** argv) {
     exit(EXIT_SUCCESS);
   }
 
-  if (!result.count("file")) {
+  if (!result.count("file") && !result.count("index")) {
     std::cerr
         << "requires an input file (\"../../data/1m_nn_uniform_4f.dat\")\n";
     std::cout << options.help() << std::endl;
     exit(EXIT_FAILURE);
   }
 
-  const auto data_file = result["file"].as<std::string>();
   app_params.m = result["query"].as<int>();
   app_params.num_threads = result["thread"].as<int>();
+  app_params.num_streams = result["streams"].as<int>();
   app_params.max_leaf_size = result["leaf"].as<int>();
   app_params.batch_size = result["batch_size"].as<int>();
   app_params.cpu = result["cpu"].as<bool>();
+  app_params.huge_pages = result["huge_pages"].as<bool>();
+  app_params.populate = result["populate"].as<bool>();
+  app_params.lnt_placement = result["lnt"].as<std::string>();
+  app_params.tree_layout = result["layout"].as<std::string>();
+  app_params.split_policy = result["split"].as<std::string>();
+  app_params.index_file = result["index"].as<std::string>();
+  app_params.save_index_file = result["save_index"].as<std::string>();
+  app_params.insert_batch = result["insert_batch"].as<int>();
+  app_params.dims = result["dims"].as<int>();
+  app_params.use_double = result["double"].as<bool>();
+  app_params.radius = result["radius"].as<double>();
+  app_params.count_only = result["count_only"].as<bool>();
+  app_params.epsilon = result["epsilon"].as<double>();
+  app_params.max_leaves = result["max_leaves"].as<int>();
+  app_params.dual_tree = result["dual_tree"].as<bool>();
+  app_params.self_join = result["self_join"].as<bool>();
   std::cout << app_params << std::endl;
 
-  std::cout << "Loading Data..." << std::endl;
-
-  const auto in_data = load_data_from_file<Point4F>(data_file);
-  const auto n = in_data.size();
-
-  // For each thread
-  std::vector<std::queue<Task>> q_data(app_params.num_threads);
-  const auto tasks_per_thread = app_params.m / app_params.num_threads;
-  for (int tid = 0; tid < app_params.num_threads; ++tid) {
-    for (int i = 0; i < tasks_per_thread; ++i) {
-      q_data[tid].emplace(i, RandPoint());
-    }
+  // The join is over a single tree, for the nearest neighbors
+  if ((app_params.dual_tree || app_params.self_join) &&
+      (app_params.insert_batch > 0 || app_params.radius > 0)) {
+    std::cerr << "--dual_tree and --self_join do not work with --insert_batch "
+                 "or --radius"
+              << std::endl;
+    return EXIT_FAILURE;
   }
 
-  std::cout << "Building kd Tree..." << std::endl;
-
-  const kdt::KdtParams params{app_params.max_leaf_size};
-  tree_ref = std::make_shared<kdt::KdTree>(params, in_data.data(), n);
-
-  const auto num_leaf_nodes = tree_ref->GetStats().num_leaf_nodes;
-  auto lnt_addr = rdc::AllocateLnt(num_leaf_nodes, app_params.max_leaf_size);
-  tree_ref->LoadPayload(lnt_addr);
-
-  // Init
-  rdc::Init(app_params.num_threads, app_params.batch_size);
-  omp_set_num_threads(app_params.num_threads);
-  final_results1.resize(app_params.m);
-
-  std::cout << "Starting Traversal..." << std::endl;
-  if (app_params.cpu) {
-    TimeTask("CPU Traversal", [&] {
-      std::vector<Executor<dist::Euclidean>> cpu_exe;
-      for (int tid = 0; tid < app_params.num_threads; ++tid) {
-        cpu_exe.emplace_back(tid, 0, 0);
-      }
-
-      // Run
-#pragma omp parallel for
-      for (int tid = 0; tid < app_params.num_threads; ++tid) {
-        while (!q_data[tid].empty()) {
-          const auto task = q_data[tid].front();
-          cpu_exe[tid].SetQuery(task);
-          final_results1[task.first] = cpu_exe[tid].CpuTraverse();
-          q_data[tid].pop();
-        }
-      }
-    });
-
-  } else {
-    // Use Redwood
-    constexpr auto num_streams = 2;
-
-    // Setup traversers
-    std::vector<Executor<dist::Euclidean>> exes;
-    exes.reserve(app_params.num_threads * num_streams * app_params.batch_size);
-    for (int tid = 0; tid < app_params.num_threads; ++tid) {
-      for (int stream_id = 0; stream_id < num_streams; ++stream_id) {
-        for (int i = 0; i < app_params.batch_size; ++i) {
-          exes.emplace_back(tid, stream_id, i);
-        }
-      }
-    }
-
-    // exe[4][2][1024]
-    const auto tid_offset = num_streams * app_params.batch_size;
-    const auto stream_offset = app_params.batch_size;
-
-    TimeTask("GPU Traversal", [&] {
-#pragma omp parallel for
-      for (int tid = 0; tid < app_params.num_threads; ++tid) {
-        auto cur_stream = 0;
-        while (!q_data[tid].empty()) {
-          auto it = tid * tid_offset + cur_stream * stream_offset;
-          const auto it_end = it + app_params.batch_size;
-          for (; it != it_end;) {
-            if (exes[it].Finished()) {
-              if (!q_data[tid].empty()) {
-                const auto q = q_data[tid].front();
-                q_data[tid].pop();
-
-                exes[it].SetQuery(q);
-                exes[it].StartQuery();
-              }
-
-              ++it;
-            } else {
-              exes[it].Resume();
-              if (exes[it].Finished()) {
-                // Do not increment 'it'
-              } else {
-                ++it;
-              }
-            }
-          }
-
-          rdc::LaunchAsyncWorkQueue(tid, cur_stream);
-
-          // switch to next
-          cur_stream = (cur_stream + 1) % num_streams;
-
-          redwood::DeviceStreamSynchronize(tid, cur_stream);
-          rdc::ResetBuffer(tid, cur_stream);
-        }
-      }
-
-      redwood::DeviceSynchronize();
-
-      const auto left =
-          app_params.num_threads * num_streams * app_params.batch_size;
-      for (int i = 0; i < left; ++i) {
-        const auto q_idx = exes[i].my_task_.first;
-        final_results1[q_idx] = exes[i].CpuTraverse();
-      }
-    });
+  // The input files are raw arrays of points, their type is not in them
+  if (app_params.dims == 2) {
+    return app_params.use_double ? Run<2, double>(result)
+                                 : Run<2, float>(result);
+  }
+  if (app_params.dims == 3) {
+    return app_params.use_double ? Run<3, double>(result)
+                                 : Run<3, float>(result);
+  }
+  if (app_params.dims == 4) {
+    return app_params.use_double ? Run<4, double>(result)
+                                 : Run<4, float>(result);
   }
-  std::cout << "Program Execution Completed. " << std::endl;
 
-  rdc::Release();
-  return EXIT_SUCCESS;
+  std::cerr << "unsupported number of dimensions: " << app_params.dims
+            << std::endl;
+  return EXIT_FAILURE;
 }
@@ -0,0 +1,267 @@
+#pragma once
+
+#include <omp.h>
+
+#include <atomic>
+#include <cstddef>
+#include <future>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "../Utils.hpp"
+#include "Executor.hpp"
+#include "Functors/DistanceMetrics.hpp"
+#include "KDTree.hpp"
+#include "KnnSet.hpp"
+#include "RadiusSet.hpp"
+#include "ReducerHandler.hpp"
+#include "Redwood.hpp"
+
+// Of the last run of a 'QueryEngine', summed over its queries
+struct QueryStats {
+  std::size_t num_queries = 0;
+  // Leaf nodes reduced
+  std::size_t num_leaves = 0;
+  // Stopped at 'SearchOptions::max_leaves'
+  std::size_t num_truncated = 0;
+};
+
+// Runs batches of queries against 'query_trees', so an application does not
+// have to drive the executors itself. Owns a pool of 'batch_size' executors
+// per (thread, stream), starts a query on each one that finishes, launches
+// the stream's batch and moves on to the next stream (the first one done, or
+// round-robin), until every query has finished. Nothing is left for
+// 'CpuTraverse()' at the end.
+//
+// The batch buffers are rdc's: call 'rdc::Init()' before (and before
+// 'LoadPayload()', for the NUMA placement), and 'rdc::SetRadius()' for a
+// 'RadiusSet' (the constructor throws otherwise). A 'KnnSet<T, K>' sets the
+// result slots to K neighbors ('rdc::SetNumNeighbors()', unless 'cpu'), which
+// also ends a fixed-radius search. One engine per point type, one run at a
+// time.
+template <typename Tree, typename Functor = dist::Euclidean,
+          typename ResultSet = KnnSet<typename Tree::PointT::Scalar, 1>>
+class QueryEngine {
+  using PointT = typename Tree::PointT;
+  static constexpr int Dim = PointT::kDims;
+  using T = typename PointT::Scalar;
+  using Exe = Executor<Functor, Dim, T, ResultSet>;
+
+ public:
+  // 'Neighbor<T>' for NN, 'std::array<Neighbor<T>, K>' for KNN, 'RadiusResult'
+  // for fixed-radius search
+  using Result = decltype(std::declval<Exe&>().TakeResult());
+
+  // With 'cpu', each query is traversed at once on its thread, no batches
+  explicit QueryEngine(const bool cpu = false)
+      : cpu_(cpu),
+        num_threads_(rdc::stored_num_threads),
+        num_streams_(rdc::stored_num_streams),
+        batch_size_(rdc::stored_batch_size) {
+    // No kernel is launched on the CPU path, the radius is read either way
+    if constexpr (std::is_same_v<ResultSet, RadiusSet<T>>) {
+      if (!rdc::radius_query<Dim, T>.enabled) {
+        throw std::runtime_error(
+            "Error: fixed-radius search needs a radius, call "
+            "'rdc::SetRadius()' first. ");
+      }
+    } else if constexpr (kNumNeighborsOf<ResultSet> > 0) {
+      if (!cpu_) rdc::SetNumNeighbors<Dim, T>(kNumNeighborsOf<ResultSet>);
+    }
+
+    const auto per_thread = cpu_ ? 1 : num_streams_ * batch_size_;
+    exes_.reserve(num_threads_ * per_thread);
+    for (int tid = 0; tid < num_threads_; ++tid) {
+      for (int i = 0; i < per_thread; ++i) {
+        exes_.emplace_back(tid, i / batch_size_, i % batch_size_);
+      }
+    }
+  }
+
+  QueryEngine(const QueryEngine&) = delete;
+  QueryEngine& operator=(const QueryEngine&) = delete;
+
+  // For the queries of the next runs that are not given their own
+  void SetOptions(const SearchOptions& options) { options_ = options; }
+
+  // Blocking, 'results[i]' is the one of 'queries[i]'
+  _NODISCARD std::vector<Result> Run(const PointT* queries, const int n) {
+    std::vector<Result> results(n);
+    Run(queries, n,
+        [&](const int i, Result&& result) { results[i] = std::move(result); });
+    return results;
+  }
+
+  _NODISCARD std::vector<Result> Run(const std::vector<PointT>& queries) {
+    return Run(queries.data(), static_cast<int>(queries.size()));
+  }
+
+  // 'options[i]' for 'queries[i]'
+  _NODISCARD std::vector<Result> Run(
+      const std::vector<PointT>& queries,
+      const std::vector<SearchOptions>& options) {
+    std::vector<Result> results(queries.size());
+    Run(
+        queries.data(), static_cast<int>(queries.size()),
+        [&](const int i, Result&& result) { results[i] = std::move(result); },
+        options.data());
+    return results;
+  }
+
+  // Blocking, 'callback(i, result)' as soon as 'queries[i]' finishes. Called
+  // from all the traversal threads at once. 'options[i]' for 'queries[i]',
+  // the ones of 'SetOptions()' without.
+  template <typename Callback>
+  void Run(const PointT* queries, const int n, Callback&& callback,
+           const SearchOptions* options = nullptr) {
+    const Queries batch{queries, n, options};
+    std::atomic<int> next{0};
+    thread_stats_.assign(num_threads_, QueryStats{});
+
+#pragma omp parallel for num_threads(num_threads_)
+    for (int tid = 0; tid < num_threads_; ++tid) {
+      const redwood::numa::ScopedPin pin(tid);
+      if (cpu_) {
+        RunCpu(tid, batch, next, callback);
+      } else {
+        RunBatches(tid, batch, next, callback);
+      }
+    }
+  }
+
+  _NODISCARD QueryStats Stats() const {
+    QueryStats total;
+    for (const auto& stats : thread_stats_) {
+      total.num_queries += stats.num_queries;
+      total.num_leaves += stats.num_leaves;
+      total.num_truncated += stats.num_truncated;
+    }
+    return total;
+  }
+
+  // Runs on a thread of its own, wait for the future before the next run
+  _NODISCARD std::future<std::vector<Result>> RunAsync(
+      std::vector<PointT> queries) {
+    return std::async(std::launch::async,
+                      [this, queries = std::move(queries)] {
+                        return Run(queries);
+                      });
+  }
+
+ private:
+  struct Queries {
+    const PointT* points;
+    int n;
+    const SearchOptions* options;
+  };
+
+  void SetQuery(Exe& exe, const Queries& batch, const int i) const {
+    exe.SetQuery({i, batch.points[i]});
+    exe.SetOptions(batch.options ? batch.options[i] : options_);
+  }
+
+  template <typename Callback>
+  static void Finish(Exe& exe, QueryStats& stats, Callback& callback) {
+    ++stats.num_queries;
+    stats.num_leaves += exe.NumLeaves();
+    if (exe.Truncated()) ++stats.num_truncated;
+    callback(exe.my_task_.first, exe.TakeResult());
+  }
+
+  template <typename Callback>
+  void RunCpu(const int tid, const Queries& batch, std::atomic<int>& next,
+              Callback& callback) {
+    QueryStats stats;
+    auto& exe = exes_[tid];
+    for (auto i = next++; i < batch.n; i = next++) {
+      SetQuery(exe, batch, i);
+      exe.CpuTraverse();
+      Finish(exe, stats, callback);
+    }
+    thread_stats_[tid] = stats;
+  }
+
+  // The executors of a stream are only resumed with the results of the batch
+  // they pushed into. A finished executor takes the next query right away.
+  template <typename Callback>
+  void RunBatches(const int tid, const Queries& batch, std::atomic<int>& next,
+                  Callback& callback) {
+    QueryStats stats;
+    auto num_active = 0;
+    auto cur_stream = 0;
+    while (true) {
+      const auto results = BatchResults(tid, cur_stream);
+      const auto begin = (tid * num_streams_ + cur_stream) * batch_size_;
+      for (auto it = begin; it != begin + batch_size_;) {
+        auto& exe = exes_[it];
+        if (!exe.Finished()) {
+          exe.Resume(results);
+          if (!exe.Finished()) {
+            ++it;
+            continue;
+          }
+          --num_active;
+          Finish(exe, stats, callback);
+        }
+
+        const auto i = next++;
+        if (i >= batch.n) {
+          ++it;
+          continue;
+        }
+        SetQuery(exe, batch, i);
+        exe.StartQuery();
+        if (exe.Finished()) {
+          // Nothing to reduce, same executor again
+          Finish(exe, stats, callback);
+        } else {
+          ++num_active;
+          ++it;
+        }
+      }
+
+      // Every executor of the stream tried to take a query
+      if (num_active == 0) break;
+
+      rdc::LaunchAsyncWorkQueue<Dim, T>(tid, cur_stream);
+
+      // switch to a stream whose batch has already finished. If all of them
+      // are still in flight, block on the next one in round-robin.
+      auto next_stream = (cur_stream + 1) % num_streams_;
+      for (int s = 1; s < num_streams_; ++s) {
+        const auto candidate = (cur_stream + s) % num_streams_;
+        if (rdc::BatchFinished(tid, candidate)) {
+          next_stream = candidate;
+          break;
+        }
+      }
+      cur_stream = next_stream;
+
+      rdc::WaitBatch(tid, cur_stream);
+      rdc::ResetBuffer<Dim, T>(tid, cur_stream);
+    }
+    thread_stats_[tid] = stats;
+  }
+
+  _NODISCARD static auto BatchResults(const int tid, const int stream_id) {
+    if constexpr (std::is_same_v<ResultSet, RadiusSet<T>>) {
+      return rdc::BatchMatches<Dim, T>(tid, stream_id);
+    } else {
+      return rdc::BatchResults<Dim, T>(tid, stream_id);
+    }
+  }
+
+  bool cpu_;
+  SearchOptions options_;
+  int num_threads_;
+  int num_streams_;
+  int batch_size_;
+
+  // [tid][stream_id][batch_size], or one per thread with 'cpu'
+  std::vector<Exe> exes_;
+
+  // Of the last run, [tid]
+  std::vector<QueryStats> thread_stats_;
+};
@@ -0,0 +1,222 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <limits>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#include "../Utils.hpp"
+#include "Redwood/Usm.hpp"
+
+// Where the 'NeighborList's are carved from: large USM chunks, handed out one
+// after the other. One per thread, so the lists of a search never go through
+// the lock of the USM pool. A chunk is returned to the pool once the arena
+// moved past it and the last list in it is gone, wherever that happens.
+class ListArena {
+ public:
+  struct Chunk {
+    int* data;
+    int capacity;
+    int used;
+    std::atomic<int> refs;
+  };
+
+  ListArena() = default;
+
+  ListArena(const ListArena&) = delete;
+  ListArena& operator=(const ListArena&) = delete;
+
+  ~ListArena() {
+    if (chunk_) Release(chunk_);
+  }
+
+  // Of the calling thread
+  static ListArena& Local() {
+    thread_local ListArena arena;
+    return arena;
+  }
+
+  // Room for 'n' ints, in the returned chunk, which counts one more reference
+  _NODISCARD std::pair<Chunk*, int*> Allocate(const int n) {
+    if (!chunk_ || chunk_->capacity - chunk_->used < n) NewChunk(n);
+    const auto data = chunk_->data + chunk_->used;
+    chunk_->used += n;
+    chunk_->refs.fetch_add(1, std::memory_order_relaxed);
+    return {chunk_, data};
+  }
+
+  // Makes the allocation ending at 'end' 'n' ints longer, if it was the last
+  // one of this arena and there is room left
+  _NODISCARD bool Extend(const Chunk* chunk, const int* end, const int n) {
+    if (chunk != chunk_ || end != chunk_->data + chunk_->used ||
+        chunk_->capacity - chunk_->used < n) {
+      return false;
+    }
+    chunk_->used += n;
+    return true;
+  }
+
+  static void Release(Chunk* chunk) {
+    if (chunk->refs.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+      redwood::UsmFree(chunk->data);
+      delete chunk;
+    }
+  }
+
+ private:
+  static constexpr int kChunkSize = 1 << 16;
+
+  // The arena holds a reference to its current chunk
+  void NewChunk(const int n) {
+    if (chunk_) Release(chunk_);
+    const auto capacity = std::max(kChunkSize, n);
+    chunk_ = new Chunk{redwood::UsmMalloc<int>(capacity), capacity, 0, {1}};
+  }
+
+  Chunk* chunk_ = nullptr;
+};
+
+// Ids of the points a fixed-radius query found, in unspecified order. A
+// growable array in USM, so the results of a query can be handed to a kernel
+// as they are, allocated from the 'ListArena' of the thread. Move-only.
+class NeighborList {
+ public:
+  NeighborList() = default;
+
+  // A copy of 'ids', allocated once
+  NeighborList(const int* ids, const int n) {
+    if (n == 0) return;
+    std::tie(chunk_, data_) = ListArena::Local().Allocate(n);
+    std::copy_n(ids, n, data_);
+    size_ = n;
+    capacity_ = n;
+  }
+
+  NeighborList(const NeighborList&) = delete;
+  NeighborList& operator=(const NeighborList&) = delete;
+
+  NeighborList(NeighborList&& other) noexcept { Steal(other); }
+
+  NeighborList& operator=(NeighborList&& other) noexcept {
+    if (this != &other) {
+      Free();
+      Steal(other);
+    }
+    return *this;
+  }
+
+  ~NeighborList() { Free(); }
+
+  void Append(const int id) {
+    if (size_ == capacity_) Grow();
+    data_[size_++] = id;
+  }
+
+  // Keeps the memory
+  void Clear() { size_ = 0; }
+
+  _NODISCARD int Size() const { return size_; }
+
+  _NODISCARD const int* Data() const { return data_; }
+
+  _NODISCARD const int* begin() const { return data_; }
+  _NODISCARD const int* end() const { return data_ + size_; }
+
+ private:
+  static constexpr int kMinCapacity = 16;
+
+  // Doubled, in place if nothing was allocated after it
+  void Grow() {
+    auto& arena = ListArena::Local();
+    const auto capacity = std::max(kMinCapacity, 2 * capacity_);
+    if (chunk_ &&
+        arena.Extend(chunk_, data_ + capacity_, capacity - capacity_)) {
+      capacity_ = capacity;
+      return;
+    }
+
+    const auto [chunk, data] = arena.Allocate(capacity);
+    std::copy_n(data_, size_, data);
+    if (chunk_) ListArena::Release(chunk_);
+    chunk_ = chunk;
+    data_ = data;
+    capacity_ = capacity;
+  }
+
+  void Free() {
+    if (chunk_) ListArena::Release(chunk_);
+    chunk_ = nullptr;
+    data_ = nullptr;
+    size_ = 0;
+    capacity_ = 0;
+  }
+
+  void Steal(NeighborList& other) {
+    chunk_ = std::exchange(other.chunk_, nullptr);
+    data_ = std::exchange(other.data_, nullptr);
+    size_ = std::exchange(other.size_, 0);
+    capacity_ = std::exchange(other.capacity_, 0);
+  }
+
+  ListArena::Chunk* chunk_ = nullptr;
+  int* data_ = nullptr;
+  int size_ = 0;
+  int capacity_ = 0;
+};
+
+// What a fixed-radius query returns, 'ids' is empty if count only
+struct RadiusResult {
+  int count;
+  NeighborList ids;
+};
+
+// Every point closer than 'radius' to a query (strictly, so cells at the
+// radius are pruned). With 'count_only' only how many of them, nothing is
+// allocated. The ids are gathered on the host, in memory kept from one query
+// to the next, and copied to a list of the right size at the end.
+template <typename T>
+class RadiusSet {
+ public:
+  void Insert(const T dist, const int id) {
+    if (dist < radius_) Append(id);
+  }
+
+  // A point already known to be in range, e.g., from a leaf kernel
+  void Append(const int id) {
+    ++count_;
+    if (!count_only_) ids_.push_back(id);
+  }
+
+  // For count only, 'n' points in range
+  void Add(const int n) { count_ += n; }
+
+  void Reset(const T radius, const bool count_only) {
+    radius_ = radius;
+    count_only_ = count_only;
+    count_ = 0;
+    ids_.clear();
+  }
+
+  // Nothing farther than the radius matters, cells beyond it are pruned
+  _NODISCARD T WorstDist() const { return radius_; }
+
+  _NODISCARD int Count() const { return count_; }
+
+  _NODISCARD bool CountOnly() const { return count_only_; }
+
+  // The result so far, the set starts a new list
+  _NODISCARD RadiusResult Take() {
+    RadiusResult result{
+        count_, NeighborList(ids_.data(), static_cast<int>(ids_.size()))};
+    ids_.clear();
+    return result;
+  }
+
+ private:
+  T radius_ = std::numeric_limits<T>::max();
+  bool count_only_ = false;
+  int count_ = 0;
+  std::vector<int> ids_;
+};
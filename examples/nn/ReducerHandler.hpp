@@ -1,36 +1,141 @@
 #pragma once
 
+#include <algorithm>
 #include <array>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
 
 #include "../Utils.hpp"
 #include "Functors/DistanceMetrics.hpp"
+#include "Functors/LeafKernels.hpp"
+#include "Functors/ReduceOps.hpp"
 #include "KnnSet.hpp"
 #include "Redwood.hpp"
+#include "Redwood/KernelRegistry.hpp"
 
-using Task = std::pair<int, Point4F>;
+// A query, by index, for the trees of 'Point<Dim, T>'
+template <int Dim, typename T>
+using Task = std::pair<int, Point<Dim, T>>;
 
+// The tables and buffers below are per point type, 'Point<Dim, T>', the one of
+// the tree being searched. The results are in 'T'.
 namespace rdc {
 
-// Shared accross threads, streams.
-inline Point4F* lnt_base_addr = nullptr;
-inline int stored_max_leaf_size;
+// Shared accross threads, streams. The leaves are packed back to back, leaf
+// 'uid' is the points [lnt_offsets[uid], lnt_offsets[uid + 1]) of the table.
+//
+// Only one table is live at a time, whatever its point type: 'AllocateLnt()'
+// frees the previous one, so the trees loaded into it can no longer be
+// searched. Several trees share a table by being loaded into regions of it,
+// like the members of a 'kdt::Forest'.
+template <int Dim, typename T>
+inline Point<Dim, T>* lnt_base_addr = nullptr;
+inline int* lnt_offsets_base_addr = nullptr;
+
+// With 'kReplicate', one copy of the LNT per NUMA node, [0] are the base ones
+template <int Dim, typename T>
+inline std::vector<Point<Dim, T>*> lnt_replicas;
+inline std::vector<int*> lnt_offsets_replicas;
+inline std::size_t stored_lnt_size;
+inline std::size_t stored_num_leaf_nodes;
+
+// 'FreeLnt()' of the live table, nullptr if there is none
+inline void (*free_live_lnt)() = nullptr;
+
+template <int Dim, typename T>
+void FreeLnt() {
+  redwood::numa::FreePlaced(lnt_replicas<Dim, T>);
+  redwood::numa::FreePlaced(lnt_offsets_replicas);
+  lnt_replicas<Dim, T>.clear();
+  lnt_offsets_replicas.clear();
+  lnt_base_addr<Dim, T> = nullptr;
+  lnt_offsets_base_addr = nullptr;
+  free_live_lnt = nullptr;
+}
+
+// 'num_leaf_points' is the number of points in all the leaves together (see
+// 'KdTree::NumLeafPoints()'). Fill the returned tables ('LoadPayload()'), then
+// call 'SyncLnt()' to update the other replicas.
+template <int Dim, typename T>
+_NODISCARD std::pair<Point<Dim, T>*, int*> AllocateLnt(
+    const int num_leaf_nodes, const int num_leaf_points,
+    const redwood::numa::Placement placement =
+        redwood::numa::Placement::kFirstTouch) {
+  if (free_live_lnt) free_live_lnt();
+  free_live_lnt = FreeLnt<Dim, T>;
+
+  stored_lnt_size = num_leaf_points;
+  stored_num_leaf_nodes = num_leaf_nodes;
+
+  lnt_replicas<Dim, T> =
+      redwood::numa::AllocatePlaced<Point<Dim, T>>(stored_lnt_size, placement);
+  lnt_offsets_replicas =
+      redwood::numa::AllocatePlaced<int>(stored_num_leaf_nodes + 1, placement);
+  lnt_base_addr<Dim, T> = lnt_replicas<Dim, T>[0];
+  lnt_offsets_base_addr = lnt_offsets_replicas[0];
+
+  return std::make_pair(lnt_base_addr<Dim, T>, lnt_offsets_base_addr);
+}
+
+template <int Dim, typename T>
+void SyncLnt() {
+  redwood::numa::SyncReplicas(lnt_replicas<Dim, T>, stored_lnt_size);
+  redwood::numa::SyncReplicas(lnt_offsets_replicas, stored_num_leaf_nodes + 1);
+}
+
+// The LNT copy closest to thread 'tid'
+template <int Dim, typename T>
+_NODISCARD const Point<Dim, T>* LntBaseAddr(const int tid) {
+  const auto& replicas = lnt_replicas<Dim, T>;
+  const auto node = redwood::numa::NodeOf(tid);
+  return node < static_cast<int>(replicas.size()) ? replicas[node]
+                                                  : lnt_base_addr<Dim, T>;
+}
+
+_NODISCARD inline const int* LntOffsetsAddr(const int tid) {
+  const auto node = redwood::numa::NodeOf(tid);
+  return node < static_cast<int>(lnt_offsets_replicas.size())
+             ? lnt_offsets_replicas[node]
+             : lnt_offsets_base_addr;
+}
+
+template <int Dim, typename T>
+_NODISCARD const Point<Dim, T>* LntDataAddrAt(const int node_idx) {
+  return lnt_base_addr<Dim, T> + lnt_offsets_base_addr[node_idx];
+}
 
-_NODISCARD inline Point4F* AllocateLnt(const int num_leaf_nodes,
-                                       const int max_leaf_size) {
-  stored_max_leaf_size = max_leaf_size;
-  lnt_base_addr = redwood::UsmMalloc<Point4F>(num_leaf_nodes * max_leaf_size);
-  return lnt_base_addr;
+template <int Dim, typename T>
+_NODISCARD const Point<Dim, T>* LntDataAddrAt(const int tid,
+                                              const int node_idx) {
+  return LntBaseAddr<Dim, T>(tid) + LntOffsetsAddr(tid)[node_idx];
 }
 
-_NODISCARD inline const Point4F* LntDataAddrAt(const int node_idx) {
-  return lnt_base_addr + node_idx * stored_max_leaf_size;
+// Number of points in leaf 'node_idx', at most the tree's 'leaf_max_size'
+_NODISCARD inline int LntLeafSize(const int node_idx) {
+  return lnt_offsets_base_addr[node_idx + 1] - lnt_offsets_base_addr[node_idx];
 }
 
+_NODISCARD inline int LntLeafSize(const int tid, const int node_idx) {
+  const auto offsets = LntOffsetsAddr(tid);
+  return offsets[node_idx + 1] - offsets[node_idx];
+}
+
+// What the leaf nodes are reduced with, 'reduce::Min' for the nearest
+// neighbor, 'reduce::TopK' of one of 'kTopKSizes' for more (see
+// 'SetNumNeighbors()'). Either way a result slot is sorted (distance, position
+// in the leaf) entries.
+using LeafFunctor = dist::Euclidean;
+inline constexpr std::array<int, 7> kTopKSizes{4, 8, 16, 32, 64, 128, 256};
+
 // For NN and KNN
+template <int Dim, typename T>
 struct Buffer {
+  // Placed on the node of their thread, see 'numa::TouchForThread()'
   void Alloc(const int buffer_size) {
-    u_qs = redwood::UsmMalloc<Point4F>(buffer_size);
-    u_leaf_idx = redwood::UsmMalloc<int>(buffer_size);
+    u_qs = redwood::UsmMallocPlaced<Point<Dim, T>>(buffer_size);
+    u_leaf_idx = redwood::UsmMallocPlaced<int>(buffer_size);
   }
 
   void DeAlloc() const {
@@ -42,82 +147,323 @@ struct Buffer {
 
   void Reset() { num_active = 0; }
 
-  void Push(const Task& task, const int node_idx) {
+  // Returns the slot of the item in the batch
+  int Push(const Task<Dim, T>& task, const int node_idx) {
     u_qs[num_active] = task.second;
     u_leaf_idx[num_active] = node_idx;
-    ++num_active;
+    return num_active++;
   }
 
   int num_active;
-  Point4F* u_qs;
+  Point<Dim, T>* u_qs;
   int* u_leaf_idx;
 };
 
+// Read-only view of the results of a finished batch, slot 'i' is the reduction
+// of the i-th item pushed into it: the 'stride' nearest points of its leaf, in
+// ascending order of distance. The missing ones (smaller leaf) are last, with
+// position -1 and distance 'max()'.
+template <typename T>
+struct ResultSpan {
+  _NODISCARD int Size() const { return size; }
+
+  _NODISCARD const reduce::Entry<T>* At(const int slot) const {
+    return data + slot * stride;
+  }
+
+  const reduce::Entry<T>* data;
+  int size;
+  int stride;
+};
+
+// One result slot of 'k' entries per item of a batch. The kernel overwrites
+// the USM slots, then they are copied to 'h_results' on the same stream, so
+// the executors read their results from a contiguous host array once the
+// batch is done, instead of touching USM one slot at a time. 'h_results' is
+// pinned, or the copy would not be asynchronous on CUDA.
+template <typename T>
 struct ResultBuffer {
   void Alloc(const int buffer_size, const int k = 1) {
     stored_k = k;
-    underlying_dat = redwood::UsmMalloc<float>(buffer_size * k);
+    num_ready = 0;
+    u_results = redwood::UsmMallocPlaced<reduce::Entry<T>>(buffer_size * k);
+    h_results = redwood::HostMalloc<reduce::Entry<T>>(buffer_size * k);
+  }
+
+  void DeAlloc() const {
+    redwood::UsmFree(u_results);
+    redwood::HostFree(h_results);
   }
 
-  void DeAlloc() const { redwood::UsmFree(underlying_dat); }
+  // Enqueue the copy of the first 'num_active' slots to the host
+  void ReadbackAsync(const int tid, const int stream_id, const int num_active) {
+    num_ready = num_active;
+    redwood::MemcpyAsync(h_results, u_results,
+                         num_active * stored_k * sizeof(reduce::Entry<T>), tid,
+                         stream_id);
+  }
 
-  _NODISCARD float* GetAddrAt(const int executor_id) const {
-    return underlying_dat + executor_id * stored_k;
+  _NODISCARD ResultSpan<T> HostSpan() const {
+    return ResultSpan<T>{h_results, num_ready, stored_k};
   }
 
-  float* underlying_dat;
+  reduce::Entry<T>* u_results;
+  reduce::Entry<T>* h_results;
+  int num_ready;
   int stored_k;
 };
 
+// Results of a fixed-radius batch (see 'SetRadius()'). Slot 'i' is how many
+// points of its leaf are in range, and unless count only, their positions in
+// the leaf. A count above 'stride' means the slot overflowed.
+struct MatchSpan {
+  _NODISCARD int Size() const { return size; }
+
+  _NODISCARD int Count(const int slot) const { return counts[slot]; }
+
+  _NODISCARD const int* At(const int slot) const {
+    return matches + slot * stride;
+  }
+
+  const int* counts;
+  const int* matches;
+  int size;
+  int stride;
+};
+
+// Like 'ResultBuffer', one count and 'stride' match slots per item of a batch.
+// A leaf has at most 'leaf_max_size' points, so with that as the stride, the
+// slots never overflow and the kernel needs no atomics.
+struct MatchBuffer {
+  void Alloc(const int buffer_size, const int stride) {
+    stored_stride = stride;
+    num_ready = 0;
+    u_counts = redwood::UsmMallocPlaced<int>(buffer_size);
+    u_matches = stride > 0 ? redwood::UsmMallocPlaced<int>(buffer_size * stride)
+                           : nullptr;
+    h_counts = redwood::HostMalloc<int>(buffer_size);
+    h_matches =
+        stride > 0 ? redwood::HostMalloc<int>(buffer_size * stride) : nullptr;
+  }
+
+  void DeAlloc() const {
+    redwood::UsmFree(u_counts);
+    redwood::HostFree(h_counts);
+    if (u_matches) {
+      redwood::UsmFree(u_matches);
+      redwood::HostFree(h_matches);
+    }
+  }
+
+  // Enqueue the copy of the first 'num_active' slots to the host
+  void ReadbackAsync(const int tid, const int stream_id, const int num_active) {
+    num_ready = num_active;
+    redwood::MemcpyAsync(h_counts, u_counts, num_active * sizeof(int), tid,
+                         stream_id);
+    if (u_matches) {
+      redwood::MemcpyAsync(h_matches, u_matches,
+                           num_active * stored_stride * sizeof(int), tid,
+                           stream_id);
+    }
+  }
+
+  _NODISCARD MatchSpan HostSpan() const {
+    return MatchSpan{h_counts, h_matches, num_ready, stored_stride};
+  }
+
+  int* u_counts;
+  int* u_matches;
+  int* h_counts;
+  int* h_matches;
+  int num_ready;
+  int stored_stride;
+};
+
+// Set by 'SetRadius()', the leaves are searched for the points closer than
+// 'radius' instead of reduced to their nearest points
+template <typename T>
+struct RadiusQuery {
+  bool enabled = false;
+  T radius = T(0);
+  bool count_only = false;
+};
+
 inline int stored_num_threads;
-inline std::vector<std::array<Buffer, 2>> buffers;
-inline std::vector<std::array<ResultBuffer, 2>> result_addr;
+inline int stored_num_streams;
+inline int stored_batch_size;
+
+// [tid][stream_id]
+template <int Dim, typename T>
+inline std::vector<std::vector<Buffer<Dim, T>>> buffers;
+template <int Dim, typename T>
+inline std::vector<std::vector<ResultBuffer<T>>> result_buffers;
+template <int Dim, typename T>
+inline std::vector<std::vector<MatchBuffer>> match_buffers;
+template <int Dim, typename T>
+inline RadiusQuery<T> radius_query;
+
+// Recorded after each launch, tells whether a stream's batch has finished
+inline std::vector<std::vector<redwood::Event>> batch_done;
+
+template <int Dim, typename T>
+void AllocResultBuffers(const int k) {
+  auto& results = result_buffers<Dim, T>;
+  results.assign(stored_num_threads,
+                 std::vector<ResultBuffer<T>>(stored_num_streams));
+  for (int tid = 0; tid < stored_num_threads; ++tid) {
+    for (int i = 0; i < stored_num_streams; ++i) {
+      auto& buf = results[tid][i];
+      buf.Alloc(stored_batch_size, k);
+
+      redwood::numa::TouchForThread(
+          tid, buf.u_results,
+          stored_batch_size * k * sizeof(reduce::Entry<T>));
+      redwood::AttachStreamMem(tid, i, buf.u_results);
+    }
+  }
+}
 
-inline void Init(const int num_thread, const int batch_size) {
-  redwood::Init(num_thread);
+template <int Dim, typename T>
+void FreeResultBuffers() {
+  for (auto& per_thread : result_buffers<Dim, T>) {
+    for (const auto& results : per_thread) results.DeAlloc();
+  }
+  result_buffers<Dim, T>.clear();
+}
+
+template <int Dim, typename T>
+void Init(const int num_thread, const int batch_size,
+          const int num_streams = 2) {
+  redwood::Init(num_thread, num_streams);
   stored_num_threads = num_thread;
+  stored_num_streams = num_streams;
+  stored_batch_size = batch_size;
 
-  buffers.resize(num_thread);
-  result_addr.resize(num_thread);
+  auto& bufs = buffers<Dim, T>;
+  bufs.assign(num_thread, std::vector<Buffer<Dim, T>>(num_streams));
+  batch_done.assign(num_thread, std::vector<redwood::Event>(num_streams));
   for (int tid = 0; tid < num_thread; ++tid) {
-    for (int i = 0; i < 2; ++i) {
-      buffers[tid][i].Alloc(batch_size);
-      result_addr[tid][i].Alloc(batch_size);
-
-      redwood::AttachStreamMem(tid, i, buffers[tid][i].u_leaf_idx);
-      redwood::AttachStreamMem(tid, i, buffers[tid][i].u_qs);
-      redwood::AttachStreamMem(tid, i, result_addr[tid][i].underlying_dat);
+    for (int i = 0; i < num_streams; ++i) {
+      bufs[tid][i].Alloc(batch_size);
+      batch_done[tid][i] = redwood::CreateEvent();
+
+      // Place the pages on the NUMA node of 'tid'
+      redwood::numa::TouchForThread(tid, bufs[tid][i].u_qs,
+                                    batch_size * sizeof(Point<Dim, T>));
+      redwood::numa::TouchForThread(tid, bufs[tid][i].u_leaf_idx,
+                                    batch_size * sizeof(int));
+
+      redwood::AttachStreamMem(tid, i, bufs[tid][i].u_leaf_idx);
+      redwood::AttachStreamMem(tid, i, bufs[tid][i].u_qs);
     }
   }
+
+  AllocResultBuffers<Dim, T>(1);
+}
+
+// Smallest result slot the kernels can return the 'k' nearest points of a
+// leaf in
+_NODISCARD inline int SlotSizeFor(const int k) {
+  if (k <= 1) return 1;
+  for (const auto size : kTopKSizes) {
+    if (k <= size) return size;
+  }
+  throw std::runtime_error("Error: no leaf kernel for the " +
+                           std::to_string(k) + " nearest neighbors, at most " +
+                           std::to_string(kTopKSizes.back()) + ". ");
+}
+
+template <int Dim, typename T>
+void FreeMatchBuffers() {
+  for (auto& per_thread : match_buffers<Dim, T>) {
+    for (const auto& matches : per_thread) matches.DeAlloc();
+  }
+  match_buffers<Dim, T>.clear();
+}
+
+// The kernels return the 'k' nearest points of each leaf (or a few more)
+// instead of only the nearest one, for a 'KnnSet<T, k>'. Also switches back
+// from fixed-radius search ('SetRadius()'). Call after 'Init()', between
+// batches. 'QueryEngine' calls it for its result set.
+template <int Dim, typename T>
+void SetNumNeighbors(const int k) {
+  const auto size = SlotSizeFor(k);
+  if (radius_query<Dim, T>.enabled) {
+    FreeMatchBuffers<Dim, T>();
+    radius_query<Dim, T> = RadiusQuery<T>{};
+  }
+
+  const auto& results = result_buffers<Dim, T>;
+  if (!results.empty() && results[0][0].stored_k == size) return;
+
+  FreeResultBuffers<Dim, T>();
+  AllocResultBuffers<Dim, T>(size);
 }
 
-inline void Release() {
+// Switches the batches of 'Point<Dim, T>' to fixed-radius search, for the
+// executors with a 'RadiusSet', until 'SetNumNeighbors()'. Call after
+// 'Init()'. 'leaf_max_size' is the
+// largest leaf of the trees searched. Without 'count_only', the kernels return
+// the matches of each leaf, not only their number.
+template <int Dim, typename T>
+void SetRadius(const T radius, const bool count_only,
+               const int leaf_max_size) {
+  radius_query<Dim, T> = RadiusQuery<T>{true, radius, count_only};
+
+  const auto stride = count_only ? 0 : leaf_max_size;
+  FreeMatchBuffers<Dim, T>();
+  auto& matches = match_buffers<Dim, T>;
+  matches.assign(stored_num_threads,
+                 std::vector<MatchBuffer>(stored_num_streams));
   for (int tid = 0; tid < stored_num_threads; ++tid) {
-    for (int i = 0; i < 2; ++i) {
-      buffers[tid][i].DeAlloc();
-      result_addr[tid][i].DeAlloc();
+    for (int i = 0; i < stored_num_streams; ++i) {
+      auto& buf = matches[tid][i];
+      buf.Alloc(stored_batch_size, stride);
+
+      redwood::numa::TouchForThread(tid, buf.u_counts,
+                                    stored_batch_size * sizeof(int));
+      redwood::AttachStreamMem(tid, i, buf.u_counts);
+      if (buf.u_matches) {
+        redwood::numa::TouchForThread(
+            tid, buf.u_matches, stored_batch_size * stride * sizeof(int));
+        redwood::AttachStreamMem(tid, i, buf.u_matches);
+      }
     }
   }
-
-  redwood::UsmFree(lnt_base_addr);
 }
 
-inline void ResetBuffer(const int tid, const int cur_stream) {
-  buffers[tid][cur_stream].Reset();
+template <int Dim, typename T>
+void Release() {
+  for (int tid = 0; tid < stored_num_threads; ++tid) {
+    for (int i = 0; i < stored_num_streams; ++i) {
+      buffers<Dim, T>[tid][i].DeAlloc();
+      redwood::DestroyEvent(batch_done[tid][i]);
+    }
+  }
+
+  FreeResultBuffers<Dim, T>();
+  FreeMatchBuffers<Dim, T>();
+  radius_query<Dim, T> = RadiusQuery<T>{};
+  FreeLnt<Dim, T>();
 }
 
-_NODISCARD inline float* RequestResultAddr(const int tid, const int stream_id,
-                                           const int executor_index) {
-  return result_addr[tid][stream_id].GetAddrAt(executor_index);
+template <int Dim, typename T>
+void ResetBuffer(const int tid, const int cur_stream) {
+  buffers<Dim, T>[tid][cur_stream].Reset();
 }
 
-inline void ReduceLeafNode(const int tid, const int stream_id, const Task& task,
-                           const int node_idx) {
-  buffers[tid][stream_id].Push(task, node_idx);
+// Returns the slot the result will be in, see 'BatchResults()' (or
+// 'BatchMatches()' for fixed-radius search)
+template <int Dim, typename T>
+_NODISCARD int ReduceLeafNode(const int tid, const int stream_id,
+                              const Task<Dim, T>& task, const int node_idx) {
+  return buffers<Dim, T>[tid][stream_id].Push(task, node_idx);
 }
 
-inline void DebugCpuReduction(const Buffer& buf, const dist::Euclidean functor,
-                              const ResultBuffer& results) {
+// Same as the kernel of the 'ReduceOp' of the result slots, on the host
+template <typename ReduceOp, int Dim, typename T>
+void DebugCpuReduction(const Buffer<Dim, T>& buf, const LeafFunctor functor,
+                       const ResultBuffer<T>& results) {
   const auto n = buf.Size();
 
   // i is batch id, = tid, = index in the buffer
@@ -125,30 +471,101 @@ inline void DebugCpuReduction(const Buffer& buf, const dist::Euclidean functor,
     const auto node_idx = buf.u_leaf_idx[i];
     const auto q = buf.u_qs[i];
 
-    const auto node_addr = LntDataAddrAt(node_idx);
-    const auto addr = reinterpret_cast<KnnSet<float, 1>*>(results.GetAddrAt(i));
-
-    for (int j = 0; j < stored_max_leaf_size; ++j) {
-      const float dist = functor(node_addr[j], q);
-      addr->Insert(dist);
-    }
+    const auto node_addr = LntDataAddrAt<Dim, T>(node_idx);
+    const auto slot = results.u_results + i * results.stored_k;
+    reduce::ResetSlot<ReduceOp, T>(slot);
+    leaf::Reduce<ReduceOp>(functor, node_addr, LntLeafSize(node_idx), q, slot);
   }
 }
 
-inline void LaunchAsyncWorkQueue(const int tid, const int stream_id) {
-  const auto num_active = buffers[tid][stream_id].Size();
+template <typename ReduceOp, int Dim, typename T>
+void LaunchLeafReduction(const int tid, const int stream_id,
+                         const Buffer<Dim, T>& buf,
+                         const ResultBuffer<T>& results) {
+  static_assert(
+      redwood::IsKernelRegistered<LeafFunctor, ReduceOp, Point<Dim, T>>::value);
+  redwood::LaunchReduction<LeafFunctor, ReduceOp>(
+      tid, stream_id, LntBaseAddr<Dim, T>(tid), LntOffsetsAddr(tid), buf.u_qs,
+      buf.u_leaf_idx, buf.Size(), results.u_results);
+}
+
+template <int Dim, typename T>
+void LaunchAsyncWorkQueue(const int tid, const int stream_id) {
+  auto& buf = buffers<Dim, T>[tid][stream_id];
+  const auto num_active = buf.Size();
 
   if constexpr (kDebugMod) {
     std::cout << "rdc::LaunchAsyncWorkQueue "
               << "tid: " << tid << ", stream: " << stream_id << ", "
-              << buffers[tid][stream_id].Size() << " actives." << std::endl;
+              << buf.Size() << " actives." << std::endl;
     // 128? 256?
   }
 
-  dist::Euclidean functor{};
-  redwood::NearestNeighborKernel(
-      tid, stream_id, lnt_base_addr, stored_max_leaf_size,
-      buffers[tid][stream_id].u_qs, buffers[tid][stream_id].u_leaf_idx,
-      num_active, result_addr[tid][stream_id].underlying_dat, functor);
+  static_assert(
+      redwood::IsRadiusKernelRegistered<LeafFunctor, Point<Dim, T>>::value);
+
+  const auto& radius = radius_query<Dim, T>;
+  if (radius.enabled) {
+    auto& matches = match_buffers<Dim, T>[tid][stream_id];
+    redwood::LaunchRadiusSearch<LeafFunctor>(
+        tid, stream_id, LntBaseAddr<Dim, T>(tid), LntOffsetsAddr(tid),
+        buf.u_qs, buf.u_leaf_idx, num_active, radius.radius, matches.u_counts,
+        matches.u_matches, matches.stored_stride);
+    matches.ReadbackAsync(tid, stream_id, num_active);
+  } else {
+    // One of 'SlotSizeFor()'
+    auto& results = result_buffers<Dim, T>[tid][stream_id];
+    switch (results.stored_k) {
+      case 1:
+        LaunchLeafReduction<reduce::Min>(tid, stream_id, buf, results);
+        break;
+      case 4:
+        LaunchLeafReduction<reduce::TopK<4>>(tid, stream_id, buf, results);
+        break;
+      case 8:
+        LaunchLeafReduction<reduce::TopK<8>>(tid, stream_id, buf, results);
+        break;
+      case 16:
+        LaunchLeafReduction<reduce::TopK<16>>(tid, stream_id, buf, results);
+        break;
+      case 32:
+        LaunchLeafReduction<reduce::TopK<32>>(tid, stream_id, buf, results);
+        break;
+      case 64:
+        LaunchLeafReduction<reduce::TopK<64>>(tid, stream_id, buf, results);
+        break;
+      case 128:
+        LaunchLeafReduction<reduce::TopK<128>>(tid, stream_id, buf, results);
+        break;
+      default:
+        LaunchLeafReduction<reduce::TopK<256>>(tid, stream_id, buf, results);
+        break;
+    }
+    results.ReadbackAsync(tid, stream_id, num_active);
+  }
+
+  redwood::EventRecord(batch_done[tid][stream_id], tid, stream_id);
+}
+
+// Non-blocking, true if the last batch launched on this stream has finished
+_NODISCARD inline bool BatchFinished(const int tid, const int stream_id) {
+  return redwood::EventQuery(batch_done[tid][stream_id]);
+}
+
+inline void WaitBatch(const int tid, const int stream_id) {
+  redwood::EventSynchronize(batch_done[tid][stream_id]);
+}
+
+// All the results of the last batch launched on this stream, in host memory.
+// Valid once the batch has finished, until the next launch on the stream.
+template <int Dim, typename T>
+_NODISCARD ResultSpan<T> BatchResults(const int tid, const int stream_id) {
+  return result_buffers<Dim, T>[tid][stream_id].HostSpan();
+}
+
+// Same, after 'SetRadius()'
+template <int Dim, typename T>
+_NODISCARD MatchSpan BatchMatches(const int tid, const int stream_id) {
+  return match_buffers<Dim, T>[tid][stream_id].HostSpan();
 }
 }  // namespace rdc
@@ -0,0 +1,211 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <limits>
+#include <stdexcept>
+#include <string>
+
+#include "../Utils.hpp"
+#include "Redwood/Point.hpp"
+
+// How 'kdt::KdTree' splits a range of points. A policy is a type with
+//
+//   template <int Dim, typename T>
+//   static Split Choose(const Point<Dim, T>* data, const int* idx, int n,
+//                       int depth);
+//
+// where 'idx' are the indices in 'data' of the 'n' (at least 3) points of the
+// range. The tree then partitions the range on 'Split::axis' so that the
+// 'Split::mid' smallest points go to the left child, the next one is the
+// node's pivot and the rest go to the right child.
+
+namespace kdt {
+
+struct Split {
+  int axis;
+  int mid;
+};
+
+namespace detail {
+
+template <int Dim, typename T>
+struct Box {
+  std::array<T, Dim> lo;
+  std::array<T, Dim> hi;
+
+  _NODISCARD T Extent(const int axis) const { return hi[axis] - lo[axis]; }
+
+  _NODISCARD int WidestAxis() const {
+    auto axis = 0;
+    for (int d = 1; d < Dim; ++d) {
+      if (Extent(d) > Extent(axis)) axis = d;
+    }
+    return axis;
+  }
+
+  // Sum of the extents, i.e., the "surface" of a box in SAH-like costs
+  _NODISCARD T Margin() const {
+    auto margin = T(0);
+    for (int d = 0; d < Dim; ++d) margin += Extent(d);
+    return margin;
+  }
+};
+
+template <int Dim, typename T>
+Box<Dim, T> BoundingBox(const Point<Dim, T>* data, const int* idx,
+                        const int n) {
+  Box<Dim, T> box;
+  box.lo.fill(std::numeric_limits<T>::max());
+  box.hi.fill(std::numeric_limits<T>::lowest());
+  for (auto it = idx; it != idx + n; ++it) {
+    const auto& p = data[*it];
+    for (int d = 0; d < Dim; ++d) {
+      box.lo[d] = std::min(box.lo[d], p.data[d]);
+      box.hi[d] = std::max(box.hi[d], p.data[d]);
+    }
+  }
+  return box;
+}
+
+// Keeps at least one point on each side of the pivot
+inline int ClampMid(const int mid, const int n) {
+  return std::clamp(mid, 1, n - 2);
+}
+
+}  // namespace detail
+
+// Median, cycling through the axes. Balanced, but the cells get thin and
+// elongated on skewed data.
+struct MedianSplit {
+  template <int Dim, typename T>
+  static Split Choose(const Point<Dim, T>* data, const int* idx, const int n,
+                      const int depth) {
+    return {depth % Dim, (n - 1) / 2};
+  }
+};
+
+// Median on the axis along which the points are the most spread out
+struct MaxSpreadSplit {
+  template <int Dim, typename T>
+  static Split Choose(const Point<Dim, T>* data, const int* idx, const int n,
+                      const int depth) {
+    const auto box = detail::BoundingBox(data, idx, n);
+    return {box.WidestAxis(), (n - 1) / 2};
+  }
+};
+
+// Median on the axis of largest variance, less sensitive to outliers than the
+// spread
+struct MaxVarianceSplit {
+  template <int Dim, typename T>
+  static Split Choose(const Point<Dim, T>* data, const int* idx, const int n,
+                      const int depth) {
+    std::array<double, Dim> sum{};
+    std::array<double, Dim> sum_sqr{};
+    for (int i = 0; i < n; ++i) {
+      for (int d = 0; d < Dim; ++d) {
+        const double x = data[idx[i]].data[d];
+        sum[d] += x;
+        sum_sqr[d] += x * x;
+      }
+    }
+
+    auto axis = 0;
+    auto best = -1.0;
+    for (int d = 0; d < Dim; ++d) {
+      const auto mean = sum[d] / n;
+      const auto var = sum_sqr[d] / n - mean * mean;
+      if (var > best) {
+        best = var;
+        axis = d;
+      }
+    }
+    return {axis, (n - 1) / 2};
+  }
+};
+
+// Splits the widest side of the points' bounding box in the middle, sliding
+// the plane to the nearest point if one side would be empty. Cells stay fat,
+// at the cost of unbalanced subtrees.
+struct SlidingMidpointSplit {
+  template <int Dim, typename T>
+  static Split Choose(const Point<Dim, T>* data, const int* idx, const int n,
+                      const int depth) {
+    const auto box = detail::BoundingBox(data, idx, n);
+    const auto axis = box.WidestAxis();
+    const auto plane = (box.lo[axis] + box.hi[axis]) / 2;
+
+    auto num_left = 0;
+    for (int i = 0; i < n; ++i) {
+      if (data[idx[i]].data[axis] < plane) ++num_left;
+    }
+    return {axis, detail::ClampMid(num_left, n)};
+  }
+};
+
+// SAH-like: among a few planes per axis, takes the one minimizing
+// 'n_left * margin(left) + n_right * margin(right)', i.e., the expected number
+// of points reduced by a query landing in a random cell.
+struct CostSplit {
+  static constexpr int kNumBins = 16;
+
+  template <int Dim, typename T>
+  static Split Choose(const Point<Dim, T>* data, const int* idx, const int n,
+                      const int depth) {
+    const auto box = detail::BoundingBox(data, idx, n);
+
+    Split best{depth % Dim, (n - 1) / 2};
+    auto best_cost = std::numeric_limits<T>::max();
+    for (int axis = 0; axis < Dim; ++axis) {
+      const auto extent = box.Extent(axis);
+      if (!(extent > T(0))) continue;
+
+      std::array<int, kNumBins> bins{};
+      for (int i = 0; i < n; ++i) {
+        const auto t = (data[idx[i]].data[axis] - box.lo[axis]) / extent;
+        ++bins[std::min(static_cast<int>(t * kNumBins), kNumBins - 1)];
+      }
+
+      // Plane 'b' is between bins 'b - 1' and 'b'
+      auto num_left = 0;
+      for (int b = 1; b < kNumBins; ++b) {
+        num_left += bins[b - 1];
+        const auto plane = box.lo[axis] + extent * b / kNumBins;
+
+        auto left = box;
+        auto right = box;
+        left.hi[axis] = plane;
+        right.lo[axis] = plane;
+        const auto cost = static_cast<T>(num_left) * left.Margin() +
+                          static_cast<T>(n - num_left) * right.Margin();
+        if (cost < best_cost) {
+          best_cost = cost;
+          best = {axis, detail::ClampMid(num_left, n)};
+        }
+      }
+    }
+    return best;
+  }
+};
+
+// Calls 'visitor' with the policy named 'name' (median, max_spread,
+// max_variance, sliding_midpoint, cost)
+template <typename Visitor>
+void WithSplitPolicy(const std::string& name, Visitor&& visitor) {
+  if (name == "median") {
+    visitor(MedianSplit{});
+  } else if (name == "max_spread") {
+    visitor(MaxSpreadSplit{});
+  } else if (name == "max_variance") {
+    visitor(MaxVarianceSplit{});
+  } else if (name == "sliding_midpoint") {
+    visitor(SlidingMidpointSplit{});
+  } else if (name == "cost") {
+    visitor(CostSplit{});
+  } else {
+    throw std::runtime_error("Error: unknown split policy '" + name + "'.");
+  }
+}
+
+}  // namespace kdt
@@ -0,0 +1,95 @@
+#include <gtest/gtest.h>
+
+#include <array>
+#include <vector>
+
+#include "../DualTree.hpp"
+#include "../KDTree.hpp"
+#include "../QueryEngine.hpp"
+#include "Redwood/Point.hpp"
+#include "TestUtils.hpp"
+
+namespace {
+
+constexpr int kNumPoints = 5000;
+
+using Tree = kdt::KdTree<3, double>;
+
+// Two threads, three streams of small batches, so the streams are rotated and
+// drained many times
+class DualTreeTest : public test::TreeTest<3, double> {
+ protected:
+  static void SetUpTestSuite() { SetUpTree(kNumPoints, 8, 2, 16, 3); }
+
+  template <int K>
+  static void ExpectSame(const std::array<Neighbor<double>, K>& res,
+                         const std::array<Neighbor<double>, K>& expected,
+                         const int i) {
+    for (int j = 0; j < K; ++j) {
+      EXPECT_EQ(res[j].dist, expected[j].dist) << "query " << i << ", " << j;
+      EXPECT_EQ(res[j].id, expected[j].id) << "query " << i << ", " << j;
+    }
+  }
+};
+
+}  // namespace
+
+TEST_F(DualTreeTest, BichromaticSameAsBruteForce) {
+  const auto queries = MakeQueries(1000);
+
+  DualTreeKnn<Tree> join(*tree_);
+  const auto results = join.Run(queries);
+  ASSERT_EQ(results.size(), queries.size());
+  for (std::size_t i = 0; i < queries.size(); ++i) {
+    ExpectSame<1>(results[i], BruteForce<1>(queries[i]), static_cast<int>(i));
+  }
+
+  // Not a trivial test, whole groups of queries skip subtrees, and far fewer
+  // leaves are reduced than with no pruning
+  const auto stats = join.Stats();
+  EXPECT_EQ(stats.num_queries, queries.size());
+  EXPECT_GT(stats.num_pruned, 0u);
+  EXPECT_LT(stats.num_leaves, queries.size() * 10);
+}
+
+// Each point only pushes the leaves still in range of its current bound, the
+// group pruning and the seeds save more than a single-tree search does
+TEST_F(DualTreeTest, FewerLeavesThanSingleTree) {
+  const auto queries = MakeQueries(1000);
+
+  QueryEngine<Tree> engine;
+  const auto expected = engine.Run(queries);
+
+  DualTreeKnn<Tree> join(*tree_);
+  const auto results = join.Run(queries);
+  for (std::size_t i = 0; i < queries.size(); ++i) {
+    EXPECT_EQ(results[i][0].dist, expected[i].dist) << "query " << i;
+  }
+  EXPECT_LT(join.Stats().num_leaves, engine.Stats().num_leaves);
+}
+
+TEST_F(DualTreeTest, Knn) {
+  const auto queries = MakeQueries(300, 42);
+
+  DualTreeKnn<Tree, 4> join(*tree_);
+  const auto results = join.Run(queries);
+  for (std::size_t i = 0; i < queries.size(); ++i) {
+    ExpectSame<4>(results[i], BruteForce<4>(queries[i]), static_cast<int>(i));
+  }
+}
+
+TEST_F(DualTreeTest, SelfJoinExcludesItself) {
+  DualTreeKnn<Tree, 3> join(*tree_);
+  const auto results = join.SelfJoin();
+  ASSERT_EQ(results.size(), static_cast<std::size_t>(kNumPoints));
+  for (int id = 0; id < kNumPoints; ++id) {
+    ExpectSame<3>(results[id], BruteForce<3>(data_[id], id), id);
+  }
+
+  // The join is reusable
+  EXPECT_TRUE(join.Run({}).empty());
+  const auto again = join.SelfJoin();
+  for (int id = 0; id < kNumPoints; ++id) {
+    EXPECT_EQ(again[id][0].id, results[id][0].id);
+  }
+}
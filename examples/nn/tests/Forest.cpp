@@ -0,0 +1,117 @@
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "../Executor.hpp"
+#include "../Forest.hpp"
+#include "../GlobalVars.hpp"
+#include "Functors/DistanceMetrics.hpp"
+#include "Redwood/Point.hpp"
+#include "Redwood/Usm.hpp"
+#include "TestUtils.hpp"
+
+namespace {
+
+template <typename PointT>
+class ForestTest : public ::testing::Test {
+ protected:
+  static constexpr int Dim = PointT::kDims;
+  using T = typename PointT::Scalar;
+
+  static void SetUpTestSuite() { rdc::Init<Dim, T>(1, 16, 1); }
+
+  void Insert(const std::vector<PointT>& points, const int batch) {
+    for (int i = 0; i < static_cast<int>(points.size()); i += batch) {
+      const auto n = std::min(batch, static_cast<int>(points.size()) - i);
+      for (const auto id : forest_.Insert(points.data() + i, n)) {
+        points_.resize(id + 1);
+        live_.resize(id + 1);
+        points_[id] = points[id - first_id_];
+        live_[id] = true;
+      }
+      forest_.Poll();
+    }
+    first_id_ += static_cast<int>(points.size());
+  }
+
+  void Remove(const std::vector<int>& ids) {
+    forest_.Remove(ids);
+    for (const auto id : ids) live_[id] = false;
+  }
+
+  // Every query against a brute force search of the live points
+  void ExpectSameAsBruteForce() {
+    forest_.Sync();
+    query_trees<Dim, T> = forest_.Trees();
+
+    Executor<dist::Euclidean, Dim, T> exe(0, 0, 0);
+    for (const auto& q : test::MakePoints<PointT>(200, test::kQuerySeed)) {
+      const auto expected = test::BruteForceKnn<1>(
+          points_, q, [this](const int id) { return !live_[id]; })[0];
+
+      exe.SetQuery({0, q});
+      ASSERT_EQ(exe.CpuTraverse(), expected.dist);
+      EXPECT_EQ(exe.Nearest().id, expected.id);
+    }
+  }
+
+  kdt::Forest<Dim, T> forest_{kdt::KdtParams{16, 1}, 256};
+  std::vector<PointT> points_;
+  std::vector<bool> live_;
+  int first_id_ = 0;
+};
+
+using PointTypes = ::testing::Types<Point4F, Point3F, Point2D>;
+TYPED_TEST_SUITE(ForestTest, PointTypes);
+
+}  // namespace
+
+TYPED_TEST(ForestTest, Inserts) {
+  this->Insert(test::MakePoints<TypeParam>(3000, test::kDataSeed), 300);
+  EXPECT_EQ(this->forest_.Size(), 3000);
+  // 3000 points in slots of 256, 512, 1024, ...: at most one tree per bit
+  EXPECT_LE(this->forest_.Trees().size(), 4u);
+  this->ExpectSameAsBruteForce();
+}
+
+TYPED_TEST(ForestTest, RemovesAreNotFound) {
+  this->Insert(test::MakePoints<TypeParam>(3000, test::kDataSeed), 300);
+
+  // Both leaf points and pivots
+  std::vector<int> ids;
+  for (int id = 0; id < 3000; id += 3) ids.push_back(id);
+  this->Remove(ids);
+  EXPECT_EQ(this->forest_.Size(), 2000);
+  this->ExpectSameAsBruteForce();
+}
+
+TYPED_TEST(ForestTest, RemovesDuringMergeAndAfter) {
+  this->Insert(test::MakePoints<TypeParam>(1000, test::kDataSeed), 1000);
+
+  // Still merging, then merged again with newer points
+  this->Remove({1, 2, 3, 500, 999});
+  this->Insert(test::MakePoints<TypeParam>(2000, 42), 250);
+  this->Remove({1000, 1500, 2999, 3});
+  EXPECT_EQ(this->forest_.Size(), 3000 - 8);
+  this->ExpectSameAsBruteForce();
+}
+
+// The forest reallocates the table as it grows, the old ones must not leak
+TEST(LeafNodeTableTest, ReplacesThePreviousOne) {
+  (void)rdc::AllocateLnt<4, float>(100, 1000);
+  const auto in_use = redwood::GetUsmStats().bytes_in_use;
+
+  (void)rdc::AllocateLnt<4, float>(100, 1000);
+  EXPECT_EQ(redwood::GetUsmStats().bytes_in_use, in_use);
+
+  // Also across point types, there is a single table
+  (void)rdc::AllocateLnt<2, double>(100, 1000);
+  (void)rdc::AllocateLnt<4, float>(100, 1000);
+  EXPECT_EQ(redwood::GetUsmStats().bytes_in_use, in_use);
+
+  rdc::FreeLnt<4, float>();
+  EXPECT_LT(redwood::GetUsmStats().bytes_in_use, in_use);
+  EXPECT_EQ((rdc::lnt_base_addr<4, float>), nullptr);
+  EXPECT_EQ((rdc::lnt_base_addr<2, double>), nullptr);
+}
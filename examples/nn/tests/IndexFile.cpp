@@ -0,0 +1,189 @@
+#include <gtest/gtest.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "../IndexFile.hpp"
+#include "../KDTree.hpp"
+#include "Redwood/Point.hpp"
+
+namespace {
+
+using Tree = kdt::KdTree<4, float>;
+
+std::vector<Point4F> MakeData(const int n) {
+  std::mt19937 gen(114514);
+  std::uniform_real_distribution<float> dis(0.0f, 1024.0f);
+
+  std::vector<Point4F> data(n);
+  for (auto& p : data) {
+    for (auto& x : p.data) x = dis(gen);
+  }
+  return data;
+}
+
+template <typename T>
+bool SameBytes(const std::vector<T>& a, const T* b, const int n) {
+  return static_cast<int>(a.size()) == n &&
+         std::memcmp(a.data(), b, n * sizeof(T)) == 0;
+}
+
+class IndexFileTest : public ::testing::Test {
+ protected:
+  // Built once, reused by all the tests
+  static void SetUpTestSuite() {
+    data_ = new std::vector<Point4F>(MakeData(5000));
+    tree_ = new Tree(kdt::KdtParams{16, 1, kdt::Layout::kEytzinger},
+                     data_->data(), static_cast<int>(data_->size()),
+                     kdt::SlidingMidpointSplit{});
+
+    lnt_ = new std::vector<Point4F>(tree_->NumLeafPoints());
+    lnt_offsets_ = new std::vector<int>(tree_->GetStats().num_leaf_nodes + 1);
+    tree_->LoadPayload(lnt_->data(), lnt_offsets_->data());
+  }
+
+  static void TearDownTestSuite() {
+    delete lnt_offsets_;
+    delete lnt_;
+    delete tree_;
+    delete data_;
+  }
+
+  void SetUp() override {
+    path_ = ::testing::TempDir() + "index_file_test.idx";
+    kdt::SaveIndex(path_, *tree_, lnt_->data(), lnt_offsets_->data());
+  }
+
+  void TearDown() override { std::remove(path_.c_str()); }
+
+  // Overwrites 'size' bytes at 'offset' of the saved file
+  void Patch(const std::size_t offset, const void* bytes,
+             const std::size_t size) const {
+    std::fstream file(path_, std::ios::binary | std::ios::in | std::ios::out);
+    file.seekp(static_cast<std::streamoff>(offset));
+    file.write(static_cast<const char*>(bytes),
+               static_cast<std::streamsize>(size));
+  }
+
+  static std::vector<Point4F>* data_;
+  static Tree* tree_;
+  static std::vector<Point4F>* lnt_;
+  static std::vector<int>* lnt_offsets_;
+
+  std::string path_;
+};
+
+std::vector<Point4F>* IndexFileTest::data_ = nullptr;
+Tree* IndexFileTest::tree_ = nullptr;
+std::vector<Point4F>* IndexFileTest::lnt_ = nullptr;
+std::vector<int>* IndexFileTest::lnt_offsets_ = nullptr;
+
+}  // namespace
+
+TEST_F(IndexFileTest, RoundTrip) {
+  const kdt::MappedIndex index(path_);
+  const auto tree = kdt::LoadTree<4, float>(index);
+
+  EXPECT_EQ(tree.GetParams().leaf_max_size, 16);
+  EXPECT_EQ(tree.GetParams().layout, kdt::Layout::kEytzinger);
+  EXPECT_EQ(tree.GetStats().num_leaf_nodes, tree_->GetStats().num_leaf_nodes);
+  EXPECT_EQ(tree.GetStats().num_branch_nodes,
+            tree_->GetStats().num_branch_nodes);
+  EXPECT_EQ(tree.GetStats().max_depth, tree_->GetStats().max_depth);
+  EXPECT_EQ(tree.NumLeafPoints(), tree_->NumLeafPoints());
+
+  EXPECT_TRUE(SameBytes(tree_->nodes_, tree.nodes_.data(),
+                        static_cast<int>(tree.nodes_.size())));
+  EXPECT_TRUE(SameBytes(tree_->pivots_, tree.pivots_.data(),
+                        static_cast<int>(tree.pivots_.size())));
+  EXPECT_EQ(tree_->v_acc_, tree.v_acc_);
+
+  std::vector<Point4F> lnt(index.NumLeafPoints());
+  std::vector<int> lnt_offsets(index.Header().num_leaf_nodes + 1);
+  index.CopyLnt(lnt.data(), lnt_offsets.data());
+  EXPECT_TRUE(SameBytes(*lnt_, lnt.data(), static_cast<int>(lnt.size())));
+  EXPECT_EQ(*lnt_offsets_, lnt_offsets);
+
+  // In place, without copies
+  const auto u_lnt = index.Section<Point4F>(kdt::kLnt);
+  EXPECT_EQ(reinterpret_cast<std::uintptr_t>(u_lnt) % kdt::kIndexAlignment,
+            0u);
+  EXPECT_TRUE(SameBytes(*lnt_, u_lnt, index.NumLeafPoints()));
+}
+
+TEST_F(IndexFileTest, RejectsOtherVersions) {
+  const auto version = kdt::kIndexVersion + 1;
+  Patch(offsetof(kdt::IndexHeader, version), &version, sizeof(version));
+  EXPECT_THROW(kdt::MappedIndex{path_}, std::runtime_error);
+}
+
+TEST_F(IndexFileTest, RejectsOtherFiles) {
+  const char garbage[] = "not an index";
+  Patch(0, garbage, sizeof(garbage));
+  EXPECT_THROW(kdt::MappedIndex{path_}, std::runtime_error);
+  EXPECT_THROW(kdt::MappedIndex{path_ + ".missing"}, std::runtime_error);
+}
+
+TEST_F(IndexFileTest, RejectsTruncatedFiles) {
+  {
+    const kdt::MappedIndex index(path_);
+    const auto& header = index.Header();
+    std::ofstream(path_ + ".cut", std::ios::binary)
+        .write(reinterpret_cast<const char*>(&header),
+               static_cast<std::streamsize>(header.offsets[kdt::kLnt]));
+  }
+  EXPECT_THROW(kdt::MappedIndex{path_ + ".cut"}, std::runtime_error);
+  std::remove((path_ + ".cut").c_str());
+}
+
+TEST_F(IndexFileTest, RejectsCorruptLeafNodeTables) {
+  uint64_t lnt_offsets_at;
+  uint64_t lnt_size;
+  {
+    const kdt::MappedIndex index(path_);
+    lnt_offsets_at = index.Header().offsets[kdt::kLntOffsets];
+    lnt_size = index.Header().sizes[kdt::kLnt];
+  }
+
+  // Fewer points than the leaves hold, in a file still long enough
+  const auto smaller = lnt_size - sizeof(Point4F);
+  Patch(offsetof(kdt::IndexHeader, sizes) + kdt::kLnt * sizeof(uint64_t),
+        &smaller, sizeof(smaller));
+  EXPECT_THROW(kdt::MappedIndex{path_}, std::runtime_error);
+  Patch(offsetof(kdt::IndexHeader, sizes) + kdt::kLnt * sizeof(uint64_t),
+        &lnt_size, sizeof(lnt_size));
+  EXPECT_NO_THROW(kdt::MappedIndex{path_});
+
+  // A leaf starting before the previous one
+  const auto& offsets = *lnt_offsets_;
+  const auto backwards = offsets[1] - 1;
+  Patch(lnt_offsets_at + 2 * sizeof(int), &backwards, sizeof(backwards));
+  EXPECT_THROW(kdt::MappedIndex{path_}, std::runtime_error);
+  Patch(lnt_offsets_at + 2 * sizeof(int), &offsets[2], sizeof(int));
+
+  // The last leaf ending past the table
+  const auto past_end = offsets.back() + 1;
+  Patch(lnt_offsets_at + (offsets.size() - 1) * sizeof(int), &past_end,
+        sizeof(past_end));
+  EXPECT_THROW(kdt::MappedIndex{path_}, std::runtime_error);
+}
+
+TEST_F(IndexFileTest, RejectsOtherPointTypes) {
+  const kdt::MappedIndex index(path_);
+  EXPECT_EQ(index.Header().dims, 4u);
+  EXPECT_EQ(index.Header().scalar_size, sizeof(float));
+
+  EXPECT_THROW((kdt::LoadTree<3, float>(index)), std::runtime_error);
+  EXPECT_THROW((kdt::LoadTree<4, double>(index)), std::runtime_error);
+
+  std::vector<Point2D> lnt(index.NumLeafPoints());
+  std::vector<int> lnt_offsets(index.Header().num_leaf_nodes + 1);
+  EXPECT_THROW(index.CopyLnt(lnt.data(), lnt_offsets.data()),
+               std::runtime_error);
+}
@@ -0,0 +1,328 @@
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <random>
+#include <stdexcept>
+#include <vector>
+
+#include "../KDTree.hpp"
+#include "Redwood/Point.hpp"
+
+namespace {
+
+using Tree = kdt::KdTree<4, float>;
+
+std::vector<Point4F> MakeData(const int n, const bool with_ties) {
+  std::mt19937 gen(114514);
+  std::uniform_real_distribution<float> dis(0.0f, 1024.0f);
+
+  std::vector<Point4F> data(n);
+  for (auto& p : data) {
+    for (auto& x : p.data) {
+      // Few distinct values, so a lot of points are equal on the split axis
+      x = with_ties ? static_cast<float>(static_cast<int>(dis(gen)) % 8)
+                    : dis(gen);
+    }
+  }
+  return data;
+}
+
+void ExpectSameNodes(const Tree& a, const Tree& b) {
+  ASSERT_EQ(a.nodes_.size(), b.nodes_.size());
+
+  for (std::size_t i = 0; i < a.nodes_.size(); ++i) {
+    const auto& na = a.nodes_[i];
+    const auto& nb = b.nodes_[i];
+    ASSERT_EQ(na.IsLeaf(), nb.IsLeaf());
+
+    if (na.IsLeaf()) {
+      EXPECT_EQ(na.uid, nb.uid);
+      EXPECT_EQ(na.node_type.leaf.idx_left, nb.node_type.leaf.idx_left);
+      EXPECT_EQ(na.node_type.leaf.idx_right, nb.node_type.leaf.idx_right);
+    } else {
+      EXPECT_EQ(na.axis, nb.axis);
+      EXPECT_EQ(na.split, nb.split);
+      EXPECT_EQ(na.node_type.tree.left_child, nb.node_type.tree.left_child);
+      EXPECT_EQ(na.node_type.tree.right_child, nb.node_type.tree.right_child);
+    }
+  }
+}
+
+// Children by index, depth first: every node is reached exactly once
+template <int Dim, typename T>
+int CountReachable(const kdt::KdTree<Dim, T>& tree, const int node_idx) {
+  const auto& node = tree.GetNode(node_idx);
+  if (node.IsLeaf()) return 1;
+  return 1 + CountReachable(tree, node.GetChild(kdt::Dir::kLeft)) +
+         CountReachable(tree, node.GetChild(kdt::Dir::kRight));
+}
+
+void ExpectSameBuild(const std::vector<Point4F>& data, const int num_threads) {
+  const Tree sequential(kdt::KdtParams{32, 1}, data.data(),
+                        static_cast<int>(data.size()));
+  const Tree parallel(kdt::KdtParams{32, num_threads}, data.data(),
+                      static_cast<int>(data.size()));
+
+  const auto seq_stats = sequential.GetStats();
+  const auto par_stats = parallel.GetStats();
+  EXPECT_EQ(seq_stats.num_leaf_nodes, par_stats.num_leaf_nodes);
+  EXPECT_EQ(seq_stats.num_branch_nodes, par_stats.num_branch_nodes);
+  EXPECT_EQ(seq_stats.max_depth, par_stats.max_depth);
+  EXPECT_EQ(sequential.v_acc_, parallel.v_acc_);
+
+  ExpectSameNodes(sequential, parallel);
+
+  EXPECT_EQ(CountReachable(parallel, Tree::kRoot),
+            static_cast<int>(parallel.nodes_.size()));
+  EXPECT_EQ(seq_stats.num_leaf_nodes + seq_stats.num_branch_nodes,
+            static_cast<int>(sequential.nodes_.size()));
+}
+
+// What the traversals see, in depth first order whatever the layout
+struct Walk {
+  void Visit(const Tree& tree, const int node_idx) {
+    const auto& node = tree.GetNode(node_idx);
+    if (node.IsLeaf()) {
+      leaves.push_back(node.uid);
+      return;
+    }
+
+    axes.push_back(node.axis);
+    splits.push_back(node.split);
+    Visit(tree, tree.Child(node_idx, kdt::Dir::kLeft));
+    Visit(tree, tree.Child(node_idx, kdt::Dir::kRight));
+  }
+
+  std::vector<int> axes;
+  std::vector<float> splits;
+  std::vector<int> leaves;
+};
+
+// Every point is either a pivot or in one leaf, and is on the side of the
+// splits of its ancestors it belongs to.
+template <int Dim, typename T>
+struct Check {
+  void Visit(const kdt::KdTree<Dim, T>& tree, const int node_idx) {
+    const auto& node = tree.GetNode(node_idx);
+    if (node.IsLeaf()) {
+      for (auto i = node.node_type.leaf.idx_left;
+           i <= node.node_type.leaf.idx_right; ++i) {
+        CheckPoint(tree.in_data_ref_[tree.v_acc_[i]]);
+        ++seen[tree.v_acc_[i]];
+      }
+      return;
+    }
+
+    CheckPoint(tree.GetPivot(node_idx));
+    ++num_pivots;
+
+    ancestors.push_back({node.axis, node.split, kdt::Dir::kLeft});
+    Visit(tree, tree.Child(node_idx, kdt::Dir::kLeft));
+    ancestors.back().dir = kdt::Dir::kRight;
+    Visit(tree, tree.Child(node_idx, kdt::Dir::kRight));
+    ancestors.pop_back();
+  }
+
+  void CheckPoint(const Point<Dim, T>& p) const {
+    for (const auto& a : ancestors) {
+      if (a.dir == kdt::Dir::kLeft) {
+        ASSERT_LE(p.data[a.axis], a.split);
+      } else {
+        ASSERT_GE(p.data[a.axis], a.split);
+      }
+    }
+  }
+
+  struct Ancestor {
+    int axis;
+    T split;
+    kdt::Dir dir;
+  };
+
+  std::vector<Ancestor> ancestors;
+  std::vector<int> seen;
+  int num_pivots = 0;
+};
+
+template <int Dim, typename T>
+std::vector<Point<Dim, T>> MakeOtherData(const int n) {
+  std::mt19937 gen(1919810);
+  std::uniform_real_distribution<T> dis(0, 1024);
+
+  std::vector<Point<Dim, T>> data(n);
+  for (auto& p : data) {
+    for (auto& x : p.data) x = dis(gen);
+  }
+  return data;
+}
+
+template <int Dim, typename T>
+void ExpectValidTree(const kdt::KdtParams params) {
+  const auto data = MakeOtherData<Dim, T>(20000);
+  const auto n = static_cast<int>(data.size());
+  const kdt::KdTree<Dim, T> tree(params, data.data(), n);
+
+  Check<Dim, T> check;
+  check.seen.assign(n, 0);
+  check.Visit(tree, kdt::KdTree<Dim, T>::kRoot);
+
+  const auto in_leaves =
+      static_cast<int>(std::count(check.seen.begin(), check.seen.end(), 1));
+  EXPECT_EQ(in_leaves + check.num_pivots, n);
+  EXPECT_EQ(CountReachable(tree, kdt::KdTree<Dim, T>::kRoot),
+            static_cast<int>(tree.nodes_.size()));
+}
+
+}  // namespace
+
+TEST(KdTreeTest, ParallelBuildIsDeterministic) {
+  ExpectSameBuild(MakeData(100000, false), 4);
+}
+
+TEST(KdTreeTest, ParallelBuildWithTies) {
+  ExpectSameBuild(MakeData(100000, true), 3);
+}
+
+TEST(KdTreeTest, SmallerThanOneLeaf) {
+  ExpectSameBuild(MakeData(20, false), 4);
+}
+
+TEST(KdTreeTest, LayoutsHoldTheSameTree) {
+  // 1100 points, so the leaves are on two different levels
+  const auto data = MakeData(1100, false);
+  const auto n = static_cast<int>(data.size());
+
+  std::vector<Walk> walks;
+  for (const auto layout : {kdt::Layout::kDepthFirst, kdt::Layout::kEytzinger,
+                            kdt::Layout::kVanEmdeBoas}) {
+    const Tree tree(kdt::KdtParams{32, 1, layout}, data.data(), n);
+    walks.emplace_back();
+    walks.back().Visit(tree, Tree::kRoot);
+  }
+
+  ASSERT_FALSE(walks[0].leaves.empty());
+  for (int i = 1; i < static_cast<int>(walks.size()); ++i) {
+    EXPECT_EQ(walks[0].axes, walks[i].axes);
+    EXPECT_EQ(walks[0].splits, walks[i].splits);
+    EXPECT_EQ(walks[0].leaves, walks[i].leaves);
+  }
+}
+
+// Command line names of the layouts and of the leaf table placements
+TEST(KdTreeTest, ParsesTheOptionNames) {
+  EXPECT_EQ(kdt::ParseLayout("dfs"), kdt::Layout::kDepthFirst);
+  EXPECT_EQ(kdt::ParseLayout("eytzinger"), kdt::Layout::kEytzinger);
+  EXPECT_EQ(kdt::ParseLayout("veb"), kdt::Layout::kVanEmdeBoas);
+  EXPECT_THROW(kdt::ParseLayout("bfs"), std::runtime_error);
+
+  using redwood::numa::Placement;
+  EXPECT_EQ(redwood::numa::ParsePlacement("first_touch"),
+            Placement::kFirstTouch);
+  EXPECT_EQ(redwood::numa::ParsePlacement("interleave"),
+            Placement::kInterleave);
+  EXPECT_EQ(redwood::numa::ParsePlacement("replicate"), Placement::kReplicate);
+  EXPECT_THROW(redwood::numa::ParsePlacement("first-touch"),
+               std::runtime_error);
+}
+
+TEST(KdTreeTest, SplitPoliciesBuildValidTrees) {
+  for (const auto with_ties : {false, true}) {
+    const auto data = MakeData(20000, with_ties);
+    const auto n = static_cast<int>(data.size());
+
+    for (const auto* name : {"median", "max_spread", "max_variance",
+                             "sliding_midpoint", "cost"}) {
+      SCOPED_TRACE(name);
+      kdt::WithSplitPolicy(name, [&](const auto policy) {
+        const Tree tree(kdt::KdtParams{32, 4}, data.data(), n, policy);
+
+        Check<4, float> check;
+        check.seen.assign(n, 0);
+        check.Visit(tree, Tree::kRoot);
+
+        // The pivots are not in 'v_acc_' ranges of the leaves
+        const auto in_leaves =
+            static_cast<int>(std::count(check.seen.begin(),
+                                        check.seen.end(), 1));
+        EXPECT_EQ(in_leaves + check.num_pivots, n);
+        EXPECT_EQ(std::count_if(check.seen.begin(), check.seen.end(),
+                                [](const int c) { return c > 1; }),
+                  0);
+        EXPECT_EQ(CountReachable(tree, Tree::kRoot),
+                  static_cast<int>(tree.nodes_.size()));
+      });
+    }
+  }
+
+  EXPECT_THROW(kdt::WithSplitPolicy("nope", [](auto) {}), std::runtime_error);
+}
+
+TEST(KdTreeTest, OtherPointTypesBuildValidTrees) {
+  ExpectValidTree<2, float>(kdt::KdtParams{32, 4});
+  ExpectValidTree<3, float>(kdt::KdtParams{16, 1});
+  ExpectValidTree<3, double>(kdt::KdtParams{32, 4, kdt::Layout::kEytzinger});
+  ExpectValidTree<4, double>(kdt::KdtParams{8, 2});
+}
+
+TEST(KdTreeTest, LeavesFitInLeafMaxSize) {
+  const auto data = MakeData(10000, false);
+  const auto n = static_cast<int>(data.size());
+
+  for (const auto leaf_max_size : {2, 7, 32}) {
+    const Tree tree(kdt::KdtParams{leaf_max_size, 1}, data.data(), n,
+                    kdt::SlidingMidpointSplit{});
+
+    // What 'LoadPayload()' packs into the leaf node table
+    auto num_leaf_points = 0;
+    for (const auto& node : tree.nodes_) {
+      if (!node.IsLeaf()) continue;
+      const auto size =
+          node.node_type.leaf.idx_right - node.node_type.leaf.idx_left + 1;
+      EXPECT_GE(size, 1);
+      EXPECT_LE(size, leaf_max_size);
+      num_leaf_points += size;
+    }
+    EXPECT_EQ(num_leaf_points, tree.NumLeafPoints());
+  }
+
+  // No room for a branch node's pivot and its two sides
+  for (const auto leaf_max_size : {-1, 0, 1}) {
+    EXPECT_THROW(kdt::KdtParams{leaf_max_size}, std::runtime_error);
+  }
+}
+
+TEST(KdTreeTest, TreesLoadTheirOwnPayload) {
+  // Built and loaded together, e.g., several indexes in one process
+  const auto data_a = MakeData(5000, false);
+  const auto data_b = MakeData(3000, true);
+  const Tree a(kdt::KdtParams{16, 4}, data_a.data(),
+               static_cast<int>(data_a.size()));
+  const Tree b(kdt::KdtParams{8, 3, kdt::Layout::kVanEmdeBoas}, data_b.data(),
+               static_cast<int>(data_b.size()));
+
+  for (const auto* tree : {&a, &b}) {
+    const auto num_leaves = tree->GetStats().num_leaf_nodes;
+    std::vector<Point4F> lnt(tree->NumLeafPoints());
+    std::vector<int> lnt_offsets(num_leaves + 1);
+    tree->LoadPayload(lnt.data(), lnt_offsets.data());
+
+    EXPECT_EQ(lnt_offsets[0], 0);
+    EXPECT_EQ(lnt_offsets[num_leaves], tree->NumLeafPoints());
+
+    std::vector<int> seen(num_leaves, 0);
+    for (const auto& node : tree->nodes_) {
+      if (!node.IsLeaf() || node.uid < 0) continue;
+      ASSERT_LT(node.uid, num_leaves);
+      ++seen[node.uid];
+
+      const auto& leaf = node.node_type.leaf;
+      ASSERT_EQ(lnt_offsets[node.uid + 1] - lnt_offsets[node.uid],
+                leaf.idx_right - leaf.idx_left + 1);
+      for (auto i = leaf.idx_left; i <= leaf.idx_right; ++i) {
+        EXPECT_EQ(lnt[lnt_offsets[node.uid] + i - leaf.idx_left],
+                  tree->in_data_ref_[tree->v_acc_[i]]);
+      }
+    }
+    EXPECT_EQ(std::count(seen.begin(), seen.end(), 1), num_leaves);
+  }
+}
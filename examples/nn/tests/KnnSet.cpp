@@ -0,0 +1,66 @@
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <limits>
+#include <random>
+#include <vector>
+
+#include "../KnnSet.hpp"
+
+namespace {
+
+// Against sorting everything, with duplicated distances
+template <int K>
+void ExpectSameAsSort(const int n) {
+  std::mt19937 gen(114514 + n);
+  std::uniform_int_distribution<int> dis(0, 4 * n);
+
+  std::vector<Neighbor<float>> all(n);
+  for (int i = 0; i < n; ++i) all[i] = {static_cast<float>(dis(gen)), i};
+
+  KnnSet<float, K> set;
+  set.Reset();
+  for (const auto& neighbor : all) set.Insert(neighbor.dist, neighbor.id);
+
+  auto expected = all;
+  std::stable_sort(expected.begin(), expected.end());
+  const auto sorted = set.Sorted();
+  for (int i = 0; i < K; ++i) {
+    if (i < n) {
+      ASSERT_EQ(sorted[i].dist, expected[i].dist) << "K=" << K << " i=" << i;
+      // Ties can be any of them
+      EXPECT_EQ(all[sorted[i].id].dist, sorted[i].dist);
+    } else {
+      EXPECT_EQ(sorted[i].dist, std::numeric_limits<float>::max());
+      EXPECT_EQ(sorted[i].id, -1);
+    }
+  }
+  EXPECT_EQ(set.WorstDist(), sorted[K - 1].dist);
+}
+
+}  // namespace
+
+TEST(KnnSetTest, SameAsSort) {
+  for (const auto n : {0, 1, 5, 31, 32, 33, 1000}) {
+    ExpectSameAsSort<1>(n);
+    ExpectSameAsSort<2>(n);
+    ExpectSameAsSort<7>(n);
+    ExpectSameAsSort<32>(n);
+    ExpectSameAsSort<256>(n);
+  }
+}
+
+TEST(KnnSetTest, IdsFollowTheirDistances) {
+  KnnSet<double, 4> set;
+  set.Reset();
+  for (const auto id : {5, 3, 8, 1, 9, 2}) set.Insert(id * 0.5, id);
+
+  const auto sorted = set.Sorted();
+  for (int i = 0; i < 4; ++i) EXPECT_EQ(sorted[i].dist, sorted[i].id * 0.5);
+  EXPECT_EQ(sorted[0].id, 1);
+  EXPECT_EQ(sorted[3].id, 5);
+
+  // Not better than the worst
+  set.Insert(2.5, 100);
+  EXPECT_EQ(set.Sorted()[3].id, 5);
+}
@@ -0,0 +1,216 @@
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <vector>
+
+#include "../../Utils.hpp"
+#include "Functors/LeafKernels.hpp"
+#include "Functors/ReduceOps.hpp"
+#include "Redwood/Point.hpp"
+
+_NODISCARD inline Point4F RandPoint() {
+  Point4F p;
+  p.data[0] = MyRand(0, 1024);
+  p.data[1] = MyRand(0, 1024);
+  p.data[2] = MyRand(0, 1024);
+  p.data[3] = MyRand(0, 1024);
+  return p;
+}
+
+// SIMD versions must be bit-identical to 'dist::Euclidean'
+void ExpectSameAsScalar(const leaf::MinDistFunc impl) {
+  for (int n = 1; n <= 100; ++n) {
+    std::vector<Point4F> leaf_data(n);
+    for (auto& p : leaf_data) p = RandPoint();
+    const auto q = RandPoint();
+
+    const auto expected = leaf::MinEuclideanScalar(leaf_data.data(), n, q);
+    const auto actual = impl(leaf_data.data(), n, q);
+    EXPECT_EQ(0, std::memcmp(&expected, &actual, sizeof(float))) << "n=" << n;
+  }
+}
+
+TEST(LeafKernelTest, Dispatch) {
+  std::vector<Point4F> leaf_data(64);
+  for (auto& p : leaf_data) p = RandPoint();
+  const auto q = RandPoint();
+
+  EXPECT_EQ(leaf::MinEuclidean(leaf_data.data(), 64, q),
+            leaf::MinEuclideanScalar(leaf_data.data(), 64, q));
+}
+
+TEST(LeafKernelTest, PaddingOnly) {
+  std::vector<Point4F> leaf_data(32);
+  for (auto& p : leaf_data) p.data[0] = std::numeric_limits<float>::max();
+
+  EXPECT_EQ(leaf::MinEuclidean(leaf_data.data(), 32, RandPoint()),
+            std::numeric_limits<float>::max());
+}
+
+#if REDWOOD_X86_SIMD
+TEST(LeafKernelTest, Avx2) {
+  if (!__builtin_cpu_supports("avx2")) GTEST_SKIP();
+  ExpectSameAsScalar(leaf::MinEuclideanAvx2);
+}
+
+TEST(LeafKernelTest, Avx512) {
+  if (!__builtin_cpu_supports("avx512f")) GTEST_SKIP();
+  ExpectSameAsScalar(leaf::MinEuclideanAvx512);
+}
+#endif
+
+// Same distance and the same point as the scalar version
+void ExpectSameNearest(const leaf::NearestFunc impl) {
+  for (int n = 1; n <= 100; ++n) {
+    std::vector<Point4F> leaf_data(n);
+    for (auto& p : leaf_data) p = RandPoint();
+    const auto q = RandPoint();
+
+    const auto expected = leaf::NearestEuclideanScalar(leaf_data.data(), n, q);
+    const auto actual = impl(leaf_data.data(), n, q);
+    EXPECT_EQ(actual.value, expected.value) << "n=" << n;
+    EXPECT_EQ(actual.pos, expected.pos) << "n=" << n;
+  }
+}
+
+TEST(LeafKernelTest, Nearest) {
+  std::vector<Point4F> leaf_data(64);
+  for (auto& p : leaf_data) p = RandPoint();
+  const auto q = RandPoint();
+
+  constexpr dist::Euclidean functor;
+  const auto nearest = leaf::Nearest(functor, leaf_data.data(), 64, q);
+  ASSERT_GE(nearest.pos, 0);
+  EXPECT_EQ(functor(leaf_data[nearest.pos], q), nearest.value);
+  EXPECT_EQ(nearest.value, leaf::MinEuclidean(leaf_data.data(), 64, q));
+
+  EXPECT_EQ(leaf::Nearest(functor, leaf_data.data(), 0, q).pos, -1);
+
+  // The first one on ties, wherever the lanes put them
+  leaf_data[50] = leaf_data[40] = leaf_data[nearest.pos];
+  EXPECT_EQ(leaf::Nearest(functor, leaf_data.data(), 64, q).pos,
+            std::min(nearest.pos, 40));
+}
+
+TEST(LeafKernelTest, NearestPaddingOnly) {
+  std::vector<Point4F> leaf_data(32);
+  for (auto& p : leaf_data) p.data[0] = std::numeric_limits<float>::max();
+
+  const auto nearest =
+      leaf::NearestEuclidean(leaf_data.data(), 32, RandPoint());
+  EXPECT_EQ(nearest.value, std::numeric_limits<float>::max());
+  EXPECT_EQ(nearest.pos, -1);
+}
+
+// Every distance bit-identical to the scalar version
+void ExpectSameDistances(const leaf::DistancesFunc impl) {
+  for (int n = 1; n <= 100; ++n) {
+    std::vector<Point4F> leaf_data(n);
+    for (auto& p : leaf_data) p = RandPoint();
+    const auto q = RandPoint();
+
+    std::vector<float> expected(n);
+    std::vector<float> actual(n);
+    leaf::DistancesEuclideanScalar(leaf_data.data(), n, q, expected.data());
+    impl(leaf_data.data(), n, q, actual.data());
+    EXPECT_EQ(0, std::memcmp(expected.data(), actual.data(),
+                             n * sizeof(float)))
+        << "n=" << n;
+  }
+}
+
+#if REDWOOD_X86_SIMD
+TEST(LeafKernelTest, NearestAvx2) {
+  if (!__builtin_cpu_supports("avx2")) GTEST_SKIP();
+  ExpectSameNearest(leaf::NearestEuclideanAvx2);
+}
+
+TEST(LeafKernelTest, NearestAvx512) {
+  if (!__builtin_cpu_supports("avx512f")) GTEST_SKIP();
+  ExpectSameNearest(leaf::NearestEuclideanAvx512);
+}
+
+TEST(LeafKernelTest, DistancesAvx2) {
+  if (!__builtin_cpu_supports("avx2")) GTEST_SKIP();
+  ExpectSameDistances(leaf::DistancesEuclideanAvx2);
+}
+
+TEST(LeafKernelTest, DistancesAvx512) {
+  if (!__builtin_cpu_supports("avx512f")) GTEST_SKIP();
+  ExpectSameDistances(leaf::DistancesEuclideanAvx512);
+}
+#endif
+
+TEST(ReduceOpTest, Sum) {
+  std::vector<Point4F> leaf_data(50);
+  for (auto& p : leaf_data) p = RandPoint();
+  const auto q = RandPoint();
+
+  constexpr dist::Gravity functor;
+  auto expected = 0.0f;
+  for (const auto& p : leaf_data) expected += functor(p, q);
+
+  auto slot = 0.0f;
+  leaf::Reduce<reduce::Sum>(functor, leaf_data.data(), 50, q, &slot);
+  EXPECT_FLOAT_EQ(slot, expected);
+}
+
+TEST(ReduceOpTest, TopK) {
+  constexpr auto k = 8;
+  std::vector<Point4F> leaf_data(50);
+  for (auto& p : leaf_data) p = RandPoint();
+  const auto q = RandPoint();
+
+  constexpr dist::Manhattan functor;
+  std::vector<float> expected;
+  for (const auto& p : leaf_data) expected.push_back(functor(p, q));
+  std::sort(expected.begin(), expected.end());
+
+  // The positions are the ones of the points in the leaf
+  reduce::Entry<float> slot[k];
+  reduce::ResetSlot<reduce::TopK<k>, float>(slot);
+  leaf::Reduce<reduce::TopK<k>>(functor, leaf_data.data(), 50, q, slot);
+  for (int i = 0; i < k; ++i) {
+    EXPECT_EQ(slot[i].value, expected[i]) << "i=" << i;
+    EXPECT_EQ(functor(leaf_data[slot[i].pos], q), expected[i]) << "i=" << i;
+  }
+
+  // Two leaves folded into the same slot
+  reduce::ResetSlot<reduce::TopK<k>, float>(slot);
+  leaf::Reduce<reduce::TopK<k>>(functor, leaf_data.data(), 20, q, slot);
+  leaf::Reduce<reduce::TopK<k>>(functor, leaf_data.data() + 20, 30, q, slot);
+  for (int i = 0; i < k; ++i) {
+    EXPECT_EQ(slot[i].value, expected[i]) << "i=" << i;
+  }
+}
+
+// The Euclidean one takes the distances from the SIMD kernel, the entries and
+// their order on ties are the same as one point at a time
+TEST(ReduceOpTest, TopKEuclidean) {
+  constexpr auto k = 4;
+  std::vector<Point4F> leaf_data(150);
+  for (auto& p : leaf_data) p = RandPoint();
+  const auto q = RandPoint();
+
+  // Three ties among the nearest
+  leaf_data[120] = leaf_data[70] = leaf_data[3] = q;
+
+  constexpr dist::Euclidean functor;
+  reduce::Entry<float> expected[k];
+  reduce::ResetSlot<reduce::TopK<k>, float>(expected);
+  for (int i = 0; i < 150; ++i) {
+    reduce::TopK<k>::Insert(expected, {functor(leaf_data[i], q), i});
+  }
+
+  reduce::Entry<float> slot[k];
+  reduce::ResetSlot<reduce::TopK<k>, float>(slot);
+  leaf::Reduce<reduce::TopK<k>>(functor, leaf_data.data(), 150, q, slot);
+  for (int i = 0; i < k; ++i) {
+    EXPECT_EQ(slot[i].value, expected[i].value) << "i=" << i;
+    EXPECT_EQ(slot[i].pos, expected[i].pos) << "i=" << i;
+  }
+  EXPECT_EQ(slot[1].pos, 70);
+  EXPECT_EQ(slot[2].pos, 120);
+}
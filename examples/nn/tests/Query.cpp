@@ -13,8 +13,6 @@
 #include "Redwood.hpp"
 #include "Redwood/Point.hpp"
 
-using Task = std::pair<int, Point4F>;
-
 _NODISCARD inline Point4F RandPoint() {
   Point4F p;
   p.data[0] = MyRand(0, 1024);
@@ -57,8 +55,8 @@ class QueryTest : public ::testing::Test {
     q2_data = q_data;
   }
 
-  std::vector<std::queue<Task>> q_data;
-  std::vector<std::queue<Task>> q2_data;
+  std::vector<std::queue<Task<4, float>>> q_data;
+  std::vector<std::queue<Task<4, float>>> q2_data;
 
   std::vector<Point4F> in_data;
 };
@@ -70,7 +68,7 @@ TEST_F(QueryTest, BuildQueue) {
 
 TEST_F(QueryTest, CpuTraversal) {
   const auto tid = 0;
-  Executor<dist::Euclidean> cpu_exe{tid, 0, 0};
+  Executor<dist::Euclidean, 4, float> cpu_exe{tid, 0, 0};
   const auto task = q_data[tid].front();
 
   cpu_exe.SetQuery(task);
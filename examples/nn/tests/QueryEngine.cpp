@@ -0,0 +1,193 @@
+#include <gtest/gtest.h>
+#include <pthread.h>
+#include <sched.h>
+
+#include <mutex>
+#include <vector>
+
+#include "../KDTree.hpp"
+#include "../QueryEngine.hpp"
+#include "Functors/DistanceMetrics.hpp"
+#include "Redwood/Point.hpp"
+#include "TestUtils.hpp"
+
+namespace {
+
+constexpr int kNumPoints = 5000;
+
+using Tree = kdt::KdTree<3, double>;
+using Engine = QueryEngine<Tree>;
+
+// Two threads, three streams of small batches, so the executors are reused
+// and every stream is drained
+class QueryEngineTest : public test::TreeTest<3, double> {
+ protected:
+  static void SetUpTestSuite() { SetUpTree(kNumPoints, 8, 2, 8, 3); }
+
+  static void ExpectSameAsBruteForce(const std::vector<Point3D>& queries,
+                                     const std::vector<Neighbor<double>>& res) {
+    ASSERT_EQ(res.size(), queries.size());
+    for (std::size_t i = 0; i < queries.size(); ++i) {
+      const auto expected = BruteForceNearest(queries[i]);
+      EXPECT_EQ(res[i].dist, expected.dist) << "query " << i;
+      EXPECT_EQ(res[i].id, expected.id) << "query " << i;
+    }
+  }
+};
+
+}  // namespace
+
+TEST_F(QueryEngineTest, SameAsBruteForce) {
+  Engine engine;
+  const auto queries = MakeQueries(500);
+  ExpectSameAsBruteForce(queries, engine.Run(queries));
+
+  // The pool is reused, fewer queries than executors
+  const auto few = MakeQueries(5, 42);
+  ExpectSameAsBruteForce(few, engine.Run(few));
+  EXPECT_TRUE(engine.Run(few.data(), 0).empty());
+}
+
+TEST_F(QueryEngineTest, Cpu) {
+  const auto queries = MakeQueries(500);
+  ExpectSameAsBruteForce(queries, Engine(true).Run(queries));
+}
+
+// The traversal threads are pinned for the run only, the caller runs one of
+// them and gets its own affinity back
+TEST_F(QueryEngineTest, CallerKeepsItsAffinity) {
+  cpu_set_t before;
+  cpu_set_t after;
+  ASSERT_EQ(pthread_getaffinity_np(pthread_self(), sizeof(before), &before), 0);
+
+  const auto queries = MakeQueries(100);
+  ExpectSameAsBruteForce(queries, Engine(true).Run(queries));
+  ExpectSameAsBruteForce(queries, Engine().Run(queries));
+
+  ASSERT_EQ(pthread_getaffinity_np(pthread_self(), sizeof(after), &after), 0);
+  EXPECT_TRUE(CPU_EQUAL(&before, &after));
+}
+
+TEST_F(QueryEngineTest, Callback) {
+  const auto queries = MakeQueries(300, 7);
+
+  std::mutex mutex;
+  std::vector<int> calls(queries.size());
+  std::vector<Neighbor<double>> results(queries.size());
+  Engine().Run(queries.data(), static_cast<int>(queries.size()),
+               [&](const int i, Neighbor<double>&& result) {
+                 const std::lock_guard<std::mutex> lock(mutex);
+                 ++calls[i];
+                 results[i] = result;
+               });
+
+  for (const auto n : calls) EXPECT_EQ(n, 1);
+  ExpectSameAsBruteForce(queries, results);
+}
+
+TEST_F(QueryEngineTest, Future) {
+  const auto queries = MakeQueries(300, 8);
+
+  Engine engine;
+  auto future = engine.RunAsync(queries);
+  ExpectSameAsBruteForce(queries, future.get());
+}
+
+TEST_F(QueryEngineTest, WithinEpsilon) {
+  const auto queries = MakeQueries(500);
+
+  Engine engine;
+  ExpectSameAsBruteForce(queries, engine.Run(queries));
+  const auto exact_stats = engine.Stats();
+  EXPECT_EQ(exact_stats.num_queries, queries.size());
+  EXPECT_EQ(exact_stats.num_truncated, 0u);
+
+  constexpr auto kEpsilon = 0.5;
+  SearchOptions options;
+  options.epsilon = kEpsilon;
+  engine.SetOptions(options);
+  const auto results = engine.Run(queries);
+  for (std::size_t i = 0; i < queries.size(); ++i) {
+    const auto expected = BruteForceNearest(queries[i]);
+    EXPECT_GE(results[i].dist, expected.dist);
+    EXPECT_LE(results[i].dist, expected.dist * (1 + kEpsilon))
+        << "query " << i;
+  }
+  EXPECT_LT(engine.Stats().num_leaves, exact_stats.num_leaves);
+}
+
+TEST_F(QueryEngineTest, LeafBudget) {
+  const auto queries = MakeQueries(500);
+
+  for (const auto cpu : {false, true}) {
+    Engine engine(cpu);
+    SearchOptions options;
+    options.max_leaves = 2;
+    engine.SetOptions(options);
+    const auto results = engine.Run(queries);
+
+    const auto stats = engine.Stats();
+    EXPECT_LE(stats.num_leaves, 2 * queries.size());
+    EXPECT_GT(stats.num_truncated, 0u);
+    for (std::size_t i = 0; i < queries.size(); ++i) {
+      EXPECT_GE(results[i].dist, BruteForceNearest(queries[i]).dist);
+    }
+  }
+}
+
+TEST_F(QueryEngineTest, PerQueryOptions) {
+  const auto queries = MakeQueries(500);
+
+  // Every other query stops at its first leaf
+  std::vector<SearchOptions> options(queries.size());
+  for (std::size_t i = 0; i < options.size(); i += 2) {
+    options[i].max_leaves = 1;
+  }
+
+  Engine engine;
+  const auto results = engine.Run(queries, options);
+  EXPECT_LE(engine.Stats().num_truncated, queries.size() / 2);
+  for (std::size_t i = 1; i < queries.size(); i += 2) {
+    const auto expected = BruteForceNearest(queries[i]);
+    EXPECT_EQ(results[i].dist, expected.dist) << "query " << i;
+    EXPECT_EQ(results[i].id, expected.id) << "query " << i;
+  }
+}
+
+// The kernels return the K nearest points of each leaf, so every one of them
+// counts, not only the nearest of the leaf. 5 neighbors, in slots of 8.
+TEST_F(QueryEngineTest, Knn) {
+  const auto queries = MakeQueries(300);
+
+  for (const auto cpu : {false, true}) {
+    QueryEngine<Tree, dist::Euclidean, KnnSet<double, 5>> engine(cpu);
+    const auto results = engine.Run(queries);
+    ASSERT_EQ(results.size(), queries.size());
+    for (std::size_t i = 0; i < queries.size(); ++i) {
+      const auto expected = BruteForce<5>(queries[i]);
+      for (int j = 0; j < 5; ++j) {
+        EXPECT_EQ(results[i][j].dist, expected[j].dist) << "query " << i;
+        EXPECT_EQ(results[i][j].id, expected[j].id) << "query " << i;
+      }
+    }
+  }
+
+  // And back to the nearest neighbor only
+  Engine engine;
+  ExpectSameAsBruteForce(queries, engine.Run(queries));
+}
+
+// Up to 256 neighbors go through the kernels, 100 in slots of 128
+TEST_F(QueryEngineTest, ManyNeighbors) {
+  const auto queries = MakeQueries(50);
+
+  QueryEngine<Tree, dist::Euclidean, KnnSet<double, 100>> engine;
+  const auto results = engine.Run(queries);
+  for (std::size_t i = 0; i < queries.size(); ++i) {
+    const auto expected = BruteForce<100>(queries[i]);
+    for (int j = 0; j < 100; ++j) {
+      EXPECT_EQ(results[i][j].dist, expected[j].dist) << "query " << i;
+      EXPECT_EQ(results[i][j].id, expected[j].id) << "query " << i;
+    }
+  }
+}
@@ -0,0 +1,156 @@
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <stdexcept>
+#include <vector>
+
+#include "../Executor.hpp"
+#include "../KDTree.hpp"
+#include "../QueryEngine.hpp"
+#include "../RadiusSet.hpp"
+#include "Functors/DistanceMetrics.hpp"
+#include "Redwood/Point.hpp"
+#include "Redwood/Usm.hpp"
+#include "TestUtils.hpp"
+
+namespace {
+
+constexpr int kNumPoints = 4000;
+constexpr int kNumQueries = 100;
+constexpr int kLeafMaxSize = 16;
+constexpr float kRadius = 200.0f;
+
+using Exe = Executor<dist::Euclidean, 4, float, RadiusSet<float>>;
+using Engine =
+    QueryEngine<kdt::KdTree<4, float>, dist::Euclidean, RadiusSet<float>>;
+
+class RadiusSearchTest : public test::TreeTest<4, float> {
+ protected:
+  static void SetUpTestSuite() {
+    SetUpTree(kNumPoints, kLeafMaxSize, 1, 16, 2);
+  }
+
+  // Ids of the points in range of 'q', sorted
+  static std::vector<int> InRange(const Point4F& q) {
+    return test::BruteForceRadius(data_, q, kRadius);
+  }
+
+  static std::vector<int> Sorted(const NeighborList& list) {
+    std::vector<int> ids(list.begin(), list.end());
+    std::sort(ids.begin(), ids.end());
+    return ids;
+  }
+};
+
+}  // namespace
+
+TEST_F(RadiusSearchTest, CpuTraverseSameAsBruteForce) {
+  rdc::SetRadius<4, float>(kRadius, false, kLeafMaxSize);
+
+  Exe exe(0, 0, 0);
+  auto total = 0;
+  const auto queries = MakeQueries(kNumQueries);
+  for (int i = 0; i < kNumQueries; ++i) {
+    const auto expected = InRange(queries[i]);
+    total += static_cast<int>(expected.size());
+
+    exe.SetQuery({i, queries[i]});
+    ASSERT_EQ(exe.CpuTraverse(), static_cast<int>(expected.size()));
+    EXPECT_EQ(Sorted(exe.TakeResult().ids), expected) << "query " << i;
+  }
+
+  // Not a trivial test
+  EXPECT_GT(total, kNumQueries);
+}
+
+TEST_F(RadiusSearchTest, BatchedSameAsBruteForce) {
+  rdc::SetRadius<4, float>(kRadius, false, kLeafMaxSize);
+
+  const auto queries = MakeQueries(kNumQueries);
+  const auto results = Engine().Run(queries);
+  for (int i = 0; i < kNumQueries; ++i) {
+    const auto expected = InRange(queries[i]);
+    EXPECT_EQ(results[i].count, static_cast<int>(expected.size()));
+    EXPECT_EQ(Sorted(results[i].ids), expected) << "query " << i;
+  }
+}
+
+TEST_F(RadiusSearchTest, CountOnly) {
+  rdc::SetRadius<4, float>(kRadius, true, kLeafMaxSize);
+
+  const auto queries = MakeQueries(kNumQueries, 42);
+  const auto results = Engine().Run(queries);
+  for (int i = 0; i < kNumQueries; ++i) {
+    EXPECT_EQ(results[i].count,
+              static_cast<int>(InRange(queries[i]).size()));
+    EXPECT_EQ(results[i].ids.Size(), 0);
+  }
+}
+
+TEST_F(RadiusSearchTest, OverflowedSlotsAreRescanned) {
+  // Fewer match slots than points in the leaves
+  rdc::SetRadius<4, float>(kRadius, false, 2);
+
+  const auto queries = MakeQueries(kNumQueries);
+  const auto results = Engine().Run(queries);
+  for (int i = 0; i < kNumQueries; ++i) {
+    EXPECT_EQ(Sorted(results[i].ids), InRange(queries[i])) << "query " << i;
+  }
+}
+
+// Without a radius there are no match buffers to read the results from
+TEST_F(RadiusSearchTest, EngineNeedsARadius) {
+  rdc::SetNumNeighbors<4, float>(1);
+  EXPECT_THROW(Engine(), std::runtime_error);
+  EXPECT_THROW(Engine(true), std::runtime_error);
+}
+
+// The nearest neighbor kernels are back once an engine sets its K neighbors
+TEST_F(RadiusSearchTest, BackToNearestNeighbors) {
+  rdc::SetRadius<4, float>(kRadius, false, kLeafMaxSize);
+  const auto queries = MakeQueries(kNumQueries);
+  EXPECT_EQ(Engine().Run(queries).size(), queries.size());
+
+  QueryEngine<kdt::KdTree<4, float>> engine;
+  EXPECT_FALSE((rdc::radius_query<4, float>.enabled));
+  const auto results = engine.Run(queries);
+  for (int i = 0; i < kNumQueries; ++i) {
+    const auto expected = BruteForceNearest(queries[i]);
+    EXPECT_EQ(results[i].dist, expected.dist) << "query " << i;
+    EXPECT_EQ(results[i].id, expected.id) << "query " << i;
+  }
+}
+
+TEST(NeighborListTest, GrowsAndMoves) {
+  NeighborList list;
+  for (int i = 0; i < 1000; ++i) list.Append(i);
+  ASSERT_EQ(list.Size(), 1000);
+  for (int i = 0; i < 1000; ++i) EXPECT_EQ(list.Data()[i], i);
+
+  auto other = std::move(list);
+  EXPECT_EQ(other.Size(), 1000);
+  EXPECT_EQ(list.Size(), 0);
+
+  other.Clear();
+  other.Append(7);
+  EXPECT_EQ(std::vector<int>(other.begin(), other.end()), std::vector<int>{7});
+}
+
+TEST(NeighborListTest, SharesTheChunksOfTheArena) {
+  const auto before = redwood::GetUsmStats().num_allocs;
+
+  std::vector<NeighborList> lists;
+  for (int i = 0; i < 1000; ++i) {
+    const std::vector<int> ids(10, i);
+    lists.emplace_back(ids.data(), 10);
+  }
+  EXPECT_LE(redwood::GetUsmStats().num_allocs - before, 1u);
+
+  // Every list keeps its own ids, whatever is freed around it
+  lists.erase(lists.begin(), lists.begin() + 500);
+  for (int i = 0; i < 500; ++i) {
+    EXPECT_EQ(std::vector<int>(lists[i].begin(), lists[i].end()),
+              std::vector<int>(10, 500 + i));
+  }
+  EXPECT_EQ(NeighborList(nullptr, 0).Data(), nullptr);
+}
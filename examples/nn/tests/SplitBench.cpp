@@ -0,0 +1,112 @@
+#include <benchmark/benchmark.h>
+
+#include <array>
+#include <memory>
+#include <random>
+#include <vector>
+
+#include "../Executor.hpp"
+#include "../GlobalVars.hpp"
+#include "../KDTree.hpp"
+#include "Functors/DistanceMetrics.hpp"
+#include "Redwood/Point.hpp"
+
+// Leaves reduced per exact NN query ('Executor::CpuTraverse()'), for each
+// split policy. Run with
+//
+//   ./bench.out --benchmark_counters_tabular=true
+
+namespace {
+
+constexpr auto kNumPoints = 1 << 16;
+constexpr auto kNumQueries = 1 << 12;
+constexpr auto kLeafSize = 32;
+constexpr auto kDims = Point4F::kDims;
+
+using Tree = kdt::KdTree<kDims, float>;
+
+enum class Dataset { kUniform, kNormal, kClustered };
+
+// The queries are the last points, drawn from the same distribution
+std::vector<Point4F> MakeData(const Dataset dataset, const int n) {
+  std::mt19937 gen(114514);
+  std::uniform_real_distribution<float> uniform(0.0f, 1024.0f);
+  std::normal_distribution<float> normal(512.0f, 1024.0f / 6.0f);
+
+  // Tight, anisotropic blobs, the case the median split handles worst
+  std::vector<Point4F> centers(8);
+  std::vector<std::array<float, kDims>> scales(centers.size());
+  for (std::size_t c = 0; c < centers.size(); ++c) {
+    for (int d = 0; d < kDims; ++d) {
+      centers[c].data[d] = uniform(gen);
+      scales[c][d] = d == static_cast<int>(c) % kDims ? 64.0f : 4.0f;
+    }
+  }
+  std::uniform_int_distribution<std::size_t> pick(0, centers.size() - 1);
+  std::normal_distribution<float> blob(0.0f, 1.0f);
+
+  std::vector<Point4F> data(n);
+  for (auto& p : data) {
+    const auto c = pick(gen);
+    for (int d = 0; d < kDims; ++d) {
+      if (dataset == Dataset::kUniform) {
+        p.data[d] = uniform(gen);
+      } else if (dataset == Dataset::kNormal) {
+        p.data[d] = normal(gen);
+      } else {
+        p.data[d] = centers[c].data[d] + scales[c][d] * blob(gen);
+      }
+    }
+  }
+  return data;
+}
+
+template <typename SplitPolicy>
+void BM_NnSearch(benchmark::State& state) {
+  const auto dataset = static_cast<Dataset>(state.range(0));
+  const auto data = MakeData(dataset, kNumPoints + kNumQueries);
+  const std::vector<Point4F> queries(data.begin() + kNumPoints, data.end());
+
+  const auto tree = std::make_unique<Tree>(
+      kdt::KdtParams{kLeafSize, 1}, data.data(), kNumPoints, SplitPolicy{});
+
+  rdc::Init<kDims, float>(1, 1, 1);
+  auto [lnt, lnt_offsets] = rdc::AllocateLnt<kDims, float>(
+      tree->GetStats().num_leaf_nodes, tree->NumLeafPoints());
+  tree->LoadPayload(lnt, lnt_offsets);
+  query_trees<kDims, float> = {tree.get()};
+
+  Executor<dist::Euclidean, kDims, float> exe(0, 0, 0);
+  long num_leaves = 0;
+  long num_queries = 0;
+  for (auto _ : state) {
+    for (const auto& q : queries) {
+      exe.SetQuery({0, q});
+      benchmark::DoNotOptimize(exe.CpuTraverse());
+      num_leaves += exe.NumLeaves();
+    }
+    num_queries += kNumQueries;
+  }
+
+  query_trees<kDims, float>.clear();
+  rdc::Release<kDims, float>();
+
+  const auto per_query = static_cast<double>(num_queries);
+  state.counters["leaves/query"] = num_leaves / per_query;
+  state.counters["depth"] = tree->GetStats().max_depth;
+  state.SetItemsProcessed(num_queries);
+}
+
+// 0: uniform, 1: normal, 2: clustered
+#define SPLIT_BENCHMARK(policy) \
+  BENCHMARK_TEMPLATE(BM_NnSearch, kdt::policy)->DenseRange(0, 2)
+
+SPLIT_BENCHMARK(MedianSplit);
+SPLIT_BENCHMARK(MaxSpreadSplit);
+SPLIT_BENCHMARK(MaxVarianceSplit);
+SPLIT_BENCHMARK(SlidingMidpointSplit);
+SPLIT_BENCHMARK(CostSplit);
+
+}  // namespace
+
+BENCHMARK_MAIN();
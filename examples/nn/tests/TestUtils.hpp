@@ -0,0 +1,134 @@
+#pragma once
+
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <array>
+#include <limits>
+#include <random>
+#include <vector>
+
+#include "../GlobalVars.hpp"
+#include "../KDTree.hpp"
+#include "../KnnSet.hpp"
+#include "../ReducerHandler.hpp"
+#include "Functors/DistanceMetrics.hpp"
+#include "Redwood/Point.hpp"
+
+// What the tests of the searches have in common: random points, a tree over
+// them with its leaf node table, and brute force searches to check against.
+namespace test {
+
+// Of the points searched, and of the queries
+constexpr unsigned kDataSeed = 114514;
+constexpr unsigned kQuerySeed = 1919810;
+
+// 'n' points, uniform in [0, 1024) along every dimension
+template <typename PointT>
+std::vector<PointT> MakePoints(const int n, const unsigned seed) {
+  using T = typename PointT::Scalar;
+  std::mt19937 gen(seed);
+  std::uniform_real_distribution<T> dis(0, 1024);
+
+  std::vector<PointT> data(n);
+  for (auto& p : data) {
+    for (auto& x : p.data) x = dis(gen);
+  }
+  return data;
+}
+
+struct SkipNone {
+  bool operator()(int) const { return false; }
+};
+
+// The 'K' nearest of 'data' to 'q', in ascending order, the smaller id first
+// on ties. The ids 'skip(id)' is true for are left out. The missing ones, if
+// fewer than 'K' are left, have an id of -1.
+template <int K, typename PointT, typename Skip = SkipNone>
+std::array<Neighbor<typename PointT::Scalar>, K> BruteForceKnn(
+    const std::vector<PointT>& data, const PointT& q, const Skip skip = {}) {
+  using T = typename PointT::Scalar;
+  constexpr dist::Euclidean functor;
+
+  std::vector<Neighbor<T>> all;
+  for (int id = 0; id < static_cast<int>(data.size()); ++id) {
+    if (!skip(id)) all.push_back({functor(data[id], q), id});
+  }
+  const auto n = std::min(K, static_cast<int>(all.size()));
+  std::partial_sort(
+      all.begin(), all.begin() + n, all.end(),
+      [](const Neighbor<T>& a, const Neighbor<T>& b) {
+        return a.dist < b.dist || (a.dist == b.dist && a.id < b.id);
+      });
+
+  std::array<Neighbor<T>, K> best;
+  best.fill({std::numeric_limits<T>::max(), -1});
+  std::copy_n(all.begin(), n, best.begin());
+  return best;
+}
+
+// Ids of the points of 'data' closer than 'radius' to 'q', sorted
+template <typename PointT>
+std::vector<int> BruteForceRadius(const std::vector<PointT>& data,
+                                  const PointT& q,
+                                  const typename PointT::Scalar radius) {
+  constexpr dist::Euclidean functor;
+  std::vector<int> ids;
+  for (int id = 0; id < static_cast<int>(data.size()); ++id) {
+    if (functor(data[id], q) < radius) ids.push_back(id);
+  }
+  return ids;
+}
+
+// A tree over random points (of 'kDataSeed'), its leaf node table loaded, and
+// searched by the executors. Fixtures set it up in their 'SetUpTestSuite()'
+// with 'SetUpTree()'.
+template <int Dim, typename T>
+class TreeTest : public ::testing::Test {
+ protected:
+  using PointT = Point<Dim, T>;
+  using Tree = kdt::KdTree<Dim, T>;
+
+  static void SetUpTree(const int num_points, const int leaf_max_size,
+                        const int num_threads, const int batch_size,
+                        const int num_streams) {
+    rdc::Init<Dim, T>(num_threads, batch_size, num_streams);
+
+    data_ = MakePoints<PointT>(num_points, kDataSeed);
+    tree_ = new Tree(kdt::KdtParams{leaf_max_size, 1}, data_.data(),
+                     num_points);
+    auto [lnt, lnt_offsets] = rdc::AllocateLnt<Dim, T>(
+        tree_->GetStats().num_leaf_nodes, tree_->NumLeafPoints());
+    tree_->LoadPayload(lnt, lnt_offsets);
+    query_trees<Dim, T> = {tree_};
+  }
+
+  static void TearDownTestSuite() {
+    query_trees<Dim, T>.clear();
+    rdc::Release<Dim, T>();
+    delete tree_;
+    tree_ = nullptr;
+  }
+
+  static std::vector<PointT> MakeQueries(const int n,
+                                         const unsigned seed = kQuerySeed) {
+    return MakePoints<PointT>(n, seed);
+  }
+
+  // The 'K' nearest points of the tree, without 'skip_id'
+  template <int K>
+  static std::array<Neighbor<T>, K> BruteForce(const PointT& q,
+                                               const int skip_id = -1) {
+    return BruteForceKnn<K>(data_, q,
+                            [=](const int id) { return id == skip_id; });
+  }
+
+  static Neighbor<T> BruteForceNearest(const PointT& q) {
+    return BruteForce<1>(q)[0];
+  }
+
+  inline static std::vector<PointT> data_;
+  inline static Tree* tree_ = nullptr;
+};
+
+}  // namespace test
@@ -0,0 +1,102 @@
+#include <gtest/gtest.h>
+
+#include <cstdint>
+#include <cstring>
+
+#include "Redwood/HostUsm.hpp"
+#include "Redwood/UsmPool.hpp"
+
+TEST(UsmPoolTest, ClassSize) {
+  EXPECT_EQ(redwood::UsmPool::ClassSize(1), 256u);
+  EXPECT_EQ(redwood::UsmPool::ClassSize(256), 256u);
+  EXPECT_EQ(redwood::UsmPool::ClassSize(257), 512u);
+  EXPECT_EQ(redwood::UsmPool::ClassSize(3 << 20), 4u << 20);
+  EXPECT_EQ(redwood::UsmPool::ClassSize(5 << 20), 6u << 20);
+}
+
+TEST(UsmPoolTest, ReuseSameClass) {
+  redwood::UsmPool pool(redwood::host::RawMalloc, redwood::host::RawFree);
+
+  const auto a = pool.Allocate(1000);
+  ASSERT_NE(a, nullptr);
+  EXPECT_TRUE(pool.Free(a));
+
+  // Same class (1 KB), should get the cached block back
+  const auto b = pool.Allocate(800);
+  EXPECT_EQ(a, b);
+
+  const auto stats = pool.Stats();
+  EXPECT_EQ(stats.num_allocs, 2u);
+  EXPECT_EQ(stats.num_raw_allocs, 1u);
+  EXPECT_EQ(stats.num_reused, 1u);
+  EXPECT_EQ(stats.bytes_in_use, 1024u);
+  EXPECT_EQ(stats.bytes_cached, 0u);
+
+  pool.Free(b);
+  pool.Trim();
+  EXPECT_EQ(pool.Stats().bytes_reserved, 0u);
+}
+
+TEST(UsmPoolTest, UnknownPointer) {
+  redwood::UsmPool pool(redwood::host::RawMalloc, redwood::host::RawFree);
+  int x;
+  EXPECT_FALSE(pool.Free(&x));
+}
+
+TEST(UsmPoolTest, LargeBlocks) {
+  redwood::host::options.huge_pages = true;
+  redwood::host::options.populate = true;
+  redwood::UsmPool pool(redwood::host::RawMalloc, redwood::host::RawFree);
+
+  constexpr std::size_t kBytes = 3 << 20;
+  const auto ptr = static_cast<char*>(pool.Allocate(kBytes));
+  ASSERT_NE(ptr, nullptr);
+  EXPECT_EQ(reinterpret_cast<std::uintptr_t>(ptr) %
+                redwood::host::kAlignment,
+            0u);
+  std::memset(ptr, 1, kBytes);
+
+  pool.Free(ptr);
+  EXPECT_EQ(pool.Stats().bytes_cached, 4u << 20);
+  pool.Trim();
+  EXPECT_EQ(pool.Stats().bytes_reserved, 0u);
+
+  redwood::host::options = {};
+}
+
+// Placed blocks never come from, nor go back to, the free lists
+TEST(UsmPoolTest, UncachedBlocks) {
+  redwood::host::options.populate = true;
+  redwood::UsmPool pool(redwood::host::RawMalloc, redwood::host::RawFree);
+
+  const auto cached = pool.Allocate(1000);
+  ASSERT_NE(cached, nullptr);
+  EXPECT_TRUE(pool.Free(cached));
+
+  constexpr std::size_t kBytes = 1000;
+  const auto ptr = static_cast<char*>(pool.AllocateUncached(
+      kBytes, redwood::host::MapPlaced, redwood::host::UnmapPlaced));
+  ASSERT_NE(ptr, nullptr);
+  EXPECT_NE(static_cast<void*>(ptr), cached);
+  EXPECT_EQ(reinterpret_cast<std::uintptr_t>(ptr) %
+                static_cast<std::uintptr_t>(sysconf(_SC_PAGESIZE)),
+            0u);
+  std::memset(ptr, 1, kBytes);
+
+  auto stats = pool.Stats();
+  EXPECT_EQ(stats.num_raw_allocs, 2u);
+  EXPECT_EQ(stats.bytes_in_use, kBytes);
+  EXPECT_EQ(stats.bytes_reserved, 1024u + kBytes);
+
+  EXPECT_TRUE(pool.Free(ptr));
+  EXPECT_FALSE(pool.Free(ptr));
+  stats = pool.Stats();
+  EXPECT_EQ(stats.bytes_in_use, 0u);
+  EXPECT_EQ(stats.bytes_cached, 1024u);
+  EXPECT_EQ(stats.bytes_reserved, 1024u);
+
+  pool.Trim();
+  EXPECT_EQ(pool.Stats().bytes_reserved, 0u);
+
+  redwood::host::options = {};
+}
@@ -13,12 +13,14 @@
 #endif
 
 #ifdef __CUDACC__
-#define MAX(x, y) fmaxf(x, y)
+#define MAX(x, y) fmax(x, y)
 #define SQRTF(x) sqrtf(x)
+#define SQRT(x) sqrt(x)
 #define ABS(x) abs(x)
 #else
 #define MAX(x, y) std::max(x, y)
 #define SQRTF(x) std::sqrt(x)
+#define SQRT(x) std::sqrt(x)
 #define ABS(x) std::abs(x)
 #endif
 
@@ -29,36 +31,53 @@
 #define SOFTENING 1e-9f
 
 namespace dist {
+
+// The metrics work on points of any dimension and scalar type, in the type of
+// the coordinates. The kernels below them are 3D with a mass in 'W', so for
+// 'Point4F' only.
+
 struct Euclidean {
-  _REDWOOD_KERNEL float operator()(const Point4F p, const Point4F q) const {
-    const auto dx = p.X - q.X;
-    const auto dy = p.Y - q.Y;
-    const auto dz = p.Z - q.Z;
-    const auto dw = p.W - q.W;
-    return SQRTF(dx * dx + dy * dy + dz * dz + dw * dw + SOFTENING);
+  template <int Dim, typename T>
+  _REDWOOD_KERNEL T operator()(const Point<Dim, T> p,
+                               const Point<Dim, T> q) const {
+    auto dist_sqr = (p.data[0] - q.data[0]) * (p.data[0] - q.data[0]);
+    for (int d = 1; d < Dim; ++d) {
+      const auto diff = p.data[d] - q.data[d];
+      dist_sqr += diff * diff;
+    }
+    return FromSquared(dist_sqr);
   }
 
   _REDWOOD_KERNEL float operator()(const float a, const float b) const {
     const auto dx = a - b;
     return SQRTF(dx * dx + SOFTENING);
   }
+
+  // Same as 'operator()' given the sum of the squared differences, e.g., a
+  // lower bound built incrementally during traversal
+  template <typename T>
+  _REDWOOD_KERNEL T FromSquared(const T dist_sqr) const {
+    return SQRT(dist_sqr + static_cast<T>(SOFTENING));
+  }
 };
 
 struct Manhattan {
-  _REDWOOD_KERNEL float operator()(const Point4F p, const Point4F q) const {
-    return ABS(p.X - q.X) + ABS(p.Y - q.Y) + ABS(p.Z - q.Z) + ABS(p.W - q.W);
+  template <int Dim, typename T>
+  _REDWOOD_KERNEL T operator()(const Point<Dim, T> p,
+                               const Point<Dim, T> q) const {
+    auto dist = ABS(p.data[0] - q.data[0]);
+    for (int d = 1; d < Dim; ++d) dist += ABS(p.data[d] - q.data[d]);
+    return dist;
   }
 };
 
 struct Chebyshev {
-  _REDWOOD_KERNEL float operator()(const Point4F p, const Point4F q) const {
-    const auto dx = ABS(p.X - q.X);
-    const auto dy = ABS(p.Y - q.Y);
-    const auto dz = ABS(p.Z - q.Z);
-    const auto dw = ABS(p.W - q.W);
-    auto tmp1 = MAX(dx, dy);
-    auto tmp2 = MAX(dz, dw);
-    return MAX(tmp1, tmp2);
+  template <int Dim, typename T>
+  _REDWOOD_KERNEL T operator()(const Point<Dim, T> p,
+                               const Point<Dim, T> q) const {
+    auto dist = ABS(p.data[0] - q.data[0]);
+    for (int d = 1; d < Dim; ++d) dist = MAX(dist, ABS(p.data[d] - q.data[d]));
+    return dist;
   }
 };
 
@@ -0,0 +1,472 @@
+#pragma once
+
+#include <algorithm>
+#include <limits>
+#include <type_traits>
+
+#include "Functors/DistanceMetrics.hpp"
+#include "Functors/ReduceOps.hpp"
+#include "Redwood/Point.hpp"
+
+// Host side leaf node kernels. Evaluate a whole leaf (from the leaf node table)
+// against a single query point, instead of one 'Point4F' at a time.
+//
+// On x86-64 the Euclidean kernel is vectorized with AVX2 (8 lanes) and
+// AVX-512 (16 lanes). The best version is selected at runtime, so the caller
+// does not need to be compiled with '-mavx2' or '-mavx512f'.
+
+#if defined(__x86_64__) && defined(__GNUC__) && !defined(__CUDACC__)
+#define REDWOOD_X86_SIMD 1
+#include <immintrin.h>
+#else
+#define REDWOOD_X86_SIMD 0
+#endif
+
+namespace leaf {
+
+using MinDistFunc = float (*)(const Point4F* leaf_addr, int n, Point4F q);
+using NearestFunc = reduce::Entry<float> (*)(const Point4F* leaf_addr, int n,
+                                             Point4F q);
+using DistancesFunc = void (*)(const Point4F* leaf_addr, int n, Point4F q,
+                               float* out);
+
+inline float MinEuclideanScalar(const Point4F* leaf_addr, const int n,
+                                const Point4F q) {
+  constexpr dist::Euclidean functor;
+
+  auto my_min = std::numeric_limits<float>::max();
+  for (int i = 0; i < n; ++i) {
+    my_min = std::min(my_min, functor(leaf_addr[i], q));
+  }
+  return my_min;
+}
+
+inline reduce::Entry<float> NearestEuclideanScalar(const Point4F* leaf_addr,
+                                                   const int n,
+                                                   const Point4F q) {
+  constexpr dist::Euclidean functor;
+
+  reduce::Entry<float> best{std::numeric_limits<float>::max(), -1};
+  for (int i = 0; i < n; ++i) {
+    const auto dist = functor(leaf_addr[i], q);
+    if (dist < best.value) best = {dist, i};
+  }
+  return best;
+}
+
+inline void DistancesEuclideanScalar(const Point4F* leaf_addr, const int n,
+                                     const Point4F q, float* out) {
+  constexpr dist::Euclidean functor;
+
+  for (int i = 0; i < n; ++i) out[i] = functor(leaf_addr[i], q);
+}
+
+#if REDWOOD_X86_SIMD
+
+// All SIMD versions transpose the leaf (AoS) into x, y, z, w registers (SoA),
+// see 'SquaredDistances8()', so the summation order matches 'dist::Euclidean'
+// exactly. The square root is monotonic, thus only applied once to the
+// minimum squared distance. FMA contraction is disabled to stay bit-identical
+// with the scalar version.
+
+#pragma GCC push_options
+#pragma GCC optimize("fp-contract=off")
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+
+// Squared distances are reduced with +inf as identity, so leaves made of
+// padding only still return 'max()' like the scalar version.
+inline float SqrtOrMax(const float min_sqr) {
+  return min_sqr == std::numeric_limits<float>::infinity()
+             ? std::numeric_limits<float>::max()
+             : SQRTF(min_sqr);
+}
+
+// The nearest of the lanes, the first point on ties, then the scalar tail
+// from point 'i' on. Each lane kept its own first nearest point. The ties are
+// on the squared distances, two points only equally far after the square root
+// may come out in another order than with the scalar version, the distance is
+// the same.
+inline reduce::Entry<float> NearestOfLanes(const float* lanes,
+                                           const int* lane_pos,
+                                           const int num_lanes,
+                                           const Point4F* leaf_addr,
+                                           const int n, const int i,
+                                           const Point4F q) {
+  auto best = 0;
+  for (int j = 1; j < num_lanes; ++j) {
+    if (lanes[j] < lanes[best] ||
+        (lanes[j] == lanes[best] && lane_pos[j] < lane_pos[best])) {
+      best = j;
+    }
+  }
+
+  reduce::Entry<float> nearest{SqrtOrMax(lanes[best]), lane_pos[best]};
+  auto tail = NearestEuclideanScalar(leaf_addr + i, n - i, q);
+  tail.pos += i;
+  return tail.value < nearest.value ? tail : nearest;
+}
+
+// The query and the softening in every lane, see 'SquaredDistances8()'
+struct QueryLanes8 {
+  __m256 x;
+  __m256 y;
+  __m256 z;
+  __m256 w;
+  __m256 softening;
+};
+
+__attribute__((target("avx2"))) inline QueryLanes8 BroadcastQuery8(
+    const Point4F q) {
+  return {_mm256_set1_ps(q.data[0]), _mm256_set1_ps(q.data[1]),
+          _mm256_set1_ps(q.data[2]), _mm256_set1_ps(q.data[3]),
+          _mm256_set1_ps(SOFTENING)};
+}
+
+// Squared distances (with the softening) from 'q' to the 8 points at 'base',
+// lane 'j' is point 'j'
+__attribute__((target("avx2"))) inline __m256 SquaredDistances8(
+    const float* base, const QueryLanes8& q) {
+  // [p0 p1], [p2 p3], [p4 p5], [p6 p7]
+  const auto l0 = _mm256_loadu_ps(base);
+  const auto l1 = _mm256_loadu_ps(base + 8);
+  const auto l2 = _mm256_loadu_ps(base + 16);
+  const auto l3 = _mm256_loadu_ps(base + 24);
+
+  // [p0 | p4], [p1 | p5], [p2 | p6], [p3 | p7]
+  const auto a = _mm256_permute2f128_ps(l0, l2, 0x20);
+  const auto b = _mm256_permute2f128_ps(l0, l2, 0x31);
+  const auto c = _mm256_permute2f128_ps(l1, l3, 0x20);
+  const auto d = _mm256_permute2f128_ps(l1, l3, 0x31);
+
+  // In-lane 4x4 transpose
+  const auto t0 = _mm256_unpacklo_ps(a, b);
+  const auto t1 = _mm256_unpackhi_ps(a, b);
+  const auto t2 = _mm256_unpacklo_ps(c, d);
+  const auto t3 = _mm256_unpackhi_ps(c, d);
+
+  const auto dx = _mm256_sub_ps(_mm256_shuffle_ps(t0, t2, 0x44), q.x);
+  const auto dy = _mm256_sub_ps(_mm256_shuffle_ps(t0, t2, 0xEE), q.y);
+  const auto dz = _mm256_sub_ps(_mm256_shuffle_ps(t1, t3, 0x44), q.z);
+  const auto dw = _mm256_sub_ps(_mm256_shuffle_ps(t1, t3, 0xEE), q.w);
+
+  auto sum = _mm256_add_ps(_mm256_mul_ps(dx, dx), _mm256_mul_ps(dy, dy));
+  sum = _mm256_add_ps(sum, _mm256_mul_ps(dz, dz));
+  sum = _mm256_add_ps(sum, _mm256_mul_ps(dw, dw));
+  return _mm256_add_ps(sum, q.softening);
+}
+
+__attribute__((target("avx2"))) inline float MinEuclideanAvx2(
+    const Point4F* leaf_addr, const int n, const Point4F q) {
+  const auto lanes_q = BroadcastQuery8(q);
+  const auto base = reinterpret_cast<const float*>(leaf_addr);
+  auto acc = _mm256_set1_ps(std::numeric_limits<float>::infinity());
+
+  const auto n_body = n - n % 8;
+  int i = 0;
+  for (; i < n_body; i += 8) {
+    // Operand order matters, NaNs (uninitialized padding) are dropped
+    acc = _mm256_min_ps(SquaredDistances8(base + 4 * i, lanes_q), acc);
+  }
+
+  alignas(32) float lanes[8];
+  _mm256_store_ps(lanes, acc);
+  const auto my_min = SqrtOrMax(*std::min_element(lanes, lanes + 8));
+
+  // Tail
+  return std::min(my_min, MinEuclideanScalar(leaf_addr + i, n - i, q));
+}
+
+// Same as 'MinEuclideanAvx2()', the lanes also keep the position of their
+// nearest point
+__attribute__((target("avx2"))) inline reduce::Entry<float>
+NearestEuclideanAvx2(const Point4F* leaf_addr, const int n, const Point4F q) {
+  const auto lanes_q = BroadcastQuery8(q);
+  const auto base = reinterpret_cast<const float*>(leaf_addr);
+  auto acc = _mm256_set1_ps(std::numeric_limits<float>::infinity());
+  auto acc_pos = _mm256_set1_epi32(-1);
+  auto pos = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+  const auto step = _mm256_set1_epi32(8);
+
+  const auto n_body = n - n % 8;
+  int i = 0;
+  for (; i < n_body; i += 8) {
+    const auto sum = SquaredDistances8(base + 4 * i, lanes_q);
+
+    // Ordered compare, NaNs (uninitialized padding) are never closer
+    const auto closer = _mm256_cmp_ps(sum, acc, _CMP_LT_OQ);
+    acc = _mm256_blendv_ps(acc, sum, closer);
+    acc_pos = _mm256_castps_si256(_mm256_blendv_ps(
+        _mm256_castsi256_ps(acc_pos), _mm256_castsi256_ps(pos), closer));
+    pos = _mm256_add_epi32(pos, step);
+  }
+
+  alignas(32) float lanes[8];
+  alignas(32) int lane_pos[8];
+  _mm256_store_ps(lanes, acc);
+  _mm256_store_si256(reinterpret_cast<__m256i*>(lane_pos), acc_pos);
+  return NearestOfLanes(lanes, lane_pos, 8, leaf_addr, n, i, q);
+}
+
+// Every distance, not only the nearest, so the square root is applied to all
+// lanes. 'sqrt' is correctly rounded both ways, the distances are the same.
+__attribute__((target("avx2"))) inline void DistancesEuclideanAvx2(
+    const Point4F* leaf_addr, const int n, const Point4F q, float* out) {
+  const auto lanes_q = BroadcastQuery8(q);
+  const auto base = reinterpret_cast<const float*>(leaf_addr);
+
+  const auto n_body = n - n % 8;
+  int i = 0;
+  for (; i < n_body; i += 8) {
+    _mm256_storeu_ps(out + i,
+                     _mm256_sqrt_ps(SquaredDistances8(base + 4 * i, lanes_q)));
+  }
+
+  // Tail
+  DistancesEuclideanScalar(leaf_addr + i, n - i, q, out + i);
+}
+
+// Same with 16 lanes
+struct QueryLanes16 {
+  __m512 x;
+  __m512 y;
+  __m512 z;
+  __m512 w;
+  __m512 softening;
+};
+
+__attribute__((target("avx512f"))) inline QueryLanes16 BroadcastQuery16(
+    const Point4F q) {
+  return {_mm512_set1_ps(q.data[0]), _mm512_set1_ps(q.data[1]),
+          _mm512_set1_ps(q.data[2]), _mm512_set1_ps(q.data[3]),
+          _mm512_set1_ps(SOFTENING)};
+}
+
+__attribute__((target("avx512f"))) inline __m512 SquaredDistances16(
+    const float* base, const QueryLanes16& q) {
+  // [p0 p1 p2 p3], [p4 .. p7], [p8 .. p11], [p12 .. p15]
+  const auto l0 = _mm512_loadu_ps(base);
+  const auto l1 = _mm512_loadu_ps(base + 16);
+  const auto l2 = _mm512_loadu_ps(base + 32);
+  const auto l3 = _mm512_loadu_ps(base + 48);
+
+  // 4x4 transpose of the 128-bit blocks
+  const auto u0 = _mm512_shuffle_f32x4(l0, l1, 0x44);
+  const auto u1 = _mm512_shuffle_f32x4(l0, l1, 0xEE);
+  const auto u2 = _mm512_shuffle_f32x4(l2, l3, 0x44);
+  const auto u3 = _mm512_shuffle_f32x4(l2, l3, 0xEE);
+
+  // [p0 p4 p8 p12], [p1 p5 p9 p13], [p2 ..], [p3 ..]
+  const auto a = _mm512_shuffle_f32x4(u0, u2, 0x88);
+  const auto b = _mm512_shuffle_f32x4(u0, u2, 0xDD);
+  const auto c = _mm512_shuffle_f32x4(u1, u3, 0x88);
+  const auto d = _mm512_shuffle_f32x4(u1, u3, 0xDD);
+
+  // In-lane 4x4 transpose
+  const auto t0 = _mm512_unpacklo_ps(a, b);
+  const auto t1 = _mm512_unpackhi_ps(a, b);
+  const auto t2 = _mm512_unpacklo_ps(c, d);
+  const auto t3 = _mm512_unpackhi_ps(c, d);
+
+  // Lane 'j' is point 'j'
+  const auto dx = _mm512_sub_ps(_mm512_shuffle_ps(t0, t2, 0x44), q.x);
+  const auto dy = _mm512_sub_ps(_mm512_shuffle_ps(t0, t2, 0xEE), q.y);
+  const auto dz = _mm512_sub_ps(_mm512_shuffle_ps(t1, t3, 0x44), q.z);
+  const auto dw = _mm512_sub_ps(_mm512_shuffle_ps(t1, t3, 0xEE), q.w);
+
+  auto sum = _mm512_add_ps(_mm512_mul_ps(dx, dx), _mm512_mul_ps(dy, dy));
+  sum = _mm512_add_ps(sum, _mm512_mul_ps(dz, dz));
+  sum = _mm512_add_ps(sum, _mm512_mul_ps(dw, dw));
+  return _mm512_add_ps(sum, q.softening);
+}
+
+__attribute__((target("avx512f"))) inline float MinEuclideanAvx512(
+    const Point4F* leaf_addr, const int n, const Point4F q) {
+  const auto lanes_q = BroadcastQuery16(q);
+  const auto base = reinterpret_cast<const float*>(leaf_addr);
+  auto acc = _mm512_set1_ps(std::numeric_limits<float>::infinity());
+
+  const auto n_body = n - n % 16;
+  int i = 0;
+  for (; i < n_body; i += 16) {
+    // Operand order matters, NaNs (uninitialized padding) are dropped
+    acc = _mm512_min_ps(SquaredDistances16(base + 4 * i, lanes_q), acc);
+  }
+
+  alignas(64) float lanes[16];
+  _mm512_store_ps(lanes, acc);
+  const auto my_min = SqrtOrMax(*std::min_element(lanes, lanes + 16));
+
+  // Tail
+  return std::min(my_min, MinEuclideanScalar(leaf_addr + i, n - i, q));
+}
+
+__attribute__((target("avx512f"))) inline reduce::Entry<float>
+NearestEuclideanAvx512(const Point4F* leaf_addr, const int n,
+                       const Point4F q) {
+  const auto lanes_q = BroadcastQuery16(q);
+  const auto base = reinterpret_cast<const float*>(leaf_addr);
+  auto acc = _mm512_set1_ps(std::numeric_limits<float>::infinity());
+  auto acc_pos = _mm512_set1_epi32(-1);
+  auto pos = _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13,
+                               14, 15);
+  const auto step = _mm512_set1_epi32(16);
+
+  const auto n_body = n - n % 16;
+  int i = 0;
+  for (; i < n_body; i += 16) {
+    const auto sum = SquaredDistances16(base + 4 * i, lanes_q);
+
+    // Ordered compare, NaNs (uninitialized padding) are never closer
+    const auto closer = _mm512_cmp_ps_mask(sum, acc, _CMP_LT_OQ);
+    acc = _mm512_mask_blend_ps(closer, acc, sum);
+    acc_pos = _mm512_mask_blend_epi32(closer, acc_pos, pos);
+    pos = _mm512_add_epi32(pos, step);
+  }
+
+  alignas(64) float lanes[16];
+  alignas(64) int lane_pos[16];
+  _mm512_store_ps(lanes, acc);
+  _mm512_store_si512(lane_pos, acc_pos);
+  return NearestOfLanes(lanes, lane_pos, 16, leaf_addr, n, i, q);
+}
+
+__attribute__((target("avx512f"))) inline void DistancesEuclideanAvx512(
+    const Point4F* leaf_addr, const int n, const Point4F q, float* out) {
+  const auto lanes_q = BroadcastQuery16(q);
+  const auto base = reinterpret_cast<const float*>(leaf_addr);
+
+  const auto n_body = n - n % 16;
+  int i = 0;
+  for (; i < n_body; i += 16) {
+    _mm512_storeu_ps(
+        out + i, _mm512_sqrt_ps(SquaredDistances16(base + 4 * i, lanes_q)));
+  }
+
+  // Tail
+  DistancesEuclideanScalar(leaf_addr + i, n - i, q, out + i);
+}
+
+#pragma GCC diagnostic pop
+#pragma GCC pop_options
+
+#endif  // REDWOOD_X86_SIMD
+
+// The scalar, AVX2 and AVX-512 versions of kernel 'name', for
+// 'SelectKernel()'. Only the scalar one where there is no SIMD.
+#if REDWOOD_X86_SIMD
+#define REDWOOD_LEAF_KERNEL_VERSIONS(name) \
+  name##Scalar, name##Avx2, name##Avx512
+#else
+#define REDWOOD_LEAF_KERNEL_VERSIONS(name) \
+  name##Scalar, name##Scalar, name##Scalar
+#endif
+
+// The fastest version the CPU runs
+template <typename Func>
+Func SelectKernel(const Func scalar, [[maybe_unused]] const Func avx2,
+                  [[maybe_unused]] const Func avx512) {
+#if REDWOOD_X86_SIMD
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx512f")) return avx512;
+  if (__builtin_cpu_supports("avx2")) return avx2;
+#endif
+  return scalar;
+}
+
+// Minimum Euclidean distance from 'q' to the first 'n' points of a leaf
+inline float MinEuclidean(const Point4F* leaf_addr, const int n,
+                          const Point4F q) {
+  static const auto impl =
+      SelectKernel<MinDistFunc>(REDWOOD_LEAF_KERNEL_VERSIONS(MinEuclidean));
+  return impl(leaf_addr, n, q);
+}
+
+// Same, and the position of that point in the leaf
+inline reduce::Entry<float> NearestEuclidean(const Point4F* leaf_addr,
+                                             const int n, const Point4F q) {
+  static const auto impl =
+      SelectKernel<NearestFunc>(REDWOOD_LEAF_KERNEL_VERSIONS(NearestEuclidean));
+  return impl(leaf_addr, n, q);
+}
+
+// Euclidean distances from 'q' to each of the first 'n' points of a leaf
+inline void DistancesEuclidean(const Point4F* leaf_addr, const int n,
+                               const Point4F q, float* out) {
+  static const auto impl = SelectKernel<DistancesFunc>(
+      REDWOOD_LEAF_KERNEL_VERSIONS(DistancesEuclidean));
+  impl(leaf_addr, n, q, out);
+}
+
+#undef REDWOOD_LEAF_KERNEL_VERSIONS
+
+// Distance and position of the nearest of the first 'n' points of a leaf (the
+// first one on ties), {max(), -1} if none is closer than 'max()'. Uses the
+// SIMD kernel when the functor and the point type have one.
+template <typename Functor, int Dim, typename T>
+reduce::Entry<T> Nearest(const Functor functor, const Point<Dim, T>* leaf_addr,
+                         const int n, const Point<Dim, T> q) {
+  if constexpr (std::is_same_v<Functor, dist::Euclidean> &&
+                std::is_same_v<Point<Dim, T>, Point4F>) {
+    return NearestEuclidean(leaf_addr, n, q);
+  } else {
+    reduce::Entry<T> best{std::numeric_limits<T>::max(), -1};
+    for (int i = 0; i < n; ++i) {
+      const auto dist = functor(leaf_addr[i], q);
+      if (dist < best.value) best = {dist, i};
+    }
+    return best;
+  }
+}
+
+// Number of the first 'n' points of a leaf closer than 'radius' to 'q'. The
+// positions in the leaf of the first 'max_out' of them go to 'out', in order.
+template <typename Functor, int Dim, typename T>
+int WithinRadius(const Functor functor, const Point<Dim, T>* leaf_addr,
+                 const int n, const Point<Dim, T> q, const T radius,
+                 int* out = nullptr, const int max_out = 0) {
+  auto count = 0;
+  for (int i = 0; i < n; ++i) {
+    if (functor(leaf_addr[i], q) < radius) {
+      if (count < max_out) out[count] = i;
+      ++count;
+    }
+  }
+  return count;
+}
+
+// Fold a whole leaf into 'slot' with 'ReduceOp', the positions are the ones in
+// this leaf. Associative ops are combined locally first, so the slot is only
+// written once per leaf.
+template <typename ReduceOp, typename Functor, int Dim, typename T>
+void Reduce(const Functor functor, const Point<Dim, T>* leaf_addr, const int n,
+            const Point<Dim, T> q, reduce::ValueOf<ReduceOp, T>* slot) {
+  if constexpr (std::is_same_v<ReduceOp, reduce::Min>) {
+    ReduceOp::Insert(slot, Nearest(functor, leaf_addr, n, q));
+  } else if constexpr (ReduceOp::kAssociative) {
+    auto acc = ReduceOp::template Identity<T>();
+    for (int i = 0; i < n; ++i) {
+      acc = ReduceOp::Combine(acc, ReduceOp::Make(functor(leaf_addr[i], q), i));
+    }
+    ReduceOp::Insert(slot, acc);
+  } else if constexpr (std::is_same_v<Functor, dist::Euclidean> &&
+                       std::is_same_v<Point<Dim, T>, Point4F>) {
+    // The distances of a chunk at once with the SIMD kernel, then inserted in
+    // order like below
+    constexpr int kChunk = 64;
+    float dists[kChunk];
+    for (int begin = 0; begin < n; begin += kChunk) {
+      const auto m = std::min(kChunk, n - begin);
+      DistancesEuclidean(leaf_addr + begin, m, q, dists);
+      for (int i = 0; i < m; ++i) {
+        ReduceOp::Insert(slot, ReduceOp::Make(dists[i], begin + i));
+      }
+    }
+  } else {
+    for (int i = 0; i < n; ++i) {
+      ReduceOp::Insert(slot, ReduceOp::Make(functor(leaf_addr[i], q), i));
+    }
+  }
+}
+
+}  // namespace leaf
@@ -0,0 +1,161 @@
+#pragma once
+
+#include <cfloat>
+
+#include "Functors/DistanceMetrics.hpp"
+
+// How the values produced by a functor over a leaf node are folded into a
+// query's result slot. A slot is 'kStride' consecutive 'Value<V>'s in the
+// result buffer, i.e., 'u_out + i * kStride' for the i-th item of a batch, 'V'
+// being the functor's result type (the scalar type of the points, 'float' or
+// 'double'). The kernels wrap each value with 'Make(value, pos)', 'pos' being
+// the position of the point in its leaf, the ops that keep points ('Min',
+// 'TopK') return it along with the value, so the host can tell which point of
+// the leaf a result is.
+//
+// 'kAssociative' ops can first combine a whole leaf (or a warp) into a single
+// value with 'Combine()', starting from 'Identity()', then 'Insert()' it once.
+//
+// The kernels start each slot from 'ResetSlot()', so a slot is the reduction of
+// one leaf and the host never has to write it between batches.
+
+namespace reduce {
+
+// A value and the position in its leaf of the point it came from, -1 for none
+template <typename V>
+struct Entry {
+  V value;
+  int pos;
+};
+
+namespace detail {
+
+template <typename V>
+struct Limits;
+
+template <>
+struct Limits<float> {
+  _REDWOOD_KERNEL_INLINE static float Max() { return FLT_MAX; }
+};
+
+template <>
+struct Limits<double> {
+  _REDWOOD_KERNEL_INLINE static double Max() { return DBL_MAX; }
+};
+
+// Smaller value first, then the first point of the leaf, so the result does
+// not depend on the order the kernel combined the points in
+template <typename V>
+_REDWOOD_KERNEL_INLINE bool Before(const Entry<V> a, const Entry<V> b) {
+  return a.value < b.value || (a.value == b.value && a.pos < b.pos);
+}
+
+}  // namespace detail
+
+// Nearest neighbor, the distance and position of 'KnnSet<V, 1>'
+struct Min {
+  static constexpr int kStride = 1;
+  static constexpr bool kAssociative = true;
+
+  template <typename V>
+  using Value = Entry<V>;
+
+  template <typename V>
+  _REDWOOD_KERNEL_INLINE static Entry<V> Identity() {
+    return {detail::Limits<V>::Max(), -1};
+  }
+
+  template <typename V>
+  _REDWOOD_KERNEL_INLINE static Entry<V> Make(const V value, const int pos) {
+    return {value, pos};
+  }
+
+  template <typename V>
+  _REDWOOD_KERNEL_INLINE static Entry<V> Combine(const Entry<V> a,
+                                                 const Entry<V> b) {
+    return detail::Before(b, a) ? b : a;
+  }
+
+  template <typename V>
+  _REDWOOD_KERNEL_INLINE static void Insert(Entry<V>* slot,
+                                            const Entry<V> value) {
+    if (detail::Before(value, *slot)) *slot = value;
+  }
+};
+
+// Accumulation, e.g., forces in Barnes-Hut or kernel density estimation
+struct Sum {
+  static constexpr int kStride = 1;
+  static constexpr bool kAssociative = true;
+
+  template <typename V>
+  using Value = V;
+
+  template <typename V>
+  _REDWOOD_KERNEL_INLINE static V Identity() {
+    return V(0);
+  }
+
+  template <typename V>
+  _REDWOOD_KERNEL_INLINE static V Make(const V value, const int) {
+    return value;
+  }
+
+  template <typename V>
+  _REDWOOD_KERNEL_INLINE static V Combine(const V a, const V b) {
+    return a + b;
+  }
+
+  template <typename V>
+  _REDWOOD_KERNEL_INLINE static void Insert(V* slot, const V value) {
+    *slot += value;
+  }
+};
+
+// K nearest points, the slot is kept sorted in ascending order. The host side
+// 'KnnSet<V, K>' turns their positions into point ids.
+template <int K>
+struct TopK {
+  static constexpr int kStride = K;
+  static constexpr bool kAssociative = false;
+
+  template <typename V>
+  using Value = Entry<V>;
+
+  template <typename V>
+  _REDWOOD_KERNEL_INLINE static Entry<V> Identity() {
+    return {detail::Limits<V>::Max(), -1};
+  }
+
+  template <typename V>
+  _REDWOOD_KERNEL_INLINE static Entry<V> Make(const V value, const int pos) {
+    return {value, pos};
+  }
+
+  template <typename V>
+  _REDWOOD_KERNEL_INLINE static void Insert(Entry<V>* slot,
+                                            const Entry<V> value) {
+    if (!detail::Before(value, slot[K - 1])) return;
+
+    // Shift everything after 'value' to the back by one
+    auto i = K - 1;
+    for (; i > 0 && detail::Before(value, slot[i - 1]); --i) {
+      slot[i] = slot[i - 1];
+    }
+    slot[i] = value;
+  }
+};
+
+// What a slot of 'ReduceOp' is made of, for values of type 'V'
+template <typename ReduceOp, typename V>
+using ValueOf = typename ReduceOp::template Value<V>;
+
+// All 'kStride' values of a slot to the identity, 'V' is not deduced
+template <typename ReduceOp, typename V>
+_REDWOOD_KERNEL_INLINE void ResetSlot(ValueOf<ReduceOp, V>* slot) {
+  for (int i = 0; i < ReduceOp::kStride; ++i) {
+    slot[i] = ReduceOp::template Identity<V>();
+  }
+}
+
+}  // namespace reduce
@@ -2,5 +2,6 @@
 
 #include "Redwood/Core.hpp"
 #include "Redwood/Kernel.hpp"
+#include "Redwood/Numa.hpp"
 #include "Redwood/Point.hpp"
 #include "Redwood/Usm.hpp"
@@ -1,11 +1,17 @@
 #pragma once
 
+#include <cstddef>
 #include <vector>
 
 namespace redwood {
 
 // --- Public APIs (need to be implemented by the backends) --
-void Init(int num_threads);
+// Each of the 'num_threads' traversal threads gets 'num_streams' streams, i.e.,
+// how many batches it can have in flight (2 is double buffering). Also assigns
+// the threads to NUMA nodes/CPUs. It does not pin anything, the traversal
+// threads are the OpenMP ones of the caller, which pin themselves with
+// 'numa::ScopedPin' for the length of a traversal.
+void Init(int num_threads, int num_streams = 2);
 
 void DeviceSynchronize();
 void DeviceStreamSynchronize(int tid, int stream_id);
@@ -13,4 +19,30 @@ void DeviceStreamSynchronize(int tid, int stream_id);
 // only useful in CUDA
 void AttachStreamMem(int tid, int stream_id, void* addr);
 
+// Copy 'bytes' from 'src' to 'dst' once the work already submitted to stream
+// (tid, stream_id) is done, without blocking the caller. Either side can be USM
+// or host memory. Record an event after it to know when 'dst' is ready.
+void MemcpyAsync(void* dst, const void* src, std::size_t bytes, int tid,
+                 int stream_id);
+
+// --- Asynchronous completion (events) --
+// Opaque handle, what it points to is decided by the backend
+struct Event {
+  void* handle = nullptr;
+};
+
+Event CreateEvent();
+void DestroyEvent(Event event);
+
+// Capture all work submitted to stream (tid, stream_id) so far
+void EventRecord(Event event, int tid, int stream_id);
+
+// Non-blocking. True if the work captured by the last 'EventRecord' is done
+// (also true if the event has never been recorded).
+bool EventQuery(Event event);
+void EventSynchronize(Event event);
+
+// Non-blocking version of 'DeviceStreamSynchronize'
+bool StreamQuery(int tid, int stream_id);
+
 }  // namespace redwood
\ No newline at end of file
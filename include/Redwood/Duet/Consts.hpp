@@ -5,7 +5,9 @@ namespace duet {
 constexpr auto kDebugPrint = false;
 
 // Global Consts
+// Default number of engines, see 'duet::SetNumEngines()'
 constexpr auto kNEngine = 1;
+constexpr auto kMaxEngines = 16;
 constexpr auto kDuetLeafSize = 32;
 constexpr auto kEpssq = 1e-9;
 
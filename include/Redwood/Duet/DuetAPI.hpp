@@ -1,7 +1,15 @@
 #pragma once
 
+#include <cstdint>
+#include <vector>
+
 namespace duet {
 
+// Number of engines to map, must be called before 'redwood::Init()'. Threads
+// are assigned to engines by 'redwood::Init()'.
+void SetNumEngines(int num_engines);
+int NumEngines();
+
 // Set anchor registers
 // Like 'x0, y0, z0'
 void Start(const long tid, const void* query_element);
@@ -9,6 +17,21 @@ void Start(const long tid, const void* query_element);
 // Push leaf_no_base_addr to the duet registers
 void PushLeaf32(const long tid, const void* node_base_addr);
 
+// Block until every leaf pushed since 'Start()' has been reduced
+void Wait(const long tid);
+
+// The finish counts ('kFincnt') the engines of the thread reach once every
+// leaf pushed so far has been reduced. They never go back, so they stay valid
+// across 'Start()'.
+std::vector<uint64_t> FinishCounts(const long tid);
+
+// Non-blocking, true if the engines of the thread reached 'counts'
+bool Reached(const long tid, const std::vector<uint64_t>& counts);
+
+// Accumulated forces ('Point3D') of the leaves pushed since 'Start()', call
+// 'Wait()' first
+void GetResult(const long tid, void* result);
+
 // Simple reduction on host
 // void PushBranch(long tid, const void* node_element, unsigned query_idx);
 
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include <cstdlib>
+
+#include "Redwood/Usm.hpp"
+#include "Redwood/UsmPool.hpp"
+
+// Raw allocator of the backends where 'USM' is just host memory (cpu, duet).
+// Blocks below 2 MB come from 'aligned_alloc()', larger ones are mapped
+// directly so they can be backed by huge pages and/or pre-faulted.
+
+namespace redwood {
+namespace host {
+
+// Cache line size, also good enough for SIMD loads
+constexpr std::size_t kAlignment = 64;
+
+inline UsmOptions options;
+
+inline void Populate(void* ptr, const std::size_t bytes) {
+  const auto page_size = static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+  const auto base = static_cast<volatile char*>(ptr);
+  for (std::size_t i = 0; i < bytes; i += page_size) {
+    base[i] = 0;
+  }
+}
+
+inline void* MapLarge(const std::size_t bytes) {
+  constexpr auto kProt = PROT_READ | PROT_WRITE;
+  constexpr auto kFlags = MAP_PRIVATE | MAP_ANONYMOUS;
+  const auto populate_flag = options.populate ? MAP_POPULATE : 0;
+
+  // Explicit huge pages only work if the admin reserved some, fall back to
+  // transparent huge pages otherwise.
+  if (options.huge_pages) {
+    const auto huge_flags = kFlags | MAP_HUGETLB | populate_flag;
+    const auto ptr = mmap(nullptr, bytes, kProt, huge_flags, -1, 0);
+    if (ptr != MAP_FAILED) return ptr;
+  }
+
+  const auto ptr = mmap(nullptr, bytes, kProt, kFlags, -1, 0);
+  if (ptr == MAP_FAILED) return nullptr;
+
+  if (options.huge_pages) {
+    madvise(ptr, bytes, MADV_HUGEPAGE);
+  }
+  // After 'madvise()', so the faults already use huge pages
+  if (options.populate) {
+    Populate(ptr, bytes);
+  }
+  return ptr;
+}
+
+inline void* RawMalloc(const std::size_t bytes) {
+  if (bytes >= UsmPool::kHugePageSize) {
+    return MapLarge(bytes);
+  }
+  // Class sizes are multiples of 'kAlignment', as 'aligned_alloc()' requires
+  return aligned_alloc(kAlignment, bytes);
+}
+
+inline void RawFree(void* ptr, const std::size_t bytes) {
+  if (bytes >= UsmPool::kHugePageSize) {
+    munmap(ptr, bytes);
+  } else {
+    free(ptr);
+  }
+}
+
+// Any size is mapped, so the block shares no page with memory already written
+// elsewhere. Never populated: the first write decides the NUMA node.
+inline void* MapPlaced(const std::size_t bytes) {
+  const auto ptr = mmap(nullptr, bytes, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (ptr == MAP_FAILED) return nullptr;
+
+  if (options.huge_pages && bytes >= UsmPool::kHugePageSize) {
+    madvise(ptr, bytes, MADV_HUGEPAGE);
+  }
+  return ptr;
+}
+
+inline void UnmapPlaced(void* ptr, const std::size_t bytes) {
+  munmap(ptr, bytes);
+}
+
+}  // namespace host
+}  // namespace redwood
@@ -1,13 +1,40 @@
 #pragma once
 
+#include "Functors/ReduceOps.hpp"
 #include "Point.hpp"
 
 namespace redwood {
 
-template <typename T, typename Functor>
-void NearestNeighborKernel(int tid, int stream_id, const T* u_lnt,
-                           int max_leaf_size, const T* u_q,
-                           const int* u_node_idx, int num_active, float* u_out,
-                           Functor functor);
+// Generic leaf reduction. For the i-th item of the batch, evaluates 'Functor'
+// between 'u_q[i]' and every point of leaf 'u_node_idx[i]', and folds the
+// values into result slot 'u_out + i * ReduceOp::kStride' with 'ReduceOp' (see
+// 'Functors/ReduceOps.hpp'). The slot is reset first, whatever was in it is
+// overwritten. For 'reduce::Min' and 'reduce::TopK' the slot also has the
+// positions of the points in the leaf.
+//
+// The leaves are packed back to back in 'u_lnt', leaf 'j' is the points
+// [u_lnt_offsets[j], u_lnt_offsets[j + 1]), so there is no padding to skip.
+// The points are any 'Point<Dim, T>', the values are in 'T'.
+//
+// Only the triples listed in 'Redwood/KernelRegistry.hpp' are instantiated.
+template <typename Functor, typename ReduceOp, int Dim, typename T>
+void LaunchReduction(int tid, int stream_id, const Point<Dim, T>* u_lnt,
+                     const int* u_lnt_offsets, const Point<Dim, T>* u_q,
+                     const int* u_node_idx, int num_active,
+                     reduce::ValueOf<ReduceOp, T>* u_out);
 
-}  // namespace redwood
\ No newline at end of file
+// Fixed-radius search. For the i-th item of the batch, 'u_counts[i]' is the
+// number of points of leaf 'u_node_idx[i]' closer than 'radius' to 'u_q[i]'
+// ('Functor' distance), and 'u_matches + i * match_stride' their positions in
+// the leaf. Only the first 'match_stride' are written, so a count larger than
+// it means the slot overflowed. Count only with 'match_stride == 0'.
+//
+// Same leaf node table as 'LaunchReduction()'. Only the pairs listed in
+// 'REDWOOD_RADIUS_KERNEL_LIST' are instantiated.
+template <typename Functor, int Dim, typename T>
+void LaunchRadiusSearch(int tid, int stream_id, const Point<Dim, T>* u_lnt,
+                        const int* u_lnt_offsets, const Point<Dim, T>* u_q,
+                        const int* u_node_idx, int num_active, T radius,
+                        int* u_counts, int* u_matches, int match_stride);
+
+}  // namespace redwood
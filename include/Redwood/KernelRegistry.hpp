@@ -0,0 +1,84 @@
+#pragma once
+
+#include <type_traits>
+
+#include "Functors/DistanceMetrics.hpp"
+#include "Functors/ReduceOps.hpp"
+
+// Every (functor, reduce op, point type) triple 'redwood::LaunchReduction()' is
+// instantiated for. Each backend expands 'REDWOOD_KERNEL_LIST' with an explicit
+// instantiation macro, so adding a functor, an op or a point type here is
+// enough to get a specialized kernel on all of them.
+
+#define REDWOOD_REDUCE_OP_LIST(X, Functor, PointT) \
+  X(Functor, reduce::Min, PointT)                  \
+  X(Functor, reduce::Sum, PointT)                  \
+  X(Functor, reduce::TopK<4>, PointT)              \
+  X(Functor, reduce::TopK<8>, PointT)              \
+  X(Functor, reduce::TopK<16>, PointT)             \
+  X(Functor, reduce::TopK<32>, PointT)             \
+  X(Functor, reduce::TopK<64>, PointT)             \
+  X(Functor, reduce::TopK<128>, PointT)            \
+  X(Functor, reduce::TopK<256>, PointT)
+
+// The metrics, for points of any dimension and scalar type
+#define REDWOOD_METRIC_LIST(X, PointT)                \
+  REDWOOD_REDUCE_OP_LIST(X, dist::Euclidean, PointT) \
+  REDWOOD_REDUCE_OP_LIST(X, dist::Manhattan, PointT) \
+  REDWOOD_REDUCE_OP_LIST(X, dist::Chebyshev, PointT)
+
+#define REDWOOD_KERNEL_LIST(X)                       \
+  REDWOOD_METRIC_LIST(X, Point4F)                    \
+  REDWOOD_REDUCE_OP_LIST(X, dist::Gravity, Point4F)  \
+  REDWOOD_REDUCE_OP_LIST(X, dist::Gaussian, Point4F) \
+  REDWOOD_REDUCE_OP_LIST(X, dist::TopHat, Point4F)   \
+  REDWOOD_METRIC_LIST(X, Point2F)                    \
+  REDWOOD_METRIC_LIST(X, Point3F)                    \
+  REDWOOD_METRIC_LIST(X, Point2D)                    \
+  REDWOOD_METRIC_LIST(X, Point3D)                    \
+  REDWOOD_METRIC_LIST(X, Point4D)
+
+// Every (functor, point type) pair 'redwood::LaunchRadiusSearch()' is
+// instantiated for. Only true metrics, the others are not distances.
+#define REDWOOD_RADIUS_METRIC_LIST(X, PointT) \
+  X(dist::Euclidean, PointT)                  \
+  X(dist::Manhattan, PointT)                  \
+  X(dist::Chebyshev, PointT)
+
+#define REDWOOD_RADIUS_KERNEL_LIST(X)    \
+  REDWOOD_RADIUS_METRIC_LIST(X, Point4F) \
+  REDWOOD_RADIUS_METRIC_LIST(X, Point2F) \
+  REDWOOD_RADIUS_METRIC_LIST(X, Point3F) \
+  REDWOOD_RADIUS_METRIC_LIST(X, Point2D) \
+  REDWOOD_RADIUS_METRIC_LIST(X, Point3D) \
+  REDWOOD_RADIUS_METRIC_LIST(X, Point4D)
+
+namespace redwood {
+
+// Whether the backends provide 'LaunchReduction<Functor, ReduceOp>' for points
+// of type 'PointT', use it in a 'static_assert' to get a compile error instead
+// of a link error.
+template <typename Functor, typename ReduceOp, typename PointT>
+struct IsKernelRegistered : std::false_type {};
+
+#define REDWOOD_REGISTER_KERNEL(Functor, ReduceOp, PointT) \
+  template <>                                              \
+  struct IsKernelRegistered<Functor, ReduceOp, PointT> : std::true_type {};
+
+REDWOOD_KERNEL_LIST(REDWOOD_REGISTER_KERNEL)
+
+#undef REDWOOD_REGISTER_KERNEL
+
+// Same for 'LaunchRadiusSearch<Functor>'
+template <typename Functor, typename PointT>
+struct IsRadiusKernelRegistered : std::false_type {};
+
+#define REDWOOD_REGISTER_RADIUS_KERNEL(Functor, PointT) \
+  template <>                                           \
+  struct IsRadiusKernelRegistered<Functor, PointT> : std::true_type {};
+
+REDWOOD_RADIUS_KERNEL_LIST(REDWOOD_REGISTER_RADIUS_KERNEL)
+
+#undef REDWOOD_REGISTER_RADIUS_KERNEL
+
+}  // namespace redwood
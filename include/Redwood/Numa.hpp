@@ -0,0 +1,247 @@
+#pragma once
+
+#include <pthread.h>
+#include <sched.h>
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Redwood/Usm.hpp"
+
+// NUMA topology and thread placement, without depending on libnuma. The
+// topology is read from sysfs, memory placement relies on the Linux first-touch
+// policy: a page is allocated on the node of the thread that first writes it.
+
+namespace redwood {
+namespace numa {
+
+struct Topology {
+  // CPUs of each node, e.g., node_cpus[1] = {16, 17, ..., 31}
+  std::vector<std::vector<int>> node_cpus;
+};
+
+// Parses a sysfs cpu list such as "0-3,8,10-11"
+inline std::vector<int> ParseCpuList(const std::string& list) {
+  std::vector<int> cpus;
+  std::stringstream ss(list);
+  std::string range;
+  while (std::getline(ss, range, ',')) {
+    if (range.empty() || range == "\n") continue;
+    const auto dash = range.find('-');
+    const auto first = std::stoi(range.substr(0, dash));
+    const auto last =
+        dash == std::string::npos ? first : std::stoi(range.substr(dash + 1));
+    for (int cpu = first; cpu <= last; ++cpu) cpus.push_back(cpu);
+  }
+  return cpus;
+}
+
+inline Topology ReadTopology() {
+  Topology topo;
+  for (int node = 0;; ++node) {
+    std::ifstream file("/sys/devices/system/node/node" + std::to_string(node) +
+                       "/cpulist");
+    if (!file) break;
+
+    std::string list;
+    std::getline(file, list);
+    auto cpus = ParseCpuList(list);
+    // Memory only nodes have no CPU to run on
+    if (!cpus.empty()) topo.node_cpus.push_back(std::move(cpus));
+  }
+
+  // No sysfs (or not Linux), treat the machine as a single node
+  if (topo.node_cpus.empty()) {
+    const auto n = std::max(1u, std::thread::hardware_concurrency());
+    topo.node_cpus.emplace_back();
+    for (unsigned cpu = 0; cpu < n; ++cpu) {
+      topo.node_cpus[0].push_back(static_cast<int>(cpu));
+    }
+  }
+  return topo;
+}
+
+inline const Topology& GetTopology() {
+  static const auto topo = ReadTopology();
+  return topo;
+}
+
+inline int NumNodes() {
+  return static_cast<int>(GetTopology().node_cpus.size());
+}
+
+// Node and CPU of each traversal thread, see 'AssignThreads()'
+inline std::vector<int> thread_nodes;
+inline std::vector<int> thread_cpus;
+
+// Spread 'num_threads' traversal threads over the nodes in contiguous blocks
+// (so neighbouring thread ids share a node), then over the CPUs of each node.
+// Called by the backends' 'redwood::Init()'.
+inline void AssignThreads(const int num_threads) {
+  const auto& topo = GetTopology();
+  const auto num_nodes = NumNodes();
+
+  thread_nodes.resize(num_threads);
+  thread_cpus.resize(num_threads);
+  std::vector<int> next_cpu(num_nodes, 0);
+  for (int tid = 0; tid < num_threads; ++tid) {
+    const auto node = tid * num_nodes / num_threads;
+    const auto& cpus = topo.node_cpus[node];
+    thread_nodes[tid] = node;
+    thread_cpus[tid] = cpus[next_cpu[node]++ % cpus.size()];
+  }
+}
+
+inline int NodeOf(const int tid) {
+  return tid < static_cast<int>(thread_nodes.size()) ? thread_nodes[tid] : 0;
+}
+
+inline bool PinToCpus(const std::vector<int>& cpus) {
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  for (const auto cpu : cpus) CPU_SET(cpu, &set);
+  return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+}
+
+// Pin the calling thread to any CPU of 'node'
+inline bool PinToNode(const int node) {
+  return PinToCpus(GetTopology().node_cpus[node]);
+}
+
+// Pin the calling thread to the CPU assigned to traversal thread 'tid', after
+// 'redwood::Init()'. The pin lasts for the life of the thread, inside an
+// OpenMP parallel region use 'ScopedPin' instead.
+inline bool PinThread(const int tid) {
+  if (tid >= static_cast<int>(thread_cpus.size())) return false;
+  return PinToCpus({thread_cpus[tid]});
+}
+
+// 'PinThread()' until the end of the scope, then the thread gets its previous
+// affinity back. OpenMP runs the region on the caller (thread 0) and on pooled
+// threads, neither should stay narrowed to one CPU once the traversal is done.
+class ScopedPin {
+ public:
+  explicit ScopedPin(const int tid) {
+    saved_ = pthread_getaffinity_np(pthread_self(), sizeof(previous_),
+                                    &previous_) == 0;
+    pinned_ = saved_ && PinThread(tid);
+  }
+
+  ~ScopedPin() {
+    if (pinned_) {
+      pthread_setaffinity_np(pthread_self(), sizeof(previous_), &previous_);
+    }
+  }
+
+  ScopedPin(const ScopedPin&) = delete;
+  ScopedPin& operator=(const ScopedPin&) = delete;
+
+ private:
+  cpu_set_t previous_;
+  bool saved_ = false;
+  bool pinned_ = false;
+};
+
+// Run 'f' on a helper thread pinned to 'node', pages it writes first are
+// allocated on that node.
+template <typename Func>
+void RunOnNode(const int node, Func&& f) {
+  std::thread worker([&] {
+    PinToNode(node);
+    f();
+  });
+  worker.join();
+}
+
+inline void TouchOnNode(const int node, void* ptr, const std::size_t bytes) {
+  RunOnNode(node, [&] { std::memset(ptr, 0, bytes); });
+}
+
+inline void CopyOnNode(const int node, void* dst, const void* src,
+                       const std::size_t bytes) {
+  RunOnNode(node, [&] { std::memcpy(dst, src, bytes); });
+}
+
+// Writes page 'i' of the buffer from node 'i % num_nodes'
+inline void InterleaveOnNodes(void* ptr, const std::size_t bytes,
+                              const std::size_t page_size = 4096) {
+  const auto num_nodes = NumNodes();
+  const auto base = static_cast<char*>(ptr);
+  for (int node = 0; node < num_nodes; ++node) {
+    RunOnNode(node, [&] {
+      const auto stride = page_size * num_nodes;
+      for (auto offset = page_size * node; offset < bytes; offset += stride) {
+        std::memset(base + offset, 0, std::min(page_size, bytes - offset));
+      }
+    });
+  }
+}
+
+// Page placement of shared read-mostly tables, e.g., the leaf node table
+enum class Placement {
+  kFirstTouch,  // Wherever the thread filling the table runs
+  kInterleave,  // Pages spread round-robin over the nodes
+  kReplicate,   // One full copy per node
+};
+
+// 'name' is one of first_touch, interleave, replicate
+inline Placement ParsePlacement(const std::string& name) {
+  if (name == "first_touch") return Placement::kFirstTouch;
+  if (name == "interleave") return Placement::kInterleave;
+  if (name == "replicate") return Placement::kReplicate;
+  throw std::runtime_error("Error: unknown placement '" + name + "'.");
+}
+
+// USM array of 'n' elements placed according to 'placement'. Returns one
+// pointer per node for 'kReplicate' (index by 'NodeOf(tid)'), a single one
+// otherwise. Only [0] should be filled, then call 'SyncReplicas()'. The blocks
+// come from 'UsmMallocPlaced()', a reused or pre-faulted one would already
+// have its pages on some node.
+template <typename T>
+std::vector<T*> AllocatePlaced(const std::size_t n, const Placement placement) {
+  const auto bytes = n * sizeof(T);
+  const auto num_nodes = NumNodes();
+
+  std::vector<T*> replicas;
+  if (placement == Placement::kReplicate) {
+    for (int node = 0; node < num_nodes; ++node) {
+      replicas.push_back(UsmMallocPlaced<T>(n));
+      if (num_nodes > 1) TouchOnNode(node, replicas.back(), bytes);
+    }
+  } else {
+    replicas.push_back(UsmMallocPlaced<T>(n));
+    if (placement == Placement::kInterleave && num_nodes > 1) {
+      InterleaveOnNodes(replicas.back(), bytes);
+    }
+  }
+  return replicas;
+}
+
+// Copy [0] into the other replicas, from their own node
+template <typename T>
+void SyncReplicas(const std::vector<T*>& replicas, const std::size_t n) {
+  for (std::size_t node = 1; node < replicas.size(); ++node) {
+    CopyOnNode(static_cast<int>(node), replicas[node], replicas[0],
+               n * sizeof(T));
+  }
+}
+
+template <typename T>
+void FreePlaced(const std::vector<T*>& replicas) {
+  for (const auto ptr : replicas) UsmFree(ptr);
+}
+
+// First-touch a per-thread buffer on the node of 'tid', allocate it with
+// 'UsmMallocPlaced()'
+inline void TouchForThread(const int tid, void* ptr, const std::size_t bytes) {
+  if (NumNodes() > 1) TouchOnNode(NodeOf(tid), ptr, bytes);
+}
+
+}  // namespace numa
+}  // namespace redwood
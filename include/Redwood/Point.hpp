@@ -12,6 +12,9 @@ struct Point {
   static_assert(std::is_arithmetic<T>::value, "T must be numeric");
   static_assert(Dim > 0, "Dim must be greater than 0");
 
+  static constexpr int kDims = Dim;
+  using Scalar = T;
+
   Point() = default;
 
   T data[Dim];
@@ -1,17 +1,73 @@
 #pragma once
 
+#include <cstddef>
+#include <cstdint>
 #include <vector>
 
 namespace redwood {
 
+// Allocations are served from a size-class pool (see 'UsmPool.hpp'), freed
+// blocks are cached and reused instead of returned to the device.
 void* UsmMalloc(std::size_t n);
 void UsmFree(void* ptr);
 
+// For blocks placed on NUMA nodes by first touch (see 'Numa.hpp'). A fresh
+// block, neither taken from the pool nor pre-faulted, so its pages land where
+// they are first written. 'UsmFree()' gives it straight back to the device.
+void* UsmMallocPlaced(std::size_t n);
+
+struct UsmStats {
+  // Bytes handed out to the user (rounded up to size classes), bytes freed by
+  // the user but kept for reuse, and bytes obtained from the device (both).
+  std::size_t bytes_in_use;
+  std::size_t bytes_cached;
+  std::size_t bytes_reserved;
+  std::size_t peak_bytes_reserved;
+
+  uint64_t num_allocs;
+  uint64_t num_frees;
+  uint64_t num_reused;      // Served from the cache
+  uint64_t num_raw_allocs;  // Reached the device allocator
+};
+
+struct UsmOptions {
+  // Back large blocks (>= 2 MB) with huge pages. CPU backends only.
+  bool huge_pages = false;
+  // Pre-fault large blocks when they are allocated. CPU backends only.
+  bool populate = false;
+  // Log every allocation and free to std::cout
+  bool verbose = false;
+};
+
+// Affects the allocations made after the call
+void SetUsmOptions(const UsmOptions& options);
+
+UsmStats GetUsmStats();
+
+// Release all cached (free) blocks back to the device
+void UsmTrim();
+
+// Page-locked host memory, for the host side of 'MemcpyAsync()'. On CUDA, a
+// copy into pageable memory only returns once it is done, so it would wait
+// for the kernels before it. Not pooled, allocate it once.
+void* HostMalloc(std::size_t n);
+void HostFree(void* ptr);
+
 template <typename T>
 T* UsmMalloc(std::size_t n) {
   return static_cast<T*>(UsmMalloc(n * sizeof(T)));
 }
 
+template <typename T>
+T* UsmMallocPlaced(std::size_t n) {
+  return static_cast<T*>(UsmMallocPlaced(n * sizeof(T)));
+}
+
+template <typename T>
+T* HostMalloc(std::size_t n) {
+  return static_cast<T*>(HostMalloc(n * sizeof(T)));
+}
+
 template <typename T>
 class UsmAlloc {
  public:
@@ -49,4 +105,4 @@ bool operator!=(const UsmAlloc<T>&, const UsmAlloc<U>&) {
 
 template <typename T>
 using UsmVector = std::vector<T, redwood::UsmAlloc<T>>;
-}  // namespace redwood
\ No newline at end of file
+}  // namespace redwood
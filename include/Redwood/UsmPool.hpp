@@ -0,0 +1,164 @@
+#pragma once
+
+#include <cstddef>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "Redwood/Usm.hpp"
+
+namespace redwood {
+
+// Size-class caching layer shared by the backends' 'UsmMalloc()'. Requests are
+// rounded up to a class, and freed blocks are kept in a per-class free list to
+// be handed out again, so the raw allocator (and the page faults of fresh
+// memory) is only paid once per block.
+//
+// Classes are powers of two from 256 bytes up to 2 MB, then multiples of 2 MB
+// (the huge page size), which bounds the waste of large allocations such as
+// the leaf node table.
+class UsmPool {
+ public:
+  using RawMallocFunc = void* (*)(std::size_t bytes);
+  using RawFreeFunc = void (*)(void* ptr, std::size_t bytes);
+
+  static constexpr std::size_t kMinClassSize = 256;
+  static constexpr std::size_t kHugePageSize = std::size_t{2} << 20;
+
+  UsmPool(const RawMallocFunc raw_malloc, const RawFreeFunc raw_free)
+      : raw_malloc_(raw_malloc), raw_free_(raw_free) {}
+
+  UsmPool(const UsmPool&) = delete;
+  UsmPool& operator=(const UsmPool&) = delete;
+
+  // Cached blocks are intentionally not released here, the device runtime may
+  // already be torn down at static destruction time. Call 'Trim()' instead.
+
+  static std::size_t ClassSize(const std::size_t n) {
+    if (n > kHugePageSize) {
+      return (n + kHugePageSize - 1) / kHugePageSize * kHugePageSize;
+    }
+    auto size = kMinClassSize;
+    while (size < n) size <<= 1;
+    return size;
+  }
+
+  void* Allocate(const std::size_t n) {
+    const auto size = ClassSize(n);
+
+    std::lock_guard<std::mutex> lock(mtx_);
+    void* ptr = nullptr;
+
+    auto& free_list = free_lists_[size];
+    if (!free_list.empty()) {
+      ptr = free_list.back();
+      free_list.pop_back();
+      stats_.bytes_cached -= size;
+      ++stats_.num_reused;
+    } else {
+      ptr = raw_malloc_(size);
+      if (ptr == nullptr) return nullptr;
+      stats_.bytes_reserved += size;
+      ++stats_.num_raw_allocs;
+      if (stats_.bytes_reserved > stats_.peak_bytes_reserved) {
+        stats_.peak_bytes_reserved = stats_.bytes_reserved;
+      }
+    }
+
+    live_[ptr] = size;
+    stats_.bytes_in_use += size;
+    ++stats_.num_allocs;
+    return ptr;
+  }
+
+  // Bypasses the free lists, the block comes from 'raw_malloc' and goes back
+  // to 'raw_free' as soon as it is freed. For blocks that must not have been
+  // written before, see 'UsmMallocPlaced()'. Exactly 'n' bytes, no class.
+  void* AllocateUncached(const std::size_t n, const RawMallocFunc raw_malloc,
+                         const RawFreeFunc raw_free) {
+    const auto ptr = raw_malloc(n);
+    if (ptr == nullptr) return nullptr;
+
+    std::lock_guard<std::mutex> lock(mtx_);
+    uncached_[ptr] = Uncached{n, raw_free};
+    stats_.bytes_reserved += n;
+    stats_.bytes_in_use += n;
+    ++stats_.num_raw_allocs;
+    ++stats_.num_allocs;
+    if (stats_.bytes_reserved > stats_.peak_bytes_reserved) {
+      stats_.peak_bytes_reserved = stats_.bytes_reserved;
+    }
+    return ptr;
+  }
+
+  // Same with the raw allocator of the pool
+  void* AllocateUncached(const std::size_t n) {
+    return AllocateUncached(n, raw_malloc_, raw_free_);
+  }
+
+  // Returns false if 'ptr' was not allocated by this pool
+  bool Free(void* ptr) {
+    std::lock_guard<std::mutex> lock(mtx_);
+    const auto it = live_.find(ptr);
+    if (it == live_.end()) return FreeUncached(ptr);
+
+    const auto size = it->second;
+    live_.erase(it);
+    free_lists_[size].push_back(ptr);
+
+    stats_.bytes_in_use -= size;
+    stats_.bytes_cached += size;
+    ++stats_.num_frees;
+    return true;
+  }
+
+  // Give every cached block back to the raw allocator
+  void Trim() {
+    std::lock_guard<std::mutex> lock(mtx_);
+    for (auto& [size, free_list] : free_lists_) {
+      for (const auto ptr : free_list) {
+        raw_free_(ptr, size);
+        stats_.bytes_reserved -= size;
+      }
+      free_list.clear();
+    }
+    stats_.bytes_cached = 0;
+  }
+
+  UsmStats Stats() {
+    std::lock_guard<std::mutex> lock(mtx_);
+    return stats_;
+  }
+
+ private:
+  struct Uncached {
+    std::size_t size;
+    RawFreeFunc raw_free;
+  };
+
+  // Called with 'mtx_' held
+  bool FreeUncached(void* ptr) {
+    const auto it = uncached_.find(ptr);
+    if (it == uncached_.end()) return false;
+
+    const auto [size, raw_free] = it->second;
+    uncached_.erase(it);
+    raw_free(ptr, size);
+
+    stats_.bytes_in_use -= size;
+    stats_.bytes_reserved -= size;
+    ++stats_.num_frees;
+    return true;
+  }
+
+  RawMallocFunc raw_malloc_;
+  RawFreeFunc raw_free_;
+
+  std::mutex mtx_;
+  std::unordered_map<std::size_t, std::vector<void*>> free_lists_;
+  std::unordered_map<void*, std::size_t> live_;
+  std::unordered_map<void*, Uncached> uncached_;
+  UsmStats stats_{};
+};
+
+}  // namespace redwood
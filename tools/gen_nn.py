@@ -8,24 +8,29 @@ parser.add_argument("--filename", type=str, default="../data/input_nn_1m_4f.dat"
                     help="Name of the output file (default: ../data/input_nn_1m_4f.dat)")
 parser.add_argument("--distribution", type=str, default="uniform",
                     help="Type of distribution to use (default: uniform)")
+parser.add_argument("--dims", type=int, default=4, choices=[2, 3, 4],
+                    help="Dimension of the points, run with the same --dims (default: 4)")
+parser.add_argument("--dtype", type=str, default="float32",
+                    choices=["float32", "float64"],
+                    help="Type of the coordinates, float64 needs --double (default: float32)")
 args = parser.parse_args()
 
 # Define the dimensions of the array
-dimensions = 4
+dimensions = args.dims
 
 # Define the range of the coordinates
 low = 0.0
 high = 1024.0
 
-# Generate the random points as float32
+# Generate the random points as 'args.dtype'
 if args.distribution == "uniform":
     points = np.random.uniform(low, high, size=(
-        args.num_points, dimensions)).astype(np.float32)
+        args.num_points, dimensions)).astype(args.dtype)
 elif args.distribution == "normal":
     mean = (high + low) / 2.0
     std_dev = (high - low) / 6.0
     points = np.random.normal(mean, std_dev, size=(
-        args.num_points, dimensions)).astype(np.float32)
+        args.num_points, dimensions)).astype(args.dtype)
 else:
     raise ValueError("Invalid distribution type")
 